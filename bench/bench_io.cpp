@@ -0,0 +1,85 @@
+#include "bench_util.h"
+
+#include "base/io_util.h"
+
+#include <cstdio>
+
+using namespace NAMESPACE_NAME;
+
+static void BM_parse_ffm(benchmark::State& state) {
+		auto data = DataSet::dummy(bench_entries, bench_features, bench_fields,
+								   state.range(0), bench_seed);
+		String filename = "bench_parse.ffm";
+		data->serialize_txt(filename);
+		size_t n_bytes = filesystem::file_size(filename.c_str());
+		for (auto _ : state) {
+				auto parsed = DataSet::from_file(filename, false, " ");
+				benchmark::DoNotOptimize(parsed->size());
+		}
+		state.SetBytesProcessed(state.iterations() * n_bytes);
+		state.SetItemsProcessed(state.iterations() * data->size());
+		std::remove(filename.c_str());
+}
+BENCHMARK(BM_parse_ffm)->ArgName("nnz")->Arg(4)->Arg(16)->Arg(64);
+
+static void BM_data_set_serialize(benchmark::State& state) {
+		auto data = bench_data();
+		String filename = "bench_data_set.bin";
+		for (auto _ : state) {
+				data->serialize(filename);
+		}
+		state.SetBytesProcessed(state.iterations()
+								* filesystem::file_size(filename.c_str()));
+		std::remove(filename.c_str());
+}
+BENCHMARK(BM_data_set_serialize);
+
+static void BM_data_set_deserialize(benchmark::State& state) {
+		String filename = "bench_data_set.bin";
+		bench_data()->serialize(filename);
+		for (auto _ : state) {
+				DataSet data;
+				data.deserialize(filename);
+				benchmark::DoNotOptimize(data.size());
+		}
+		state.SetBytesProcessed(state.iterations()
+								* filesystem::file_size(filename.c_str()));
+		std::remove(filename.c_str());
+}
+BENCHMARK(BM_data_set_deserialize);
+
+template <typename M>
+static void BM_model_serialize(benchmark::State& state) {
+		auto optimizer = make_optimizer<SGD>();
+		ModelFixture<M> fixture(state.range(0), *optimizer, bench_nnz);
+		String filename = "bench_model.bin";
+		for (auto _ : state) {
+				fixture.model->serialize(filename);
+		}
+		state.SetBytesProcessed(state.iterations()
+								* filesystem::file_size(filename.c_str()));
+		std::remove(filename.c_str());
+}
+template <typename M>
+static void BM_model_deserialize(benchmark::State& state) {
+		auto optimizer = make_optimizer<SGD>();
+		ModelFixture<M> fixture(state.range(0), *optimizer, bench_nnz);
+		String filename = "bench_model.bin";
+		fixture.model->serialize(filename);
+		for (auto _ : state) {
+				auto model = Model::from_file(filename);
+				benchmark::DoNotOptimize(model->n_parameters());
+		}
+		state.SetBytesProcessed(state.iterations()
+								* filesystem::file_size(filename.c_str()));
+		std::remove(filename.c_str());
+}
+#define BENCH_MODEL_IO(M, k)                                                   \
+		BENCHMARK_TEMPLATE(BM_model_serialize, M)->ArgName("k")->Arg(k);      \
+		BENCHMARK_TEMPLATE(BM_model_deserialize, M)->ArgName("k")->Arg(k)
+
+BENCH_MODEL_IO(LM, 0);
+BENCH_MODEL_IO(FM, 8);
+BENCH_MODEL_IO(FFM, 8);
+BENCH_MODEL_IO(FwFM, 8);
+BENCH_MODEL_IO(HOFM, 8);
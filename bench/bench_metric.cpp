@@ -0,0 +1,42 @@
+#include "bench_util.h"
+
+#include "model/metric.h"
+
+#include <random>
+
+using namespace NAMESPACE_NAME;
+
+static void BM_metric(benchmark::State& state,
+					  std::vector<Metric::Type> types) {
+		auto data = bench_data();
+		auto sampler = Sampler::create(data);
+		auto entries = all_entries(*sampler);
+		std::vector<real_t> predicted(entries.size());
+		std::mt19937 G(bench_seed);
+		std::normal_distribution<real_t> dist;
+		for (auto& p : predicted) {
+				p = dist(G);
+		}
+		Metric metric(types);
+		for (auto _ : state) {
+				metric.accumulate(predicted.data(), entries.data(),
+								  entries.size());
+		}
+		benchmark::DoNotOptimize(metric.value());
+		state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK_CAPTURE(BM_metric, rmsd, {Metric::RMSD});
+BENCHMARK_CAPTURE(BM_metric, auc, {Metric::AUC});
+BENCHMARK_CAPTURE(BM_metric,
+				  ctr,
+				  {Metric::AUC, Metric::LogLoss, Metric::NE, Metric::PRAUC,
+				   Metric::Calibration});
+
+static void BM_metric_value(benchmark::State& state, Metric::Type type) {
+		Metric metric(type);
+		for (auto _ : state) {
+				benchmark::DoNotOptimize(metric.value());
+		}
+}
+BENCHMARK_CAPTURE(BM_metric_value, auc, Metric::AUC);
+BENCHMARK_CAPTURE(BM_metric_value, prauc, Metric::PRAUC);
@@ -0,0 +1,25 @@
+#include "bench_util.h"
+
+using namespace NAMESPACE_NAME;
+
+template <typename M>
+static void BM_predict(benchmark::State& state) {
+		auto optimizer = make_optimizer<SGD>();
+		ModelFixture<M> fixture(state.range(0), *optimizer, state.range(1));
+		size_t i = 0;
+		for (auto _ : state) {
+				benchmark::DoNotOptimize(fixture.model->predict(fixture.entry(i++)));
+		}
+		fixture.set_counters(state);
+}
+
+#define BENCH_PREDICT(M, ...)                                                  \
+		BENCHMARK_TEMPLATE(BM_predict, M)                                      \
+			->ArgNames({"k", "nnz"})                                           \
+			->ArgsProduct({__VA_ARGS__, {4, 16, 64}})
+
+BENCH_PREDICT(LM, {0}); // k has no effect
+BENCH_PREDICT(FM, {4, 8, 16, 32});
+BENCH_PREDICT(FFM, {4, 8, 16, 32});
+BENCH_PREDICT(FwFM, {4, 8, 16, 32});
+BENCH_PREDICT(HOFM, {4, 8, 16, 32});
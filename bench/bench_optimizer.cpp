@@ -0,0 +1,63 @@
+#include "bench_util.h"
+
+#include <cmath>
+
+using namespace NAMESPACE_NAME;
+
+// one step of training with log loss, i.e. predict followed by optimize
+template <typename M, typename O>
+static void BM_optimize(benchmark::State& state) {
+		auto optimizer = make_optimizer<O>();
+		ModelFixture<M> fixture(state.range(0), *optimizer, bench_nnz);
+		size_t i = 0;
+		for (auto _ : state) {
+				auto& entry = fixture.entry(i++);
+				real_t predicted = fixture.model->predict(entry);
+				real_t y = entry.label > 0 ? 1.0 : -1.0;
+				auto t = std::exp(-y * predicted);
+				optimizer->optimize(*fixture.model, entry, -y * t / (1.0 + t));
+		}
+		fixture.set_counters(state);
+}
+
+// the same through Optimizer::train, a batch at a time with no dispatch per
+// sample; compare with BM_optimize for the cost of virtual calls.
+template <typename M, typename O>
+static void BM_train(benchmark::State& state) {
+		constexpr size_t batch = 64;
+		auto optimizer = make_optimizer<O>();
+		ModelFixture<M> fixture(state.range(0), *optimizer, bench_nnz);
+		auto& entries = fixture.entries;
+		std::vector<real_t> pred(batch);
+		size_t i = 0;
+		for (auto _ : state) {
+				if (i + batch > entries.size()) i = 0;
+				auto start = entries.data() + i;
+				optimizer->train(*fixture.model, Loss::CrossEntropy, start,
+								 start + batch, pred.data());
+				i += batch;
+		}
+		fixture.set_counters(state, batch);
+}
+
+#define BENCH_OPTIMIZE(M, O, ...)                                              \
+		BENCHMARK_TEMPLATE(BM_optimize, M, O)                                  \
+			->ArgName("k")                                                     \
+			->ArgsProduct({__VA_ARGS__});                                      \
+		BENCHMARK_TEMPLATE(BM_train, M, O)                                     \
+			->ArgName("k")                                                     \
+			->ArgsProduct({__VA_ARGS__})
+#define BENCH_OPTIMIZERS(M, ...)                                               \
+		BENCH_OPTIMIZE(M, SGD, __VA_ARGS__);                                   \
+		BENCH_OPTIMIZE(M, AdaGrad, __VA_ARGS__);                               \
+		BENCH_OPTIMIZE(M, RMSProp, __VA_ARGS__);                               \
+		BENCH_OPTIMIZE(M, Momentum, __VA_ARGS__);                              \
+		BENCH_OPTIMIZE(M, Adam, __VA_ARGS__);                                  \
+		BENCH_OPTIMIZE(M, AdamUnbiased, __VA_ARGS__);                          \
+		BENCH_OPTIMIZE(M, AMSGrad, __VA_ARGS__)
+
+BENCH_OPTIMIZERS(LM, {0}); // k has no effect
+BENCH_OPTIMIZERS(FM, {4, 8, 16, 32});
+BENCH_OPTIMIZERS(FFM, {4, 8, 16, 32});
+BENCH_OPTIMIZERS(FwFM, {4, 8, 16, 32});
+BENCH_OPTIMIZERS(HOFM, {4, 8, 16, 32});
@@ -0,0 +1,18 @@
+#include <benchmark/benchmark.h>
+
+#include "base/thread_pool.h"
+
+using namespace NAMESPACE_NAME;
+
+// overhead of dispatching one empty task per worker then waiting for them
+static void BM_dispatch(benchmark::State& state) {
+		ThreadPool pool(state.range(0));
+		for (auto _ : state) {
+				for (int i = 0; i < state.range(0); ++i) {
+						pool.enqueue([]() {});
+				}
+				pool.sync(state.range(0));
+		}
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_dispatch)->ArgName("threads")->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
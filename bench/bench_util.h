@@ -0,0 +1,105 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include "data/sampler.h"
+#include "model/ffm.h"
+#include "model/fm.h"
+#include "model/fwfm.h"
+#include "model/hofm.h"
+#include "model/lm.h"
+#include "optimizer/optimizer.h"
+
+NAMESPACE_BEGIN
+
+// shape of synthetic data shared by benchmarks
+constexpr int bench_entries = 4096;
+constexpr int bench_features = 1 << 16;
+constexpr int bench_fields = 8;
+constexpr int bench_nnz = 16;
+constexpr unsigned bench_seed = 42;
+
+inline std::shared_ptr<DataSet> bench_data(int nnz = bench_nnz) {
+		return DataSet::dummy(bench_entries, bench_features, bench_fields, nnz,
+							  bench_seed);
+}
+
+inline Entries all_entries(Sampler& sampler) {
+		Entries entries;
+		sampler.restart();
+		sampler.get_samples(-1, entries);
+		return entries;
+}
+
+template <typename M>
+std::unique_ptr<M> make_model(size_t k);
+template <>
+inline std::unique_ptr<LM> make_model<LM>(size_t) {
+		return std::make_unique<LM>();
+}
+template <>
+inline std::unique_ptr<FM> make_model<FM>(size_t k) {
+		return std::make_unique<FM>(k);
+}
+template <>
+inline std::unique_ptr<FFM> make_model<FFM>(size_t k) {
+		return std::make_unique<FFM>(k);
+}
+template <>
+inline std::unique_ptr<FwFM> make_model<FwFM>(size_t k) {
+		return std::make_unique<FwFM>(k);
+}
+template <>
+inline std::unique_ptr<HOFM> make_model<HOFM>(size_t k) {
+		return std::make_unique<HOFM>(3, k);
+}
+
+template <typename O>
+std::unique_ptr<Optimizer> make_optimizer() {
+		constexpr real_t lr = 0.01, lambda = 1e-4;
+		std::unique_ptr<Optimizer> ret;
+		if constexpr (std::is_same_v<O, RMSProp>) {
+				ret = std::make_unique<O>(lr, lambda, 0.9);
+		} else if constexpr (std::is_same_v<O, Momentum>) {
+				ret = std::make_unique<O>(lr, lambda, 0.9);
+		} else if constexpr (std::is_base_of_v<Adam, O>) {
+				ret = std::make_unique<O>(lr, lambda, 0.9, 0.99);
+		} else {
+				ret = std::make_unique<O>(lr, lambda);
+		}
+		ret->set_epoch(1);
+		return ret;
+}
+
+// a model initialized with synthetic data, ready to be benchmarked.
+template <typename M>
+struct ModelFixture {
+		std::shared_ptr<DataSet> data;
+		std::shared_ptr<Sampler> sampler;
+		std::unique_ptr<M> model;
+		Entries entries;
+		size_t nnz = 0;
+
+		ModelFixture(size_t k, const Optimizer& optimizer, int n_nnz) {
+				data = bench_data(n_nnz);
+				data->normalize();
+				sampler = Sampler::create(data);
+				model = make_model<M>(k);
+				model->initialize(*sampler, optimizer.extras());
+				entries = all_entries(*sampler);
+				for (auto& e : entries) {
+						nnz += e->features.size();
+				}
+		}
+		Entry& entry(size_t i) { return *entries[i % entries.size()]; }
+		void set_counters(benchmark::State& state,
+						  size_t samples_per_iteration = 1) const {
+				auto n = state.iterations() * samples_per_iteration;
+				state.SetItemsProcessed(n);
+				state.counters["nnz/s"] = benchmark::Counter(
+					double(n) * nnz / entries.size(),
+					benchmark::Counter::kIsRate);
+		}
+};
+
+NAMESPACE_END
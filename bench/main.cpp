@@ -0,0 +1,14 @@
+#include <benchmark/benchmark.h>
+
+#include "base/logger.h"
+
+int main(int argc, char** argv) {
+		using namespace NAMESPACE_NAME;
+		logger::initialize();
+		logger::console->set_level(spdlog::level::warn);
+		benchmark::Initialize(&argc, argv);
+		if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+		benchmark::RunSpecifiedBenchmarks();
+		benchmark::Shutdown();
+		return 0;
+}
@@ -0,0 +1,37 @@
+# compare two JSON reports of a benchmark executable under bench/,
+# e.g. bench_optimizer --benchmark_out=new.json --benchmark_out_format=json
+import json
+import sys
+
+
+def load(filename):
+    with open(filename) as f:
+        report = json.load(f)
+    return {b['name']: b for b in report['benchmarks']
+            if b.get('run_type', 'iteration') == 'iteration'}
+
+
+def main():
+    if len(sys.argv) < 3:
+        print('usage: {} OLD.json NEW.json [THRESHOLD]'.format(sys.argv[0]))
+        sys.exit(2)
+    old, new = load(sys.argv[1]), load(sys.argv[2])
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 0.1
+
+    n_regressed = 0
+    for name, b in new.items():
+        if name not in old:
+            continue
+        ratio = b['cpu_time'] / old[name]['cpu_time']
+        mark = ''
+        if ratio > 1 + threshold:
+            mark = 'REGRESSED'
+            n_regressed += 1
+        elif ratio < 1 - threshold:
+            mark = 'improved'
+        print('{:<60} {:>8.3f}x {}'.format(name, ratio, mark))
+    sys.exit(1 if n_regressed else 0)
+
+
+if __name__ == '__main__':
+    main()
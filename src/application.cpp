@@ -2,9 +2,18 @@
 #include "base/enum_db.h"
 #include "base/io_util.h"
 #include "base/logger.h"
+#include "base/numa.h"
+#include "base/random.h"
+#include "base/timer.h"
 #include "cli.h"
+#include "data/block_file.h"
+#include "data/data_stream.h"
 #include "data/sampler.h"
+#include "model/ffm.h"
+#include "model/fm.h"
 #include "model/metric.h"
+#include "model/mips_index.h"
+#include "model/recommender.h"
 
 NAMESPACE_BEGIN
 
@@ -16,13 +25,14 @@ enum class Algorithm {
 		Adam,
 		AdamUnbiased,
 		AMSGrad,
+		ALS,
 };
 
 ENUM_DB_DEFINITION(Algorithm) = {
 	{Algorithm::SGD, "sgd"},         {Algorithm::AdaGrad, "adagrad"},
 	{Algorithm::RMSProp, "rmsprop"}, {Algorithm::Momentum, "momentum"},
 	{Algorithm::Adam, "adam"},       {Algorithm::AdamUnbiased, "adam-unbias"},
-	{Algorithm::AMSGrad, "amsgrad"},
+	{Algorithm::AMSGrad, "amsgrad"}, {Algorithm::ALS, "als"},
 };
 
 namespace {
@@ -34,10 +44,14 @@ std::string help_command;
 
 CLI::App* train;
 CLI::App* predict;
+CLI::App* recommend;
+CLI::App* serve;
+CLI::App* convert;
 
 std::string input;
 std::string output;
 std::string summary;
+std::string trace;
 std::string test;
 std::string split;
 std::string dump;
@@ -45,7 +59,9 @@ std::string dump_train;
 std::string dump_test;
 std::string model;
 std::string algorithm;
-std::string metric;
+std::string loss;
+std::vector<std::string> metrics;
+int metric_slice = -1;
 
 CLI::Option* no_output;
 Flag regression = true;
@@ -53,6 +69,8 @@ Flag normalize = true;
 Flag remove_zeros = true;
 
 int n_threads = 0;
+bool pin_threads = false;
+bool numa_interleave = false;
 real_t learning_rate = 0.001;
 real_t lambda_r = 0.0001;
 real_t alpha = 0.9;   // for RMSProp
@@ -61,6 +79,22 @@ real_t beta_1 = 0.9;  // for Adam
 real_t beta_2 = 0.99; // for Adam
 size_t k = 8;
 size_t m = 2;
+bool sparse_ffm = false;
+std::string ffm_engine = "auto";
+std::string field_pairs;
+bool stream = false;
+real_t negative_rate = 1;
+bool out_of_core = false;
+size_t block_size = BlockFile::default_block_size;
+std::string init_model;
+std::string users;
+std::string items;
+size_t top_k = 10;
+bool approx = false;
+std::string index_path;
+size_t n_lists = 0;
+size_t n_probe = 8;
+std::string socket_path;
 
 template <typename E>
 std::set<std::string> enum_name_set() {
@@ -84,10 +118,108 @@ Optimizer* get_optimizer() {
 										beta_2);
 		case Algorithm::AMSGrad:
 				return new AMSGrad(learning_rate, lambda_r, beta_1, beta_2);
+		case Algorithm::ALS: return new ALS(lambda_r);
 		}
 		UNREACHABLE("bad optimization algo: %s", algorithm.c_str());
 }
 
+// load data either in text or compressed into blocks.
+std::shared_ptr<DataSet> load_data(const std::string& path, ThreadPool& pool) {
+		std::shared_ptr<DataSet> data;
+		if (BlockFile::is_block_file(path.c_str())) {
+				data = BlockFile(path.c_str()).load(pool);
+		} else {
+				data = DataSet::from_file(path.c_str(), remove_zeros);
+		}
+		data->sort_entries();
+		if (normalize) data->normalize();
+		return data;
+}
+
+// recommend by an index of items, loaded from where it is saved if it is of
+// the same items, or built and saved there otherwise; then check it against
+// exact search on a sample of users.
+std::vector<Recommender::List> recommend_approx(const Recommender& recommender,
+												const Entries& users,
+												ThreadPool& pool) {
+		constexpr size_t n_checked = 1000; // users searched exactly
+		std::string path = index_path.empty() ? model + ".ivf" : index_path;
+		u64 fingerprint =
+			MipsIndex::fingerprint(recommender.items(), recommender.bias());
+		MipsIndex index;
+		bool fresh = false;
+		if (filesystem::exists(path)) {
+				index.deserialize(path.c_str());
+				fresh = index.fingerprint() == fingerprint;
+				if (!fresh) logger::info("index {} is of other items", path);
+		}
+		Timer timer;
+		if (!fresh) {
+				size_t n = recommender.n_items();
+				size_t lists = n_lists ? n_lists : std::ceil(std::sqrt(n));
+				timer.tic();
+				index = MipsIndex(recommender.items(), recommender.bias(),
+								  lists, pool);
+				timer.toc();
+				logger::info("built index of {} lists over {} items in {:.3} "
+							 "seconds",
+							 index.n_lists(), n, timer.seconds());
+				index.serialize(path.c_str());
+		}
+
+		timer.tic();
+		auto lists = recommender.recommend(users, top_k, pool, index, n_probe);
+		timer.toc();
+		double approx_us =
+			timer.seconds() * 1e6 / std::max<size_t>(users.size(), 1);
+		logger::info("searched {} of {} lists for {} users in {:.3} seconds; "
+					 "{:.3g} us per user",
+					 std::min(n_probe, index.n_lists()), index.n_lists(),
+					 users.size(), timer.seconds(), approx_us);
+
+		std::vector<size_t> checked(users.size());
+		std::iota(checked.begin(), checked.end(), 0);
+		std::shuffle(checked.begin(), checked.end(), random_generator());
+		checked.resize(std::min(n_checked, users.size()));
+		Entries sample;
+		for (auto u : checked) {
+				sample.push_back(users[u]);
+		}
+		timer.tic();
+		auto exact = recommender.recommend(sample, top_k, pool);
+		timer.toc();
+		double exact_us =
+			timer.seconds() * 1e6 / std::max<size_t>(sample.size(), 1);
+		size_t hits = 0, total = 0;
+		for (size_t s = 0; s < sample.size(); ++s) {
+				auto& found = lists[checked[s]];
+				for (auto& e : exact[s]) {
+						auto same = [&](auto& f) { return f.item == e.item; };
+						hits += std::any_of(found.begin(), found.end(), same);
+				}
+				total += exact[s].size();
+		}
+		logger::info("recall@{} {:.4} against exact search on {} users, "
+					 "which takes {:.3g} us per user, {:.3g}x as long",
+					 top_k, total ? double(hits) / total : 1.0, sample.size(),
+					 exact_us, exact_us / approx_us);
+		return lists;
+}
+
+// correct predictions of model for negative samples downsampled in training,
+// if the rate is given to command.
+void set_negative_rate(const CLI::App& command, Model& model, Loss loss) {
+		if (!command.count("--negative-rate")) return;
+		if (negative_rate <= 0) THROW("negative rate must be positive");
+		if (loss != Loss::CrossEntropy)
+				logger::warn("correction for downsampled negatives assumes "
+							 "predictions are log-odds, i.e. log loss");
+		model.logit_offset(std::log(negative_rate));
+		logger::info("negative samples downsampled at rate {:.3g}; "
+					 "predictions are offset by {:.6g}",
+					 negative_rate, model.logit_offset());
+}
+
 } // namespace
 
 Application::~Application() = default;
@@ -95,6 +227,11 @@ Application::Application() : m_impl(new Application_impl) {
 		regression.add_to(app, "--regression", "--binary");
 		regression.on->description("perform regression");
 		regression.off->description("perform binary classification");
+		app.add_set("--loss", loss,
+					{"squared", "logloss", "hinge", "poisson", "huber"})
+			->description("loss to minimize, weighted by samples; squared "
+						  "when performing regression and logloss otherwise "
+						  "if not specified");
 
 		normalize.add_to(app, "--normalize", "--no-normalize");
 		normalize.on->description("enable feature vector normalization");
@@ -111,6 +248,11 @@ Application::Application() : m_impl(new Application_impl) {
 				"zero    : use all threads available\n"
 				"negative: use these many threads less than available")
 			->capture_default_str();
+		app.add_flag("--pin-threads", pin_threads)
+			->description("bind worker threads to cpus spread over NUMA "
+						  "nodes, and keep each thread's share of data local");
+		app.add_flag("--numa-interleave", numa_interleave)
+			->description("interleave model parameters over NUMA nodes");
 
 		app.require_subcommand(0, 1);
 		{
@@ -125,8 +267,26 @@ Application::Application() : m_impl(new Application_impl) {
 										   "train a model either from scratch");
 
 				train->add_option("-i,--input", input)
-					->description("path to file to read data from")
+					->description("path to file to read data from; "
+								  "with --stream, may be a FIFO or - for stdin")
 					->required();
+				train->add_flag("--stream", stream)
+					->description("train online on samples as they arrive "
+								  "until the input ends; model is saved to "
+								  "output at every checkpoint");
+				train->add_option("--stream-batch", m_impl->stream_batch)
+					->description("# samples read from stream per update")
+					->capture_default_str();
+				train->add_option("--checkpoint-samples",
+								  m_impl->checkpoint_samples)
+					->description("# samples between checkpoints when "
+								  "streaming; 0 for no limit")
+					->capture_default_str();
+				train->add_option("--checkpoint-seconds",
+								  m_impl->checkpoint_seconds)
+					->description("maximum seconds between checkpoints when "
+								  "streaming")
+					->capture_default_str();
 				auto has_output =
 					train->add_option("-o,--output", output)
 						->description("path to file to output model to");
@@ -139,6 +299,9 @@ Application::Application() : m_impl(new Application_impl) {
 					->description("path to file to dump model in text");
 				train->add_option("--summary", summary)
 					->description("path to file to summarize training");
+				train->add_option("--trace", trace)
+					->description("path to file to write per-epoch "
+								  "profile of training to, in JSON");
 
 				train->add_option("--split", split)
 					->description("specify that input file should be "
@@ -149,13 +312,36 @@ Application::Application() : m_impl(new Application_impl) {
 				train->add_option("--dump-test", dump_test)
 					->description("path to file to dump split test data")
 					->needs("--split");
-
-				train->add_set("model", model, {"LM", "FM", "FFM", "HOFM"})
-					->description("type of model to train");
-				train
-					->add_set("--metric", metric, enum_name_set<Metric::Type>())
-					->description("metric used to detect early-stopping and "
-								  "report to user during training.");
+				train->add_flag("--out-of-core", out_of_core)
+					->description("decode blocks of compressed input as they "
+								  "are trained on, instead of loading all of "
+								  "them into memory")
+					->excludes("--split");
+
+				auto has_model =
+					train
+						->add_set("model", model,
+								  {"LM", "FM", "FFM", "FwFM", "HOFM"})
+						->description("type of model to train");
+				train->add_option("--init-model", init_model)
+					->description("path to file of model to continue training "
+								  "from, instead of training a new one")
+					->excludes(has_model);
+				train->add_flag("--save-extras", m_impl->save_extras)
+					->description("also save states of optimizer with model, "
+								  "so that training can be resumed from it "
+								  "with --init-model");
+				train->add_option("--metric", metrics)
+					->delimiter(',')
+					->check(CLI::IsMember(enum_name_set<Metric::Type>()))
+					->description("comma separated metrics computed on test "
+								  "data and reported to user during training; "
+								  "the first one is used to detect "
+								  "early-stopping.");
+				train->add_option("--metric-slice", metric_slice)
+					->description("field by whose features the metrics are "
+								  "additionally broken down")
+					->needs("--metric");
 				algorithm = to_string(Algorithm::SGD).c_str();
 				train->add_set("--opt", algorithm, enum_name_set<Algorithm>())
 					->description("optimization algorithm to use")
@@ -169,6 +355,19 @@ Application::Application() : m_impl(new Application_impl) {
 								  "epochs to train while making no progress;"
 								  "set to zero to disable early stopping")
 					->capture_default_str();
+				train->add_option("--batch-size", m_impl->batch_size)
+					->description("# samples trained on in parallel before "
+								  "threads synchronize; all samples if not "
+								  "specified");
+				train->add_option("--negative-rate", negative_rate)
+					->description("probability to keep each negative sample "
+								  "of input in an epoch; predictions out of "
+								  "training are corrected for it")
+					->check(CLI::Range(0.0, 1.0));
+				train->add_option("--prefetch", m_impl->prefetch)
+					->description("# batches fetched and prepared ahead on "
+								  "another thread; 0 to disable")
+					->capture_default_str();
 				train->add_option("-r", learning_rate, "learning rate", true);
 				train->add_option("--lr", lambda_r, "L2 regularizing", true);
 				train->add_option("--alpha", alpha)
@@ -187,11 +386,40 @@ Application::Application() : m_impl(new Application_impl) {
 
 				train->add_option("-k", k)
 					->description("number of latent factors; only has effect "
-								  "when training FM and FFM")
+								  "when training FM, FFM and FwFM")
 					->capture_default_str();
 				train->add_option("-m", m)
 					->description("order for HOFM")
 					->capture_default_str();
+				train->add_option("--workers", m_impl->n_workers)
+					->description("number of worker processes to train in "
+								  "data parallel, each on a shard of input")
+					->capture_default_str();
+				train->add_option("--staleness", m_impl->staleness)
+					->description("maximum # batches a worker may run ahead "
+								  "of the slowest one; only has effect with "
+								  "multiple workers")
+					->capture_default_str();
+				train->add_option("--sync-every", m_impl->sync_every)
+					->description("# samples a worker trains on between "
+								  "exchanges with parameter server")
+					->capture_default_str();
+				train->add_option("--ps-socket", m_impl->ps_socket)
+					->description("path to unix socket of parameter server");
+				train->add_flag("--sparse", sparse_ffm)
+					->description("only allocate latent vectors of observed "
+								  "(feature, field) pairs; only has effect "
+								  "when training FFM");
+				train->add_option("--field-pairs", field_pairs)
+					->description("pairs of fields whose features interact "
+								  "in FM and FFM, e.g. 0:1,0:2,3:*, or a file "
+								  "of such pairs; all of them by default");
+				train->add_set("--ffm-engine", ffm_engine,
+							   {"auto", "pairwise", "aggregated"})
+					->description("how interactions of FFM are computed; "
+								  "auto aggregates latent vectors by field "
+								  "for samples with many features per field")
+					->capture_default_str();
 		}
 		{
 				predict = app.add_subcommand("predict",
@@ -208,6 +436,109 @@ Application::Application() : m_impl(new Application_impl) {
 				predict->add_option("-o,--output", output)
 					->description("path to file to output prediction to")
 					->required();
+				predict->add_option("--negative-rate", negative_rate)
+					->description("rate at which negative samples were "
+								  "downsampled when training the model, to "
+								  "correct predictions for; overrides the "
+								  "rate saved with model")
+					->check(CLI::Range(0.0, 1.0));
+		}
+		{
+				recommend = app.add_subcommand(
+					"recommend",
+					"recommend top items to users by an FM, a sample of which "
+					"is features of a user together with those of an item");
+
+				recommend->add_option("-m,--model", model)
+					->description("path to file containing model parameters")
+					->required();
+				recommend->add_option("--users", users)
+					->description("path to file of features of users, one "
+								  "user per line")
+					->required();
+				recommend->add_option("--items", items)
+					->description("path to file of features of items, one "
+								  "item per line; items are referred to by "
+								  "line number counting from 0")
+					->required();
+				recommend->add_option("-o,--output", output)
+					->description("path to file to output a line per user "
+								  "to, of top items as item:score")
+					->required();
+				recommend->add_option("--top", top_k)
+					->description("# items to recommend to each user")
+					->check(CLI::PositiveNumber)
+					->capture_default_str();
+				recommend->add_flag("--approx", approx)
+					->description("search only lists of an index of items "
+								  "nearest to each user, and report recall "
+								  "and latency against exact search");
+				recommend->add_option("--index", index_path)
+					->description("path to index of items, which is built "
+								  "and saved there unless it is of the "
+								  "same items; defaults to model path "
+								  "followed by .ivf");
+				recommend->add_option("--lists", n_lists)
+					->description("# lists of index to build; defaults "
+								  "to square root of # items");
+				recommend->add_option("--probe", n_probe)
+					->description("# lists to search for each user")
+					->check(CLI::PositiveNumber)
+					->capture_default_str();
+		}
+		{
+				serve = app.add_subcommand(
+					"serve",
+					"keep a model loaded and predict lines of samples sent "
+					"over a unix socket, answering each with a line");
+
+				serve->add_option("-m,--model", model)
+					->description("path to file containing model parameters, "
+								  "which is reloaded when replaced")
+					->required();
+				serve->add_option("--socket", socket_path)
+					->description("path to unix socket to listen on")
+					->required();
+				serve->add_option("--max-batch", m_impl->serve_batch)
+					->description("maximum # samples predicted at a time; "
+								  "requests arriving meanwhile are batched")
+					->check(CLI::PositiveNumber)
+					->capture_default_str();
+				serve->add_option("--max-wait", m_impl->serve_wait_ms)
+					->description("maximum milliseconds to hold a request "
+								  "for a batch to fill up; 0 to batch only "
+								  "those arriving while busy")
+					->check(CLI::Range(0.0, 1000.0))
+					->capture_default_str();
+				serve->add_option("--stats-interval", m_impl->stats_seconds)
+					->description("seconds between reports of throughput "
+								  "and latency")
+					->check(CLI::PositiveNumber)
+					->capture_default_str();
+				serve->add_option("--negative-rate", negative_rate)
+					->description("rate at which negative samples were "
+								  "downsampled when training the model, to "
+								  "correct predictions for; overrides the "
+								  "rate saved with model")
+					->check(CLI::Range(0.0, 1.0));
+		}
+		{
+				convert = app.add_subcommand(
+					"convert",
+					"compress text data into blocks, which take less space "
+					"and load faster; compressed data can be given wherever "
+					"text data is expected");
+
+				convert->add_option("-i,--input", input)
+					->description("path to file to read text data from")
+					->required();
+				convert->add_option("-o,--output", output)
+					->description("path to file to output compressed data "
+								  "to; input with .zlb appended if not given");
+				convert->add_option("--block-size", block_size)
+					->description("# samples per block")
+					->check(CLI::PositiveNumber)
+					->capture_default_str();
 		}
 }
 
@@ -238,78 +569,191 @@ int Application::run() {
 		if (n_threads <= 0) {
 				n_threads += std::thread::hardware_concurrency();
 		}
-		m_impl->thread_pool = std::make_shared<ThreadPool>(n_threads);
-		logger::info("using {} worker threads", n_threads);
-
-		m_impl->loss = regression ? Loss::Squared : Loss::CrossEntropy;
-		if (!metric.empty()) {
-				auto mtype = EnumDB<Metric::Type>::to_enum(metric.c_str());
-				m_impl->metric = Metric(mtype);
+		numa::set_interleave(numa_interleave);
+		m_impl->thread_pool =
+			std::make_shared<ThreadPool>(n_threads, pin_threads);
+		logger::info("using {} worker threads{} on {} NUMA node(s)",
+					 n_threads,
+					 m_impl->thread_pool->pinned() ? " (pinned)" : "",
+					 numa::n_nodes());
+
+		if (loss.empty())
+				m_impl->loss = regression ? Loss::Squared : Loss::CrossEntropy;
+		else if (loss == "squared")
+				m_impl->loss = Loss::Squared;
+		else if (loss == "logloss")
+				m_impl->loss = Loss::CrossEntropy;
+		else if (loss == "hinge")
+				m_impl->loss = Loss::Hinge;
+		else if (loss == "poisson")
+				m_impl->loss = Loss::Poisson;
+		else if (loss == "huber")
+				m_impl->loss = Loss::Huber;
+		if (!metrics.empty()) {
+				std::vector<Metric::Type> mtypes;
+				for (auto& name : metrics) {
+						mtypes.push_back(
+							EnumDB<Metric::Type>::to_enum(name.c_str()));
+				}
+				m_impl->metric = Metric(mtypes);
+				if (metric_slice >= 0) m_impl->metric->slice_by(metric_slice);
 		}
 
 		if (train->parsed()) {
-				if (model == "LM")
+				if (!init_model.empty()) {
+						logger::info("loading initial model from {}",
+									 init_model.c_str());
+						m_impl->model = Model::from_file(init_model.c_str());
+						m_impl->warm_start = true;
+				} else if (model.empty()) {
+						THROW("either model type or initial model is needed");
+				} else if (model == "LM")
 						m_impl->model = Model::create_LM();
 				else if (model == "FM")
 						m_impl->model = Model::create_FM(k);
 				else if (model == "FFM")
-						m_impl->model = Model::create_FFM(k);
+						m_impl->model = Model::create_FFM(k, sparse_ffm);
+				else if (model == "FwFM")
+						m_impl->model = Model::create_FwFM(k);
 				else if (model == "HOFM")
 						m_impl->model = Model::create_HOFM(m, k);
+				if (!field_pairs.empty() && !init_model.empty()) {
+						logger::warn("--field-pairs is ignored as those of "
+									 "initial model are kept");
+				} else if (!field_pairs.empty()) {
+						auto pairs = FieldPairs::from_spec_or_file(field_pairs);
+						auto created = m_impl->model.get();
+						if (auto fm = dynamic_cast<FM*>(created))
+								fm->field_pairs = pairs;
+						else if (auto ffm = dynamic_cast<FFM*>(created))
+								ffm->field_pairs = pairs;
+						else
+								logger::warn("--field-pairs only has effect on "
+											 "FM and FFM");
+				}
+				if (auto ffm = dynamic_cast<FFM*>(m_impl->model.get())) {
+						if (ffm_engine == "pairwise")
+								ffm->engine = FFM::Engine::Pairwise;
+						else if (ffm_engine == "aggregated")
+								ffm->engine = FFM::Engine::Aggregated;
+				}
 
 				std::shared_ptr<Optimizer> optimizer(get_optimizer());
 				ASSERT(optimizer);
-
-				std::shared_ptr<DataSet> train_data, test_data;
-				std::shared_ptr<Sampler> train_sampler, test_sampler;
-
-				train_data = DataSet::from_file(input.c_str(), remove_zeros);
-				train_data->sort_entries();
-				if (!test.empty()) {
-						if (!split.empty()) {
-								logger::warn(
-									"both test file and input split are "
-									"specified; test file will be preferred");
+				if (dynamic_cast<ALS*>(optimizer.get())) {
+						if (!ALS::supports(*m_impl->model))
+								THROW("ALS only trains LM and FM without "
+									  "masked field pairs");
+						if (m_impl->loss != Loss::Squared)
+								THROW("ALS only minimizes squared loss");
+						if (stream || out_of_core || m_impl->n_workers > 1)
+								THROW("ALS needs all samples in memory of a "
+									  "single process");
+				}
+				set_negative_rate(*train, *m_impl->model, m_impl->loss);
+
+				if (stream) {
+						if (!test.empty() || !split.empty())
+								logger::warn("test data is ignored when "
+											 "streaming; loss and metrics are "
+											 "evaluated on samples before "
+											 "learning from them");
+						if (!*no_output) {
+								if (output.empty() && input == "-")
+										THROW("specify --output or --no-output "
+											  "when streaming from stdin");
+								if (output.empty()) output = input + ".bin";
+								logger::info("saving checkpoints to {}",
+											 output.c_str());
+								m_impl->checkpoint = output;
 						}
-						test_data =
-							DataSet::from_file(test.c_str(), remove_zeros);
-						test_data->sort_entries();
-				} else if (!split.empty()) {
-						RELEASE_ASSERT(
-							std::count(split.begin(), split.end(), ':') == 1);
-						auto pos = split.find_first_of(':');
-						auto train_share = split.substr(0, pos);
-						auto test_share = split.substr(pos + 1);
-						logger::info("splitting input into train:test={}:{}",
-									 train_share, test_share);
-						test_data = train_data->train_test_split(
-							std::stoi(train_share), std::stoi(test_share),
-							false);
-						if (!dump_train.empty()) {
-								logger::info("dumping split train data to {}",
-											 dump_train.c_str());
-								train_data->serialize_txt(dump_train.c_str());
+						m_impl->negative_rate = negative_rate;
+						DataStream data(input, remove_zeros, normalize);
+						m_impl->train_stream(*optimizer, data);
+				} else {
+						std::shared_ptr<DataSet> train_data, test_data;
+						std::shared_ptr<Sampler> train_sampler, test_sampler;
+
+						auto& pool = *m_impl->thread_pool;
+						if (out_of_core) {
+								if (!BlockFile::is_block_file(input.c_str()))
+										THROW("--out-of-core needs input "
+											  "compressed by convert");
+								train_sampler = Sampler::create(
+									std::make_shared<BlockFile>(input.c_str()),
+									normalize);
+						} else {
+								train_data = load_data(input, pool);
 						}
-						if (!dump_test.empty()) {
-								logger::info("dumping split test data to {}",
-											 dump_test.c_str());
-								test_data->serialize_txt(dump_test.c_str());
+						if (!test.empty()) {
+								if (!split.empty()) {
+										logger::warn(
+											"both test file and input split "
+											"are specified; test file will be "
+											"preferred");
+								}
+								test_data = load_data(test, pool);
+						} else if (!split.empty()) {
+								RELEASE_ASSERT(
+									std::count(split.begin(), split.end(), ':')
+									== 1);
+								auto pos = split.find_first_of(':');
+								auto train_share = split.substr(0, pos);
+								auto test_share = split.substr(pos + 1);
+								logger::info(
+									"splitting input into train:test={}:{}",
+									train_share, test_share);
+								test_data = train_data->train_test_split(
+									std::stoi(train_share),
+									std::stoi(test_share), false);
+								if (!dump_train.empty()) {
+										logger::info(
+											"dumping split train data to {}",
+											dump_train.c_str());
+										train_data->serialize_txt(
+											dump_train.c_str());
+								}
+								if (!dump_test.empty()) {
+										logger::info(
+											"dumping split test data to {}",
+											dump_test.c_str());
+										test_data->serialize_txt(
+											dump_test.c_str());
+								}
+						}
+						if (pool.pinned()) {
+								if (train_data) train_data->localize(pool);
+								if (test_data) test_data->localize(pool);
+						}
+						if (train_data) {
+								train_sampler = Sampler::create(train_data);
+						}
+						if (negative_rate < 1) {
+								train_sampler = Sampler::downsample(
+									train_sampler, negative_rate);
+						}
+						if (m_impl->prefetch) {
+								train_sampler = Sampler::prefetch(
+									train_sampler, m_impl->prefetch);
+						}
+						if (test_data) {
+								test_sampler = Sampler::create(test_data);
+						}
+						if (!summary.empty())
+								m_impl->summary =
+									must_open_file(summary, std::ios::out);
+						if (!trace.empty())
+								m_impl->trace =
+									must_open_file(trace, std::ios::out);
+						m_impl->train(*optimizer, *train_sampler, test_sampler);
+
+						if (!*no_output) {
+								if (output.empty()) output = input + ".bin";
+								logger::info("saving model to {}",
+											 output.c_str());
+								m_impl->model->serialize(output.c_str(),
+														 m_impl->save_extras);
 						}
-				}
-				train_sampler = Sampler::create(train_data);
-				train_sampler->set_normalize(normalize);
-				test_sampler = Sampler::create(test_data);
-				test_sampler->set_normalize(normalize);
-				if (!summary.empty())
-						m_impl->summary =
-							must_open_file(summary, std::ios::out);
-				;
-				m_impl->train(*optimizer, *train_sampler, test_sampler);
-
-				if (!*no_output) {
-						if (output.empty()) output = input + ".bin";
-						logger::info("saving model to {}", output.c_str());
-						m_impl->model->serialize(output.c_str());
 				}
 
 				if (!dump.empty()) {
@@ -320,10 +764,9 @@ int Application::run() {
 				return 0;
 		} else if (predict->parsed()) {
 				m_impl->model = Model::from_file(model.c_str());
-				auto data = DataSet::from_file(input.c_str(), remove_zeros);
-				data->sort_entries();
+				set_negative_rate(*predict, *m_impl->model, m_impl->loss);
+				auto data = load_data(input, *m_impl->thread_pool);
 				auto sampler = Sampler::create(data);
-				sampler->set_normalize(normalize);
 				m_impl->predict(*sampler);
 
 				auto f = must_open_file(output.c_str(), std::ios::out);
@@ -331,6 +774,70 @@ int Application::run() {
 						*f << p << '\n';
 				}
 				return 0;
+		} else if (recommend->parsed()) {
+				m_impl->model = Model::from_file(model.c_str());
+				auto fm = dynamic_cast<FM*>(m_impl->model.get());
+				if (!fm) THROW("recommend needs an FM");
+				// the norm of a user with an item depends on both
+				if (*normalize.on)
+						THROW("samples normalized as a whole do not decompose "
+							  "into users and items");
+				normalize.def = false;
+				auto& pool = *m_impl->thread_pool;
+				auto user_data = load_data(users, pool);
+				auto item_data = load_data(items, pool);
+
+				Timer timer;
+				timer.tic();
+				Recommender recommender(*fm, item_data->entries());
+				std::vector<Recommender::List> lists;
+				if (!approx) {
+						lists = recommender.recommend(user_data->entries(),
+													  top_k, pool);
+						timer.toc();
+						double pairs =
+							double(user_data->size()) * item_data->size();
+						logger::info("scored {} users x {} items in {:.3} "
+									 "seconds; {:.3g} pairs per second",
+									 user_data->size(), item_data->size(),
+									 timer.seconds(), pairs / timer.seconds());
+				} else {
+						lists = recommend_approx(recommender,
+												 user_data->entries(), pool);
+				}
+
+				auto f = must_open_file(output.c_str(), std::ios::out);
+				for (auto& list : lists) {
+						for (size_t i = 0; i < list.size(); ++i) {
+								if (i) *f << ' ';
+								*f << list[i].item << ':' << list[i].score;
+						}
+						*f << '\n';
+				}
+				return 0;
+		} else if (serve->parsed()) {
+				m_impl->remove_zeros = remove_zeros;
+				m_impl->normalize = normalize;
+				auto load_model = [this]() {
+						auto loaded = Model::from_file(model.c_str());
+						set_negative_rate(*serve, *loaded, m_impl->loss);
+						return loaded;
+				};
+				m_impl->serve(socket_path, model, load_model);
+				return 0;
+		} else if (convert->parsed()) {
+				auto data = DataSet::from_file(input.c_str(), remove_zeros);
+				data->sort_entries();
+				if (output.empty()) output = input + ".zlb";
+				BlockFile::write(output.c_str(), *data, *m_impl->thread_pool,
+								 block_size);
+				auto size = filesystem::file_size(output.c_str());
+				logger::info("compressed {} samples into {} ({} bytes, {:.1f}x "
+							 "smaller)",
+							 data->size(), output.c_str(), size,
+							 double(filesystem::file_size(input.c_str()))
+								 / size);
+				return 0;
 		}
 		UNREACHABLE("no subcommand");
 }
@@ -1,19 +1,25 @@
 #pragma once
 
 #include "application.h"
+#include "base/profiler.h"
 #include "base/thread_pool.h"
 #include "model/metric.h"
 #include "model/model.h"
+#include "model/param_server.h"
 #include "optimizer/optimizer.h"
 
 NAMESPACE_BEGIN
 
+class DataStream;
+
 struct TrainInfo {
         int epoch = 0;
         real_t train_loss = NAN;
         real_t test_loss = NAN;
-        real_t test_metric = NAN;
+        real_t test_metric = NAN; // primary metric
+        std::vector<real_t> other_metrics;
         float seconds = 0;
+        profiler::Profile profile;
 };
 
 
@@ -22,26 +28,73 @@ struct Application_impl {
 		std::shared_ptr<ThreadPool> thread_pool;
 		std::unique_ptr<Model> model;
 		std::shared_ptr<std::fstream> summary;
+		std::shared_ptr<std::fstream> trace; // per-epoch profile in JSON
 
 		// for training
 		int n_epochs = 10;
 		Loss loss;
 		std::optional<Metric> metric;
 		int window = 3;
+		bool warm_start = false;  // model is loaded rather than created
+		bool save_extras = false; // save optimizer states with model
+		size_t batch_size = -1;   // # samples trained on between syncs
+		size_t prefetch = 2;      // # batches to prefetch; 0 to disable
+
+		// for data-parallel training across processes
+		int n_workers = 1;
+		size_t staleness = 2;
+		size_t sync_every = 1024; // # samples per batch between exchanges
+		std::string ps_socket;    // path of socket of parameter server
+
+		// for training on a live stream
+		size_t stream_batch = 1024;
+		// a window ends after these many samples (0 for no limit) or seconds,
+		// when rolling loss/metric is reported and model saved to checkpoint
+		size_t checkpoint_samples = 100000;
+		real_t checkpoint_seconds = 60;
+		std::string checkpoint; // empty for not saving
+		real_t negative_rate = 1; // of negatives learned from
 
         std::vector<TrainInfo> train_info;
 		void train(Optimizer&,
 				   Sampler& train,
 				   std::shared_ptr<Sampler> test = nullptr);
 
+		void train_stream(Optimizer&, DataStream& stream);
+
 		// for predict
 		std::vector<real_t> predicted;
 
 		void predict(Sampler&);
 
+		// for serving predictions over a socket
+		size_t serve_batch = 256;  // max # samples scored at a time
+		real_t serve_wait_ms = 0;  // max wait for a batch to fill
+		real_t stats_seconds = 10; // interval of reporting latency
+		bool remove_zeros = true;
+		bool normalize = true;
+
+		// serve until interrupted; model is reloaded by load_model() when
+		// file at model_path is replaced.
+		void serve(const std::string& socket_path,
+				   const std::string& model_path,
+				   std::function<std::unique_ptr<Model>()> load_model);
+
 	private:
-		int best_epoch;
+		int best_epoch = 0;
+		std::unique_ptr<ParameterServer> param_server;
+		std::vector<int> worker_pids;
+
+		// train an epoch either locally or through workers
+		real_t train_epoch(int epoch, Optimizer&, Sampler& train);
+		void start_workers(Optimizer&, Sampler& train);
+		[[noreturn]] void run_worker(int rank, Optimizer&, Sampler& train);
+		void stop_workers();
+		void save_checkpoint();
 		void update_train_stats();
+		void log_metric_slices(Sampler& test);
+		void write_summary();
+		void write_trace();
 
 		int bad_epoch_acc = 0; // should stop when it exceeds window
 		bool should_early_stop();
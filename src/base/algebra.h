@@ -8,6 +8,8 @@
 
 #include "config.h"
 
+#include <type_traits>
+
 NAMESPACE_BEGIN
 
 using Eigen::Dynamic;
@@ -27,8 +29,24 @@ inline void disable_malloc() { Eigen::internal::set_is_malloc_allowed(false); }
 inline void enable_malloc() { Eigen::internal::set_is_malloc_allowed(true); }
 inline bool is_malloc_enabled() { return Eigen::internal::is_malloc_allowed(); }
 
-template <typename T,
-		  typename = std::enable_if<std::is_base_of_v<Eigen::EigenBase<T>, T>>>
+// call f with std::integral_constant<int, N>, where N is n if it is a common
+// size of vectors, or Dynamic otherwise, so that a kernel can be instantiated
+// on fixed-size vectors, which Eigen unrolls and keeps in registers.
+template <typename F>
+decltype(auto) with_fixed_size(size_t n, F&& f) {
+		switch (n) {
+		case 4: return f(std::integral_constant<int, 4>());
+		case 8: return f(std::integral_constant<int, 8>());
+		case 16: return f(std::integral_constant<int, 16>());
+		case 32: return f(std::integral_constant<int, 32>());
+		case 64: return f(std::integral_constant<int, 64>());
+		default: return f(std::integral_constant<int, Dynamic>());
+		}
+}
+
+template <
+	typename T,
+	typename = std::enable_if_t<std::is_base_of_v<Eigen::EigenBase<T>, T>>>
 inline std::string to_string(const T& m) {
 		std::stringstream ss;
 		index_t rows = m.rows(), cols = m.cols();
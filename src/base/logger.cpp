@@ -2,8 +2,11 @@
 #include "str.h"
 
 #include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include <mutex>
+
 static void flush_all_loggers() {
 		spdlog::apply_all(
 			[](const std::shared_ptr<spdlog::logger>& l) { l->flush(); });
@@ -39,4 +42,15 @@ void initialize() {
 		}
 }
 
+void initialize_embedded() {
+		static std::once_flag once;
+		std::call_once(once, []() {
+				if (console) return;
+				auto sink = std::make_shared<spdlog::sinks::stderr_sink_mt>();
+				console = std::make_shared<spdlog::logger>("zlearn", sink);
+				console->set_pattern("zlearn: [%l] %v");
+				console->set_level(spdlog::level::warn);
+		});
+}
+
 NAMESPACE_END
@@ -13,6 +13,9 @@ NAMESPACE_BEGIN
 namespace logger {
 
 void initialize();
+// for use as a library within another program: only warnings and errors are
+// logged, to stderr, and no log file is created. no-op if initialized.
+void initialize_embedded();
 
 extern std::shared_ptr<spdlog::logger> console;
 
@@ -0,0 +1,138 @@
+#include "numa.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+NAMESPACE_BEGIN
+
+namespace numa {
+
+namespace {
+
+constexpr auto node_root = "/sys/devices/system/node/";
+std::atomic_bool interleave_enabled = false;
+
+std::string read_line(const std::string& path) {
+		std::ifstream file(path);
+		std::string ret;
+		std::getline(file, ret);
+		return ret;
+}
+
+std::vector<int> online_nodes() {
+		auto ret = parse_list(read_line(std::string(node_root) + "online"));
+		if (ret.empty()) ret.push_back(0);
+		return ret;
+}
+
+} // namespace
+
+std::vector<int> parse_list(const std::string& list) {
+		std::vector<int> ret;
+		std::stringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+				if (range.empty()) continue;
+				auto dash = range.find('-');
+				try {
+						int first = std::stoi(range.substr(0, dash));
+						int last = dash == std::string::npos
+							? first
+							: std::stoi(range.substr(dash + 1));
+						for (int i = first; i <= last; ++i) {
+								ret.push_back(i);
+						}
+				} catch (const std::exception&) {
+						return {};
+				}
+		}
+		return ret;
+}
+
+size_t n_nodes() {
+		static size_t n = online_nodes().size();
+		return n;
+}
+
+int node_of_cpu(int cpu) {
+		for (auto node : online_nodes()) {
+				auto path = std::string(node_root) + "node"
+					+ std::to_string(node) + "/cpulist";
+				auto cpus = parse_list(read_line(path));
+				if (std::count(cpus.begin(), cpus.end(), cpu)) return node;
+		}
+		return 0;
+}
+
+std::vector<int> allowed_cpus() {
+		std::vector<int> ret;
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+				for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+						if (CPU_ISSET(cpu, &set)) ret.push_back(cpu);
+				}
+		}
+#endif
+		// stable so that cpus of a node stay in ascending order
+		std::stable_sort(ret.begin(), ret.end(), [](int a, int b) {
+				return node_of_cpu(a) < node_of_cpu(b);
+		});
+		return ret;
+}
+
+bool pin_current_thread(int cpu) {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+}
+
+void set_interleave(bool b) { interleave_enabled = b; }
+bool interleave() { return interleave_enabled; }
+
+void place(const void* data, size_t n_bytes) {
+#if defined(__linux__) && defined(SYS_mbind)
+		if (!interleave_enabled || n_nodes() < 2 || n_bytes == 0) return;
+		constexpr int MPOL_INTERLEAVE = 3;
+		constexpr unsigned MPOL_MF_MOVE = 1 << 1;
+		static size_t page_size = sysconf(_SC_PAGESIZE);
+
+		// mbind works on whole pages
+		auto begin = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+		auto end = reinterpret_cast<uintptr_t>(data) + n_bytes;
+		unsigned long mask = 0;
+		for (auto node : online_nodes()) {
+				if (node < int(sizeof(mask) * 8)) mask |= 1UL << node;
+		}
+		if (syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE, &mask,
+					sizeof(mask) * 8, MPOL_MF_MOVE)
+			!= 0) {
+				static std::atomic_bool warned = false;
+				if (!warned.exchange(true))
+						logger::warn("failed to interleave memory over nodes");
+		}
+#else
+		(void) data;
+		(void) n_bytes;
+#endif
+}
+
+} // namespace numa
+
+NAMESPACE_END
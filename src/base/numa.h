@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+#include <string>
+#include <vector>
+
+NAMESPACE_BEGIN
+
+// NUMA topology and memory placement.
+// topology is read from sysfs; placement uses mbind(2) directly so that
+// libnuma is not required. everything degrades to a no-op on hosts with a
+// single node or where the information is unavailable.
+namespace numa {
+
+// parse a cpu/node list such as "0-3,8,10-11".
+std::vector<int> parse_list(const std::string& list);
+
+size_t n_nodes();
+int node_of_cpu(int cpu);
+// cpus the process may run on, grouped by node in ascending order.
+std::vector<int> allowed_cpus();
+// return whether succeeded.
+bool pin_current_thread(int cpu);
+
+// whether memory of model parameters is interleaved across nodes.
+// parameters are read by all threads at random rows, so spreading pages
+// evenly over nodes balances traffic on the interconnect.
+void set_interleave(bool b);
+bool interleave();
+// apply placement policy to memory that has just been (re)allocated.
+void place(const void* data, size_t n_bytes);
+
+} // namespace numa
+
+NAMESPACE_END
@@ -0,0 +1,91 @@
+#include "profiler.h"
+
+#include <memory>
+#include <mutex>
+
+NAMESPACE_BEGIN
+
+namespace profiler {
+
+namespace {
+
+std::mutex registry_mutex;
+// slots are never freed so that stats of exited threads are still collected
+std::vector<std::unique_ptr<Stats>> registry;
+
+Stats* register_slot() {
+		std::lock_guard lock(registry_mutex);
+		auto& slot = registry.emplace_back(std::make_unique<Stats>());
+		slot->thread_name = "thread-" + std::to_string(registry.size() - 1);
+		return slot.get();
+}
+
+} // namespace
+
+Stats& local() {
+		thread_local Stats* slot = register_slot();
+		return *slot;
+}
+
+void set_thread_name(std::string name) { local().thread_name = std::move(name); }
+
+bool Stats::empty() const {
+		for (auto x : nanos) {
+				if (x) return false;
+		}
+		for (auto x : counts) {
+				if (x) return false;
+		}
+		return true;
+}
+
+Stats& Stats::operator+=(const Stats& rhs) {
+		for (size_t i = 0; i < nanos.size(); ++i) {
+				nanos[i] += rhs.nanos[i];
+		}
+		for (size_t i = 0; i < counts.size(); ++i) {
+				counts[i] += rhs.counts[i];
+		}
+		return *this;
+}
+
+Profile collect() {
+		Profile ret;
+		ret.total.thread_name = "total";
+		std::lock_guard lock(registry_mutex);
+		for (auto& slot : registry) {
+				if (slot->empty()) continue;
+				ret.total += *slot;
+				ret.threads.push_back(*slot);
+				slot->nanos.fill(0);
+				slot->counts.fill(0);
+		}
+		return ret;
+}
+
+const char* name(Section s) {
+		switch (s) {
+		case Section::Sample: return "sample";
+		case Section::Predict: return "predict";
+		case Section::Optimize: return "optimize";
+		case Section::Grow: return "grow";
+		case Section::Sync: return "sync";
+		case Section::Busy: return "busy";
+		case Section::Metric: return "metric";
+		case Section::N: break;
+		}
+		return "?";
+}
+const char* name(Counter c) {
+		switch (c) {
+		case Counter::Samples: return "samples";
+		case Counter::NNZ: return "nnz";
+		case Counter::BytesTouched: return "bytes_touched";
+		case Counter::N: break;
+		}
+		return "?";
+}
+
+} // namespace profiler
+
+NAMESPACE_END
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+NAMESPACE_BEGIN
+
+// lightweight instrumentation that is always compiled in.
+// each thread accumulates into a slot of its own without any locking;
+// slots are aggregated and cleared by collect() when all workers are idle,
+// e.g. at the end of each epoch.
+namespace profiler {
+
+enum class Section {
+		Sample,   // fetching samples from sampler
+		Predict,  // Model::predict, when evaluating
+		Optimize, // Optimizer::train, i.e. predict and update when training
+		Grow,     // growing parameters for unseen features/fields
+		Sync,     // waiting in ThreadPool::sync
+		Busy,     // running tasks in ThreadPool
+		Metric,   // evaluating metrics
+		N,
+};
+enum class Counter {
+		Samples,      // # training samples
+		NNZ,          // # non-zero features of training samples
+		BytesTouched, // estimated bytes of parameters read or written
+		N,
+};
+
+struct Stats {
+		std::string thread_name;
+		std::array<u64, size_t(Section::N)> nanos = {};
+		std::array<u64, size_t(Counter::N)> counts = {};
+
+		double seconds(Section s) const { return nanos[size_t(s)] * 1e-9; }
+		u64 count(Counter c) const { return counts[size_t(c)]; }
+		bool empty() const;
+		Stats& operator+=(const Stats& rhs);
+};
+
+struct Profile {
+		Stats total;
+		// only threads that recorded anything since last collection
+		std::vector<Stats> threads;
+};
+
+// statistics slot of calling thread
+Stats& local();
+void set_thread_name(std::string name);
+
+inline void count(Counter c, u64 n) { local().counts[size_t(c)] += n; }
+
+// aggregate then clear all slots.
+// NOTE: no thread should be recording concurrently.
+Profile collect();
+
+const char* name(Section s);
+const char* name(Counter c);
+
+class Scope {
+	public:
+		explicit Scope(Section section)
+		: m_nanos(local().nanos[size_t(section)])
+		, m_start(std::chrono::steady_clock::now()) {}
+		~Scope() {
+				auto d = std::chrono::steady_clock::now() - m_start;
+				m_nanos += std::chrono::nanoseconds(d).count();
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		u64& m_nanos;
+		std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace profiler
+
+NAMESPACE_END
+
+#define PROFILE_SCOPE(section)                                                 \
+		::NAMESPACE_NAME::profiler::Scope CONCAT(_profile_, __COUNTER__)(      \
+			::NAMESPACE_NAME::profiler::Section::section)
@@ -0,0 +1,119 @@
+#include "socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+sockaddr_un unix_address(const String& path) {
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+				THROW("socket path too long: %s", path.c_str());
+		std::strcpy(addr.sun_path, path.c_str());
+		return addr;
+}
+
+int unix_socket() {
+		int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) THROW("failed to create socket: %s", std::strerror(errno));
+		return fd;
+}
+
+} // namespace
+
+Socket Socket::listen(const String& path, int backlog) {
+		Socket ret(unix_socket());
+		auto addr = unix_address(path);
+		::unlink(path.c_str());
+		if (::bind(ret.m_fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+				THROW("failed to bind socket to %s: %s", path.c_str(),
+					  std::strerror(errno));
+		if (::listen(ret.m_fd, backlog) < 0)
+				THROW("failed to listen on %s: %s", path.c_str(),
+					  std::strerror(errno));
+		return ret;
+}
+
+Socket Socket::connect(const String& path) {
+		Socket ret(unix_socket());
+		auto addr = unix_address(path);
+		if (::connect(ret.m_fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+				THROW("failed to connect to %s: %s", path.c_str(),
+					  std::strerror(errno));
+		return ret;
+}
+
+Socket& Socket::operator=(Socket&& rhs) noexcept {
+		if (this != &rhs) {
+				close();
+				m_fd = rhs.m_fd;
+				rhs.m_fd = -1;
+		}
+		return *this;
+}
+
+void Socket::close() {
+		if (m_fd >= 0) ::close(m_fd);
+		m_fd = -1;
+}
+
+void Socket::shutdown() {
+		if (m_fd >= 0) ::shutdown(m_fd, SHUT_RDWR);
+}
+
+Socket Socket::accept() {
+		int fd;
+		do {
+				fd = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		} while (fd < 0 && errno == EINTR);
+		if (fd < 0) THROW("failed to accept: %s", std::strerror(errno));
+		return Socket(fd);
+}
+
+void Socket::send(const void* data, size_t n_bytes) {
+		auto p = static_cast<const char*>(data);
+		while (n_bytes) {
+				auto n = ::send(m_fd, p, n_bytes, MSG_NOSIGNAL);
+				if (n < 0) {
+						if (errno == EINTR) continue;
+						THROW("failed to send: %s", std::strerror(errno));
+				}
+				p += n;
+				n_bytes -= n;
+		}
+}
+
+bool Socket::recv(void* data, size_t n_bytes) {
+		auto p = static_cast<char*>(data);
+		size_t received = 0;
+		while (received < n_bytes) {
+				auto n = ::recv(m_fd, p + received, n_bytes - received, 0);
+				if (n < 0) {
+						if (errno == EINTR) continue;
+						THROW("failed to receive: %s", std::strerror(errno));
+				}
+				if (n == 0) {
+						if (received == 0) return false;
+						THROW("connection closed by peer in the middle");
+				}
+				received += n;
+		}
+		return true;
+}
+
+size_t Socket::recv_some(void* data, size_t n_bytes) {
+		for (;;) {
+				auto n = ::recv(m_fd, data, n_bytes, 0);
+				if (n >= 0) return n;
+				if (errno == EINTR) continue;
+				THROW("failed to receive: %s", std::strerror(errno));
+		}
+}
+
+NAMESPACE_END
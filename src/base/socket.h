@@ -0,0 +1,71 @@
+#pragma once
+
+#include "exception.hpp"
+
+#include <vector>
+
+NAMESPACE_BEGIN
+
+// blocking stream socket of unix domain.
+// errors are reported by throwing Exception.
+class Socket {
+	public:
+		// create, bind and listen to a socket at given path, replacing
+		// whatever was there.
+		static Socket listen(const String& path, int backlog = 16);
+		static Socket connect(const String& path);
+
+		Socket() = default;
+		explicit Socket(int fd) : m_fd(fd) {}
+		Socket(Socket&& rhs) noexcept : m_fd(rhs.m_fd) { rhs.m_fd = -1; }
+		Socket& operator=(Socket&& rhs) noexcept;
+		Socket(const Socket&) = delete;
+		Socket& operator=(const Socket&) = delete;
+		~Socket() { close(); }
+
+		int fd() const { return m_fd; }
+		bool valid() const { return m_fd >= 0; }
+		void close();
+		// stop both directions, waking up whoever blocks on it.
+		void shutdown();
+
+		Socket accept();
+
+		void send(const void* data, size_t n_bytes);
+		// return false if peer closed connection before anything is received.
+		bool recv(void* data, size_t n_bytes);
+		// receive what has arrived, at most n_bytes but blocking until there
+		// is some; return 0 if peer closed connection.
+		size_t recv_some(void* data, size_t n_bytes);
+
+		template <typename T,
+				  typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+		void send_value(T v) {
+				send(&v, sizeof(T));
+		}
+		template <typename T,
+				  typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+		T recv_value() {
+				T v;
+				if (!recv(&v, sizeof(T))) THROW("connection closed by peer");
+				return v;
+		}
+		template <typename T,
+				  typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+		void send_vector(const std::vector<T>& v) {
+				send_value<u64>(v.size());
+				send(v.data(), v.size() * sizeof(T));
+		}
+		template <typename T,
+				  typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+		void recv_vector(std::vector<T>& v) {
+				v.resize(recv_value<u64>());
+				if (!recv(v.data(), v.size() * sizeof(T)))
+						THROW("connection closed by peer");
+		}
+
+	private:
+		int m_fd = -1;
+};
+
+NAMESPACE_END
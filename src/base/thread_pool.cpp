@@ -1,5 +1,8 @@
 #include "thread_pool.h"
 #include "exception.hpp"
+#include "logger.h"
+#include "numa.h"
+#include "profiler.h"
 
 #include <atomic>
 #include <condition_variable>
@@ -10,31 +13,46 @@
 NAMESPACE_BEGIN
 
 struct ThreadPool_impl {
-		void worker() {
+		void worker(int index, int cpu) {
+				profiler::set_thread_name("worker-" + std::to_string(index));
+				if (cpu >= 0 && !numa::pin_current_thread(cpu))
+						logger::warn("failed to pin worker {} to cpu {}", index, cpu);
+				auto& local = local_tasks[index];
 				while (true) {
 						std::function<void()> task;
 						{
 								std::unique_lock<std::mutex> lock(task_mutex);
-								condition.wait(lock, [this]() {
-										return stop || !tasks.empty();
+								condition.wait(lock, [&]() {
+										return stop || !tasks.empty()
+											|| !local.empty();
 								});
 								// allow workers in a stopped pool
 								// to still finish remaining tasks if any
-								if (stop && tasks.empty()) { return; }
-								task = std::move(tasks.front());
-								tasks.pop();
+								auto& queue = local.empty() ? tasks : local;
+								if (stop && queue.empty()) { return; }
+								task = std::move(queue.front());
+								queue.pop();
+						}
+						{
+								PROFILE_SCOPE(Busy);
+								task();
 						}
-						task();
 						sync.fetch_add(1);
 						sync_condition.notify_one();
 				}
 		}
 
-		ThreadPool_impl(int n_threads) {
+		ThreadPool_impl(int n_threads, bool pin) : local_tasks(n_threads) {
 				if (n_threads <= 0)
 						throw Exception("n_threads must be positive");
+				std::vector<int> cpus;
+				if (pin) cpus = numa::allowed_cpus();
+				pinned = !cpus.empty();
 				for (int i = 0; i < n_threads; ++i) {
-						workers.emplace_back([this]() { worker(); });
+						// cpus are grouped by node; stride over them so that
+						// workers spread evenly over nodes
+						int cpu = pinned ? cpus[i * cpus.size() / n_threads] : -1;
+						workers.emplace_back([this, i, cpu]() { worker(i, cpu); });
 				}
 		}
 		~ThreadPool_impl() {
@@ -48,22 +66,34 @@ struct ThreadPool_impl {
 				}
 		}
 
-		void do_enqueue(std::function<void()> function) {
+		void do_enqueue(std::function<void()> function, size_t worker) {
 				if (stop) throw Exception("enqueue stopped ThreadPool");
 				{
 						std::unique_lock<std::mutex> lock(task_mutex);
-						tasks.emplace(std::move(function));
+						if (worker < local_tasks.size()) {
+								local_tasks[worker].emplace(std::move(function));
+						} else {
+								tasks.emplace(std::move(function));
+						}
+				}
+				// a targeted task must wake its own worker
+				if (worker < local_tasks.size()) {
+						condition.notify_all();
+				} else {
+						condition.notify_one();
 				}
-				condition.notify_one();
 		}
 
 		std::atomic_bool stop = false;
+		bool pinned = false;
 
 		// keep track of threads so we can join them
 		std::vector<std::thread> workers;
 
 		// the task queue
 		std::queue<std::function<void()>> tasks;
+		// tasks bound to each worker; preferred over shared ones
+		std::vector<std::queue<std::function<void()>>> local_tasks;
 		std::mutex task_mutex;
 
 		// synchronization
@@ -73,15 +103,17 @@ struct ThreadPool_impl {
 		std::condition_variable sync_condition;
 };
 
-ThreadPool::ThreadPool(int n_threads)
-: m_impl(std::make_unique<ThreadPool_impl>(n_threads)) {}
+ThreadPool::ThreadPool(int n_threads, bool pin)
+: m_impl(std::make_unique<ThreadPool_impl>(n_threads, pin)) {}
 ThreadPool::~ThreadPool() = default;
 
-void ThreadPool::do_enqueue(std::function<void()> task) {
-		m_impl->do_enqueue(std::move(task));
+void ThreadPool::do_enqueue(std::function<void()> task, size_t worker) {
+		m_impl->do_enqueue(std::move(task), worker);
 }
 size_t ThreadPool::size() { return m_impl->workers.size(); }
+bool ThreadPool::pinned() { return m_impl->pinned; }
 void ThreadPool::sync(int n_wait) {
+		PROFILE_SCOPE(Sync);
 		std::unique_lock lock(m_impl->sync_mutex);
 		m_impl->sync_condition.wait(lock,
 									[&]() { return m_impl->sync == n_wait; });
@@ -2,17 +2,22 @@
 
 #include "common.h"
 
+#include <atomic>
 #include <functional>
 #include <future>
+#include <vector>
 
 NAMESPACE_BEGIN
 
 struct ThreadPool_impl;
 class ThreadPool {
 	public:
-		ThreadPool(int n_threads);
+		// with pin, worker i is bound to a cpu such that workers are spread
+		// evenly over NUMA nodes, and memory it first touches stays local.
+		ThreadPool(int n_threads, bool pin = false);
 		~ThreadPool();
 		size_t size();
+		bool pinned();
 
 		void stop();
 
@@ -27,13 +32,54 @@ class ThreadPool {
 				do_enqueue([task]() { (*task)(); });
 				return res;
 		}
+		// run on given worker, so that a task working on the same data
+		// always lands on the same cpu.
+		template <typename F, typename... Args>
+		future_result_t<F, Args...> enqueue_to(size_t worker,
+											   F&& f,
+											   Args&&... args) {
+				using R = std::invoke_result_t<F, Args...>;
+				auto task = std::make_shared<std::packaged_task<R()>>(
+					std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+				std::future<R> res = task->get_future();
+				do_enqueue([task]() { (*task)(); }, worker);
+				return res;
+		}
 		void sync(int n_wait);
 
+		// call f(i) for i in [0, total) on all workers and wait for them,
+		// handing out chunks of i on demand, for when cost of each varies.
+		template <typename F>
+		void parallel_for(size_t total, size_t chunk, F&& f);
+
 		static std::vector<size_t> split_task(size_t total, size_t n);
 
 	private:
 		std::unique_ptr<ThreadPool_impl> m_impl;
-		void do_enqueue(std::function<void()> task);
+		void do_enqueue(std::function<void()> task, size_t worker = -1);
 };
 
+template <typename F>
+void ThreadPool::parallel_for(size_t total, size_t chunk, F&& f) {
+		std::atomic<size_t> next = 0;
+		size_t n_threads = size();
+		std::vector<std::future<void>> results;
+		for (size_t t = 0; t < n_threads; ++t) {
+				results.push_back(enqueue([&]() {
+						for (;;) {
+								size_t begin = next.fetch_add(chunk);
+								if (begin >= total) return;
+								size_t end = std::min(begin + chunk, total);
+								for (size_t i = begin; i < end; ++i) {
+										f(i);
+								}
+						}
+				}));
+		}
+		sync(n_threads);
+		for (auto& result : results) {
+				result.get();
+		}
+}
+
 NAMESPACE_END
@@ -0,0 +1,80 @@
+#include "zlearn.h"
+#include "base/logger.h"
+#include "model/model.h"
+
+#include <string>
+#include <type_traits>
+
+using namespace NAMESPACE_NAME;
+
+static_assert(std::is_same_v<real_t, float>, "zl_predict() takes float");
+
+struct zl_model {
+		std::unique_ptr<Model> model;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// run f, turning whatever it throws into a failure of the call.
+template <typename F>
+int guarded(F&& f) {
+		try {
+				f();
+				return 0;
+		} catch (const std::exception& e) {
+				last_error = e.what();
+		} catch (...) {
+				last_error = "unknown error";
+		}
+		return -1;
+}
+
+} // namespace
+
+int zl_api_version(void) { return ZL_API_VERSION; }
+
+const char* zl_last_error(void) { return last_error.c_str(); }
+
+zl_model* zl_model_load(const char* path) {
+		logger::initialize_embedded();
+		zl_model* ret = nullptr;
+		guarded([&]() {
+				if (!path) THROW("no path to model");
+				auto model = Model::from_file(path);
+				ret = new zl_model{std::move(model)};
+		});
+		return ret;
+}
+
+void zl_model_free(zl_model* model) { delete model; }
+
+int zl_predict(const zl_model* model,
+			   size_t n_rows,
+			   const uint64_t* offsets,
+			   const uint32_t* fields,
+			   const uint64_t* ids,
+			   const float* values,
+			   unsigned flags,
+			   float* out) {
+		return guarded([&]() {
+				if (!model) THROW("no model");
+				if (n_rows && (!offsets || !ids || !out)) THROW("no samples");
+				// features of a sample are copied into it, which keeps its
+				// capacity across calls
+				thread_local Entry entry;
+				auto& features = entry.features;
+				for (size_t r = 0; r < n_rows; ++r) {
+						features.clear();
+						entry.scale = 1;
+						for (auto i = offsets[r]; i < offsets[r + 1]; ++i) {
+								u32 field = fields ? fields[i] : 0;
+								real_t value = values ? values[i] : 1;
+								features.emplace_back(field, ids[i], value);
+						}
+						if (flags & ZL_NORMALIZE) entry.normalize();
+						out[r] = model->model->calibrated_predict(entry);
+				}
+		});
+}
@@ -0,0 +1,66 @@
+/* C API of libzlearn, for scoring with models trained by zlearn from within
+ * another program.
+ *
+ * a model is loaded once and may then be shared by any number of threads
+ * calling zl_predict() at the same time; it must only be freed after all of
+ * them return. samples are given in CSR form in arrays owned by caller,
+ * which are read but never kept. once a thread has scored its largest
+ * sample, no more memory is allocated by its calls.
+ */
+#ifndef ZLEARN_H
+#define ZLEARN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ZLEARN_BUILD)
+#define ZL_API __attribute__((visibility("default")))
+#else
+#define ZL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on incompatible changes of this header */
+#define ZL_API_VERSION 1
+
+/* flags of zl_predict() */
+enum {
+		/* scale each sample to unit norm, as zlearn does unless
+		 * --no-normalize is given; leave it out for models trained so. */
+		ZL_NORMALIZE = 1,
+};
+
+typedef struct zl_model zl_model;
+
+/* ZL_API_VERSION the library is built with */
+ZL_API int zl_api_version(void);
+
+/* why the last failed call on this thread failed */
+ZL_API const char* zl_last_error(void);
+
+/* load a model saved by zlearn train; NULL on failure. */
+ZL_API zl_model* zl_model_load(const char* path);
+ZL_API void zl_model_free(zl_model* model);
+
+/* score n_rows samples into out[0, n_rows), as zlearn predict does.
+ * features of sample r are at [offsets[r], offsets[r + 1]) of fields, ids
+ * and values; fields may be NULL for models without fields, e.g. LM and FM,
+ * and values may be NULL for all of 1. return 0 on success, or -1 on
+ * failure. */
+ZL_API int zl_predict(const zl_model* model,
+					  size_t n_rows,
+					  const uint64_t* offsets,
+					  const uint32_t* fields,
+					  const uint64_t* ids,
+					  const float* values,
+					  unsigned flags,
+					  float* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLEARN_H */
@@ -0,0 +1,284 @@
+#include "block_file.h"
+#include "base/io_util.h"
+#include "base/logger.h"
+#include "base/serial.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+constexpr u32 magic = 0x4b424c5a; // "ZLBK"
+// 2: weights of entries
+constexpr u32 version = 2;
+
+void put_varint(std::string& out, u64 v) {
+		while (v >= 0x80) {
+				out.push_back(char(v | 0x80));
+				v >>= 7;
+		}
+		out.push_back(char(v));
+}
+u64 get_varint(const char*& p, const char* end) {
+		u64 v = 0;
+		for (int shift = 0; shift < 64 && p != end; shift += 7) {
+				u8 byte = *p++;
+				v |= u64(byte & 0x7f) << shift;
+				if (!(byte & 0x80)) return v;
+		}
+		THROW("corrupted block: bad varint");
+}
+
+template <typename T>
+void put_raw(std::string& out, T v) {
+		out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+template <typename T>
+T get_raw(const char*& p, const char* end) {
+		if (size_t(end - p) < sizeof(T)) THROW("corrupted block: truncated");
+		T v;
+		std::memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+		return v;
+}
+
+// so that small negative deltas, from unsorted features, stay small
+u64 zigzag(i64 v) { return (u64(v) << 1) ^ u64(v >> 63); }
+i64 unzigzag(u64 v) { return i64(v >> 1) ^ -i64(v & 1); }
+
+std::string encode_block(Entries::const_iterator begin,
+						 Entries::const_iterator end,
+						 bool has_label) {
+		std::vector<u32> fields;
+		for (auto it = begin; it != end; ++it) {
+				for (auto& f : (*it)->features) {
+						fields.push_back(f.field_id);
+				}
+		}
+		std::sort(fields.begin(), fields.end());
+		auto last = std::unique(fields.begin(), fields.end());
+		fields.erase(last, fields.end());
+
+		std::string out;
+		put_varint(out, end - begin);
+		put_varint(out, fields.size());
+		u32 prev_field = 0;
+		for (auto field : fields) {
+				put_varint(out, field - prev_field);
+				prev_field = field;
+		}
+
+		std::vector<real_t> values;
+		for (auto it = begin; it != end; ++it) {
+				auto& e = **it;
+				// values as in input
+				values.clear();
+				for (auto& f : e.features) {
+						values.push_back(f.value / e.scale);
+				}
+				bool all_ones = std::all_of(values.begin(), values.end(),
+											[](real_t v) { return v == 1; });
+				bool weighted = has_label && e.weight != 1;
+				put_varint(out,
+						   e.features.size() << 2 | weighted << 1 | all_ones);
+				if (has_label) put_raw(out, e.label);
+				if (weighted) put_raw(out, e.weight);
+				size_t prev_id = 0;
+				for (auto& f : e.features) {
+						put_varint(out, zigzag(i64(f.id) - i64(prev_id)));
+						prev_id = f.id;
+						auto field = std::lower_bound(
+							fields.begin(), fields.end(), f.field_id);
+						put_varint(out, field - fields.begin());
+				}
+				if (all_ones) continue;
+				// a bit per feature for whether value is 1; others follow
+				for (size_t i = 0; i < values.size(); i += 8) {
+						u8 bits = 0;
+						size_t n = std::min(values.size() - i, size_t(8));
+						for (size_t j = 0; j < n; ++j) {
+								if (values[i + j] == 1) bits |= 1 << j;
+						}
+						out.push_back(char(bits));
+				}
+				for (auto v : values) {
+						if (v != 1) put_raw(out, v);
+				}
+		}
+		return out;
+}
+
+void decode_block(const std::string& raw,
+				  u32 file_version,
+				  bool has_label,
+				  Entries& result) {
+		const char* p = raw.data();
+		const char* end = p + raw.size();
+		size_t n_entries = get_varint(p, end);
+		std::vector<u32> fields(get_varint(p, end));
+		u32 prev_field = 0;
+		for (auto& field : fields) {
+				field = prev_field += get_varint(p, end);
+		}
+
+		result.reserve(result.size() + n_entries);
+		for (size_t i = 0; i < n_entries; ++i) {
+				auto entry = std::make_shared<Entry>();
+				u64 header = get_varint(p, end);
+				bool all_ones = header & 1;
+				header >>= 1;
+				bool weighted = file_version >= 2 && (header & 1);
+				if (file_version >= 2) header >>= 1;
+				auto& features = entry->features;
+				features.resize(header);
+				if (has_label) entry->label = get_raw<real_t>(p, end);
+				if (weighted) entry->weight = get_raw<real_t>(p, end);
+				size_t prev_id = 0;
+				for (auto& f : features) {
+						f.id = prev_id += unzigzag(get_varint(p, end));
+						size_t field = get_varint(p, end);
+						if (field >= fields.size())
+								THROW("corrupted block: bad field index");
+						f.field_id = fields[field];
+						f.value = 1;
+				}
+				if (!all_ones) {
+						const char* bits = p;
+						p += (features.size() + 7) / 8;
+						if (p > end) THROW("corrupted block: truncated");
+						for (size_t j = 0; j < features.size(); ++j) {
+								if (!(bits[j / 8] & (1 << (j % 8))))
+										features[j].value =
+											get_raw<real_t>(p, end);
+						}
+				}
+				result.push_back(std::move(entry));
+		}
+}
+
+} // namespace
+
+void BlockFile::write(String path,
+					  const DataSet& data,
+					  ThreadPool& pool,
+					  size_t block_size) {
+		RELEASE_ASSERT(block_size > 0);
+		auto pfile = must_open_file(
+			path.c_str(), std::ios_base::binary | std::ios_base::out);
+		auto& file = *pfile;
+		file.exceptions(std::ios::badbit | std::ios::failbit);
+
+		serialize_to(file, magic);
+		serialize_to(file, version);
+		serialize_to(file, data.has_label());
+		serialize_to(file, u64(block_size));
+		serialize_to(file, u64(data.size()));
+
+		auto& entries = data.entries();
+		size_t n_blocks = (entries.size() + block_size - 1) / block_size;
+		std::vector<u64> offsets;
+		// encode a block per thread at a time, bounding memory used
+		std::vector<std::string> encoded(pool.size());
+		for (size_t first = 0; first < n_blocks; first += pool.size()) {
+				size_t n = std::min(pool.size(), n_blocks - first);
+				std::vector<std::future<void>> results;
+				for (size_t i = 0; i < n; ++i) {
+						size_t b = (first + i) * block_size;
+						size_t e = std::min(b + block_size, entries.size());
+						results.push_back(pool.enqueue([&, i, b, e]() {
+								encoded[i] = encode_block(entries.begin() + b,
+														  entries.begin() + e,
+														  data.has_label());
+						}));
+				}
+				pool.sync(n);
+				for (size_t i = 0; i < n; ++i) {
+						results[i].get();
+						offsets.push_back(file.tellp());
+						file.write(encoded[i].data(), encoded[i].size());
+				}
+		}
+		u64 index = file.tellp();
+		offsets.push_back(index);
+		serialize_to(file, offsets);
+		serialize_to(file, index);
+}
+
+bool BlockFile::is_block_file(String path) {
+		std::ifstream file(path.c_str(), std::ios_base::binary);
+		u32 v = 0;
+		file.read(reinterpret_cast<char*>(&v), sizeof(v));
+		return file && v == magic;
+}
+
+BlockFile::BlockFile(String path) : m_path(std::move(path)) {
+		auto pfile = must_open_file(
+			m_path.c_str(), std::ios_base::binary | std::ios_base::in);
+		auto& file = *pfile;
+		file.exceptions(std::ios::badbit | std::ios::failbit);
+
+		u32 file_magic;
+		deserialize_from(file, file_magic);
+		if (file_magic != magic)
+				THROW("%s is not a block file", m_path.c_str());
+		deserialize_from(file, m_version);
+		if (m_version == 0 || m_version > version)
+				THROW("unsupported block file version %u", m_version);
+		deserialize_from(file, m_has_label);
+		u64 block_size, n_entries;
+		deserialize_from(file, block_size);
+		deserialize_from(file, n_entries);
+		m_block_size = block_size;
+		m_n_entries = n_entries;
+
+		u64 index;
+		file.seekg(-std::streamoff(sizeof(index)), std::ios_base::end);
+		deserialize_from(file, index);
+		file.seekg(index);
+		deserialize_from(file, m_offsets);
+		if (m_offsets.empty() || m_offsets.back() != index)
+				THROW("corrupted block index in %s", m_path.c_str());
+}
+
+void BlockFile::read_block(size_t i, Entries& result) const {
+		ASSERT(i < n_blocks());
+		// a file per call, so that blocks are read concurrently
+		auto pfile = must_open_file(
+			m_path.c_str(), std::ios_base::binary | std::ios_base::in);
+		auto& file = *pfile;
+		file.exceptions(std::ios::badbit | std::ios::failbit);
+		std::string raw(m_offsets[i + 1] - m_offsets[i], '\0');
+		file.seekg(m_offsets[i]);
+		file.read(raw.data(), raw.size());
+		decode_block(raw, m_version, m_has_label, result);
+}
+
+std::shared_ptr<DataSet> BlockFile::load(ThreadPool& pool) const {
+		logger::info("loading {} blocks from {}", n_blocks(), m_path.c_str());
+		if (n_blocks() == 0) return std::make_shared<DataSet>();
+		size_t n_threads = std::min(pool.size(), n_blocks());
+		auto splits = ThreadPool::split_task(n_blocks(), n_threads);
+		std::vector<Entries> shares(n_threads);
+		std::vector<std::future<void>> results;
+		for (size_t i = 0; i < n_threads; ++i) {
+				results.push_back(pool.enqueue([&, i]() {
+						for (size_t j = splits[i]; j < splits[i + 1]; ++j) {
+								read_block(j, shares[i]);
+						}
+				}));
+		}
+		pool.sync(n_threads);
+		Entries entries;
+		entries.reserve(m_n_entries);
+		for (size_t i = 0; i < n_threads; ++i) {
+				results[i].get();
+				std::move(shares[i].begin(), shares[i].end(),
+						  std::back_inserter(entries));
+		}
+		return std::make_shared<DataSet>(std::move(entries), m_has_label);
+}
+
+NAMESPACE_END
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "data_set.h"
+
+NAMESPACE_BEGIN
+
+// data set compressed into blocks on disk.
+// each block holds a fixed # entries and is decoded independently of
+// others, so blocks may be decoded in parallel or one at a time while
+// training. in a block:
+// - field ids are indices into a dictionary of fields it contains;
+// - feature ids are varints of delta from previous feature of the entry,
+//   which mostly fit in a byte or two as features are sorted by id;
+// - values of 1, as of categorical features, take a single bit;
+// - weights are only stored for entries not of weight 1.
+class BlockFile {
+	public:
+		static constexpr size_t default_block_size = 4096;
+
+		// encode blocks on given pool and write them to path.
+		static void write(String path,
+						  const DataSet& data,
+						  ThreadPool& pool,
+						  size_t block_size = default_block_size);
+		// whether the file at path is a block file, by its magic number.
+		static bool is_block_file(String path);
+
+		explicit BlockFile(String path);
+
+		bool has_label() const { return m_has_label; }
+		size_t size() const { return m_n_entries; }
+		size_t n_blocks() const { return m_offsets.size() - 1; }
+		size_t block_size() const { return m_block_size; }
+
+		// decode i-th block into result; may be called concurrently.
+		// NOTE: what's already in result will NOT be cleared.
+		void read_block(size_t i, Entries& result) const;
+		// decode all blocks in parallel on given pool.
+		std::shared_ptr<DataSet> load(ThreadPool& pool) const;
+
+	private:
+		String m_path;
+		u32 m_version = 0;
+		bool m_has_label = false;
+		size_t m_n_entries = 0;
+		size_t m_block_size = 0;
+		std::vector<u64> m_offsets; // of each block, and end of the last one
+};
+
+NAMESPACE_END
@@ -4,12 +4,28 @@
 #include "base/math.h"
 #include "base/random.h"
 #include "base/serial.h"
+#include "base/thread_pool.h"
 
 #include <algorithm>
 #include <cstring>
 
 NAMESPACE_BEGIN
 
+void DataSet::localize(ThreadPool& pool) {
+		size_t n_threads = pool.size();
+		auto splits = ThreadPool::split_task(size(), n_threads);
+		for (size_t i = 0; i < n_threads; ++i) {
+				auto task = [this, begin = splits[i], end = splits[i + 1]]() {
+						for (size_t j = begin; j < end; ++j) {
+								auto& e = m_entries[j];
+								e = std::make_shared<Entry>(*e);
+						}
+				};
+				pool.enqueue_to(i, std::move(task));
+		}
+		pool.sync(n_threads);
+}
+
 std::shared_ptr<DataSet>
 DataSet::train_test_split(int train_share, int test_share, bool shuffle) {
 		if (shuffle)
@@ -35,7 +51,11 @@ void DataSet::serialize(String filename) {
 		serialize_to(file, m_has_label);
 		serialize_to(file, m_entries.size());
 		for (const auto& entry : m_entries) {
-				if (m_has_label) { serialize_to(file, entry->label); }
+				if (m_has_label) {
+						serialize_to(file, entry->label);
+						serialize_to(file, entry->weight);
+				}
+				serialize_to(file, entry->scale);
 				serialize_to(file, entry->features.size());
 				for (auto& feature : entry->features) {
 						serialize_to(file, feature.field_id);
@@ -59,7 +79,11 @@ void DataSet::deserialize(String filename) {
 		reserve(n_entries);
 		for (size_t i = 0; i < n_entries; ++i) {
 				auto&& entry = add_entry();
-				if (m_has_label) { deserialize_from(file, entry->label); }
+				if (m_has_label) {
+						deserialize_from(file, entry->label);
+						deserialize_from(file, entry->weight);
+				}
+				deserialize_from(file, entry->scale);
 				size_t n_features;
 				deserialize_from(file, n_features);
 				entry->features.resize(n_features);
@@ -77,106 +101,136 @@ void DataSet::serialize_txt(String filename) {
 		file.exceptions(std::ios::badbit | std::ios::failbit);
 
 		for (auto& e : m_entries) {
-				if (has_label()) file << e->label << ' ';
+				if (has_label()) {
+						file << e->label;
+						if (e->weight != 1) file << ':' << e->weight;
+						file << ' ';
+				}
+				// values as in input
 				for (auto& f : e->features) {
-						file << f.field_id << ':' << f.id << ':' << f.value;
+						file << f.field_id << ':' << f.id << ':'
+							 << f.value / e->scale;
 						if (&f != &e->features.back()) file << ' ';
 				}
 				file << std::endl;
 		}
 }
 
-enum class FileFormat {
-		CSV,
-		SVM,
-		FFM,
-};
-
-static std::shared_ptr<DataSet>
-parse_csv(std::fstream& fs, bool remove_zeros, String separators) {
-		auto ret = std::make_shared<DataSet>();
-		ret->has_label(true);
-		std::string line;
-		while (std::getline(fs, line)) {
-				auto&& entry = ret->add_entry();
-				auto token = std::strtok(line.data(), separators.c_str());
-				entry->label = std::atof(token);
-				size_t feature_id = 0;
-				size_t field_id = 0;
-				token = std::strtok(nullptr, separators.c_str());
-				while (token) {
-						real_t value = std::atof(token);
-						if (!(remove_zeros && value == 0)) {
-								entry->features.emplace_back(
-									field_id++, feature_id++, value);
-						}
-						token = std::strtok(nullptr, separators.c_str());
+LineParser::LineParser(std::string line,
+					   bool remove_zeros,
+					   String separators)
+: m_remove_zeros(remove_zeros), m_separators(std::move(separators)) {
+		if (m_separators.empty()) {
+				int count[256] = {};
+				for (unsigned char c : line) {
+						count[c]++;
 				}
+				m_separators += most_frequent_blank(count);
 		}
-		return ret;
-}
-static std::shared_ptr<DataSet> parse_svm(std::fstream& fs,
-										  bool remove_zeros,
-										  String separators,
-										  bool has_label) {
-		auto ret = std::make_shared<DataSet>();
-		ret->has_label(has_label);
-		std::string line;
-		while (std::getline(fs, line)) {
-				auto&& entry = ret->add_entry();
-				auto token = std::strtok(line.data(), separators.c_str());
-				if (has_label) {
-						entry->label = std::atof(token);
-						token = std::strtok(nullptr, separators.c_str());
+
+		char* rest;
+		auto word1 = strtok_r(line.data(), m_separators.c_str(), &rest);
+		if (word1 == nullptr) THROW("can not detect format of a blank line");
+		int n_colon_1 = std::count(word1, word1 + strlen(word1), ':');
+		auto word2 = strtok_r(nullptr, m_separators.c_str(), &rest);
+		if (word2 == nullptr) {
+				m_has_label = false;
+				switch (n_colon_1) {
+				case 0: m_format = Format::CSV; break;
+				case 1: m_format = Format::SVM; break;
+				case 2: m_format = Format::FFM; break;
+				default: THROW("can not detect format: '%s'", word1);
 				}
-				while (token) {
-						std::string_view unit(token, strlen(token));
-						auto colon1 = unit.find_first_of(':');
-						ASSERT(unit.find_first_of(':', colon1 + 1)
-							   == std::string_view::npos);
-						token[colon1] = '\0';
-						size_t feature_id = std::atoll(token);
-						real_t value = std::atof(token + colon1 + 1);
-						if (!(remove_zeros && value == 0)) {
-								entry->features.emplace_back(feature_id, value);
-						}
-						token = std::strtok(nullptr, separators.c_str());
+		} else {
+				int n_colon_2 = std::count(word2, word2 + strlen(word2), ':');
+				switch (n_colon_2) {
+				case 0: m_format = Format::CSV; break;
+				case 1: m_format = Format::SVM; break;
+				case 2: m_format = Format::FFM; break;
+				default: THROW("can not detect format: '%s'", word2);
 				}
+				// label of FFM data may come with weight as label:weight
+				m_has_label = n_colon_1 == 0
+					|| (m_format == Format::FFM && n_colon_1 == 1);
+		}
+		// first column of CSV is always label
+		if (m_format == Format::CSV) m_has_label = true;
+		switch (m_format) {
+		case Format::CSV: logger::info("detected CSV format"); break;
+		case Format::SVM: logger::info("detected SVM format"); break;
+		case Format::FFM: logger::info("detected FFM format"); break;
 		}
-		return ret;
 }
-static std::shared_ptr<DataSet> parse_ffm(std::fstream& fs,
-										  bool remove_zeros,
-										  String separators,
-										  bool has_label) {
-		auto ret = std::make_shared<DataSet>();
-		ret->has_label(has_label);
-		std::string line;
-		while (std::getline(fs, line)) {
-				auto&& entry = ret->add_entry();
-				auto token = std::strtok(line.data(), separators.c_str());
-				if (has_label) {
-						entry->label = std::atof(token);
-						token = std::strtok(nullptr, separators.c_str());
+
+int LineParser::most_frequent_blank(const int count[256]) {
+		int freq_blank = ' ';
+		int n_freq_blank = 0;
+		for (int c = 0; c < 256; ++c) {
+				if (std::isblank(c) && count[c] > n_freq_blank) {
+						freq_blank = c;
+						n_freq_blank = count[c];
 				}
-				while (token) {
-						std::string_view unit(token, strlen(token));
+		}
+		return freq_blank;
+}
+
+bool LineParser::parse(std::string& line, Entry& entry) const {
+		// strtok_r() rather than strtok(), as lines may be parsed by several
+		// threads at once, e.g. of connections of serve
+		char* rest;
+		auto next = [&]() {
+				return strtok_r(nullptr, m_separators.c_str(), &rest);
+		};
+		auto token = strtok_r(line.data(), m_separators.c_str(), &rest);
+		if (token == nullptr) return false;
+		if (m_has_label) {
+				entry.label = std::atof(token);
+				if (auto colon = std::strchr(token, ':'))
+						entry.weight = std::atof(colon + 1);
+				token = next();
+		}
+		size_t n_columns = 0;
+		while (token) {
+				std::string_view unit(token, strlen(token));
+				size_t field_id = 0, feature_id = 0;
+				real_t value;
+				switch (m_format) {
+				case Format::CSV:
+						field_id = feature_id = n_columns++;
+						value = std::atof(token);
+						break;
+				case Format::SVM: {
 						auto colon1 = unit.find_first_of(':');
-						auto colon2 = unit.find_first_of(':', colon1 + 1);
-						ASSERT(unit.find_first_of(':', colon2 + 1)
-							   == std::string_view::npos);
+						if (colon1 == std::string_view::npos
+							|| unit.find_first_of(':', colon1 + 1)
+								   != std::string_view::npos)
+								THROW("bad feature '%s'", token);
+						token[colon1] = '\0';
+						feature_id = std::atoll(token);
+						value = std::atof(token + colon1 + 1);
+				} break;
+				case Format::FFM: {
+						auto colon1 = unit.find_first_of(':');
+						auto colon2 = colon1 == std::string_view::npos
+										  ? colon1
+										  : unit.find_first_of(':', colon1 + 1);
+						if (colon2 == std::string_view::npos
+							|| unit.find_first_of(':', colon2 + 1)
+								   != std::string_view::npos)
+								THROW("bad feature '%s'", token);
 						token[colon1] = token[colon2] = '\0';
-						size_t field_id = std::atoll(token);
-						size_t feature_id = std::atoll(token + colon1 + 1);
-						real_t value = std::atof(token + colon2 + 1);
-						if (!(remove_zeros && value == 0)) {
-								entry->features.emplace_back(field_id,
-															 feature_id, value);
-						}
-						token = std::strtok(nullptr, separators.c_str());
+						field_id = std::atoll(token);
+						feature_id = std::atoll(token + colon1 + 1);
+						value = std::atof(token + colon2 + 1);
+				} break;
 				}
+				if (!(m_remove_zeros && value == 0)) {
+						entry.features.emplace_back(field_id, feature_id,
+													value);
+				}
+				token = next();
 		}
-		return ret;
+		return true;
 }
 
 std::shared_ptr<DataSet>
@@ -198,65 +252,20 @@ DataSet::from_file(String p, bool remove_zeros, String separators) {
 				}
 				file.clear();
 				file.seekg(0, std::ios::beg);
-				int freq_blank = ' ';
-				int n_freq_blank = 0;
-				for (c = 0; c < 256; ++c) {
-						if (std::isblank(c) && count[c] > n_freq_blank) {
-								freq_blank = c;
-								n_freq_blank = count[c];
-						}
-				}
-				separators += freq_blank;
-				if (separators.empty())
-						throw Exception("failed to detect separators");
+				separators += LineParser::most_frequent_blank(count);
 		}
 
-		FileFormat format;
-		bool has_label;
-		auto line = peek_first_line(file);
-		auto word1 = std::strtok(line.data(), separators.c_str());
-		int n_colon_1 = std::count(word1, word1 + strlen(word1), ':');
-		auto word2 = std::strtok(nullptr, separators.c_str());
-		if (word2 == nullptr) {
-				has_label = false;
-				switch (n_colon_1) {
-				case 0: format = FileFormat::CSV; break;
-				case 1: format = FileFormat::SVM; break;
-				case 2: format = FileFormat::FFM; break;
-				default: THROW("can not detect format: '%s'", word1);
-				}
-		} else {
-				int n_colon_2 = std::count(word2, word2 + strlen(word2), ':');
-				switch (n_colon_2) {
-				case 0:
-						format = FileFormat::CSV;
-						has_label = true;
-						break;
-				case 1:
-						format = FileFormat::SVM;
-						has_label =
-							std::count(word1, word1 + strlen(word1), ':') == 0;
-						break;
-				case 2:
-						format = FileFormat::FFM;
-						has_label =
-							std::count(word1, word1 + strlen(word1), ':') == 0;
-						break;
-				default: THROW("can not detect format: '%s'", word2);
-				}
-		}
-		switch (format) {
-		case FileFormat::CSV:
-				logger::info("detected CSV format");
-				return parse_csv(file, remove_zeros, separators);
-		case FileFormat::SVM:
-				logger::info("detected SVM format");
-				return parse_svm(file, remove_zeros, separators, has_label);
-		case FileFormat::FFM:
-				logger::info("detected FFM format");
-				return parse_ffm(file, remove_zeros, separators, has_label);
-		default: UNREACHABLE("file format");
+		LineParser parser(peek_first_line(file), remove_zeros, separators);
+		auto ret = std::make_shared<DataSet>();
+		ret->has_label(parser.has_label());
+		std::string line;
+		while (std::getline(file, line)) {
+				Entry entry;
+				if (parser.parse(line, entry))
+						ret->m_entries.push_back(
+							std::make_shared<Entry>(std::move(entry)));
 		}
+		return ret;
 }
 
 std::shared_ptr<DataSet>
@@ -276,4 +285,27 @@ DataSet::dummy(int n_entries, int n_features, int n_fields) {
 		return ret;
 }
 
+std::shared_ptr<DataSet> DataSet::dummy(
+	int n_entries, int n_features, int n_fields, int nnz, unsigned seed) {
+		RELEASE_ASSERT(n_fields > 0);
+		RELEASE_ASSERT(n_features > 0);
+		RELEASE_ASSERT(nnz >= 0);
+		auto ret = std::make_shared<DataSet>();
+		ret->has_label(true);
+		ret->reserve(n_entries);
+		std::mt19937 G(seed);
+		std::uniform_int_distribution<int> id_dist(0, n_features - 1);
+		std::bernoulli_distribution label_dist(0.5);
+		for (int i = 0; i < n_entries; ++i) {
+				auto& e = ret->add_entry();
+				e->label = label_dist(G);
+				e->features.reserve(nnz);
+				for (int j = 0; j < nnz; ++j) {
+						e->features.emplace_back(j % n_fields, id_dist(G), 1);
+				}
+				e->sort_features();
+		}
+		return ret;
+}
+
 NAMESPACE_END
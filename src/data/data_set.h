@@ -5,6 +5,33 @@
 
 NAMESPACE_BEGIN
 
+class ThreadPool;
+
+// parser of lines of text data in CSV, SVM or FFM format.
+class LineParser {
+	public:
+		// detect format, and separator if not given, from a sample line.
+		LineParser(std::string line, bool remove_zeros, String separators = "");
+
+		bool has_label() const { return m_has_label; }
+		// parse a line into entry; the line is modified in place.
+		// return false if the line is blank.
+		bool parse(std::string& line, Entry& entry) const;
+
+		static int most_frequent_blank(const int count[256]);
+
+	private:
+		enum class Format {
+				CSV,
+				SVM,
+				FFM,
+		};
+		Format m_format;
+		bool m_has_label;
+		bool m_remove_zeros;
+		String m_separators;
+};
+
 class DataSet : public std::enable_shared_from_this<DataSet> {
 	public:
 		static std::shared_ptr<DataSet>
@@ -12,6 +39,13 @@ class DataSet : public std::enable_shared_from_this<DataSet> {
 
 		static std::shared_ptr<DataSet>
 		dummy(int n_entries, int n_features, int n_fields = 1);
+		// random categorical data with nnz features of value 1 per row,
+		// spread evenly over fields; ids are drawn from [0, n_features).
+		static std::shared_ptr<DataSet> dummy(int n_entries,
+											  int n_features,
+											  int n_fields,
+											  int nnz,
+											  unsigned seed);
 
 		DataSet() = default;
 		~DataSet() = default;
@@ -37,15 +71,27 @@ class DataSet : public std::enable_shared_from_this<DataSet> {
 						e->sort_features();
 				}
 		}
+		// scale feature vectors to unit norm; done once as data is loaded,
+		// and the scale of each entry is kept.
+		void normalize() {
+				for (auto& e : m_entries) {
+						e->normalize();
+				}
+		}
 
 		std::shared_ptr<DataSet>
 		train_test_split(int train_share, int test_share, bool shuffle);
 
+		// re-allocate entries in each share of ThreadPool::split_task on the
+		// worker processing it in a full pass, so that with pinned threads
+		// samples live on the NUMA node that reads them.
+		void localize(ThreadPool& pool);
+
 		void serialize(String filename);
 		void deserialize(String filename);
 		void serialize_txt(String filename);
 
-		static size_t max_feature_id(Entries& entries) {
+		static size_t max_feature_id(const Entries& entries) {
 				size_t max_id = 0;
 				for (const auto& entry : entries) {
 						for (auto& feature : entry->features) {
@@ -54,11 +100,11 @@ class DataSet : public std::enable_shared_from_this<DataSet> {
 				}
 				return max_id;
 		}
-		static size_t max_field_id(Entries& entries) {
+		static size_t max_field_id(const Entries& entries) {
 				size_t max_id = 0;
 				for (const auto& entry : entries) {
 						for (auto& feature : entry->features) {
-								max_id = std::max(max_id, feature.field_id);
+								max_id = std::max(max_id, size_t(feature.field_id));
 						}
 				}
 				return max_id;
@@ -0,0 +1,104 @@
+#include "data_stream.h"
+#include "base/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+NAMESPACE_BEGIN
+
+namespace {
+constexpr size_t chunk_size = 64 << 10;
+}
+
+DataStream::DataStream(const std::string& path,
+					   bool remove_zeros,
+					   bool normalize)
+: m_remove_zeros(remove_zeros), m_normalize(normalize) {
+		if (path != "-") {
+				// opening a FIFO blocks until a writer shows up
+				m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+				if (m_fd < 0)
+						THROW("failed to open '%s': %s", path.c_str(),
+							  std::strerror(errno));
+		}
+		logger::info("streaming data from {}",
+					 path == "-" ? "stdin" : path.c_str());
+		if (remove_zeros) {
+				logger::warn("feature of value 0 will be ignored");
+		}
+}
+DataStream::~DataStream() {
+		if (m_fd > 0) ::close(m_fd);
+}
+
+size_t DataStream::read(size_t n,
+						Entries& result,
+						std::optional<TimePoint> deadline) {
+		size_t n_read = 0;
+		std::string line;
+		while (n_read < n) {
+				auto end = m_buffer.find('\n', m_begin);
+				if (end == std::string::npos) {
+						if (!m_eof) {
+								if (!receive(deadline)) break;
+								continue;
+						}
+						// last line without newline
+						if (m_begin == m_buffer.size()) break;
+						end = m_buffer.size();
+				}
+				line.assign(m_buffer, m_begin, end - m_begin);
+				m_begin = std::min(end + 1, m_buffer.size());
+				n_read += parse(line, result);
+		}
+		return n_read;
+}
+
+bool DataStream::parse(std::string& line, Entries& result) {
+		++m_n_lines;
+		if (!m_parser) {
+				auto first = line.find_first_not_of(" \t\r");
+				if (first == std::string::npos) return false;
+				m_parser.emplace(line, m_remove_zeros);
+		}
+		auto entry = std::make_shared<Entry>();
+		if (!m_parser->parse(line, *entry)) return false;
+		entry->sort_features();
+		if (m_normalize) entry->normalize();
+		result.push_back(std::move(entry));
+		return true;
+}
+
+bool DataStream::receive(std::optional<TimePoint> deadline) {
+		m_buffer.erase(0, m_begin);
+		m_begin = 0;
+		for (;;) {
+				int timeout = -1;
+				if (deadline) {
+						using std::chrono::milliseconds;
+						auto left = *deadline - Clock::now();
+						auto ms = std::chrono::ceil<milliseconds>(left);
+						timeout = std::max<int>(ms.count(), 0);
+				}
+				pollfd ready{m_fd, POLLIN, 0};
+				int n_ready = ::poll(&ready, 1, timeout);
+				if (n_ready < 0 && errno == EINTR) continue;
+				if (n_ready < 0)
+						THROW("failed to poll: %s", std::strerror(errno));
+				if (n_ready == 0) return false;
+
+				size_t size = m_buffer.size();
+				m_buffer.resize(size + chunk_size);
+				auto got = ::read(m_fd, &m_buffer[size], chunk_size);
+				m_buffer.resize(size + std::max<ssize_t>(got, 0));
+				if (got < 0 && errno == EINTR) continue;
+				if (got < 0) THROW("failed to read: %s", std::strerror(errno));
+				if (got == 0) m_eof = true;
+				return true;
+		}
+}
+
+NAMESPACE_END
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "base/timer.h"
+#include "data_set.h"
+
+#include <optional>
+#include <string>
+
+NAMESPACE_BEGIN
+
+// live stream of samples in text, e.g. from stdin or a FIFO.
+// unlike DataSet::from_file(), it is read only once and never seeked, so
+// format is detected from the first non-blank line alone.
+class DataStream {
+	public:
+		// "-" for stdin
+		DataStream(const std::string& path, bool remove_zeros, bool normalize);
+		~DataStream();
+		DataStream(const DataStream&) = delete;
+		DataStream& operator=(const DataStream&) = delete;
+
+		// block until n samples are read, the stream ends or deadline, if
+		// any, passes; so a slow stream still yields a partial batch in time.
+		// return actual # samples read, which is 0 before eof() only when
+		// nothing arrived in time.
+		// NOTE: what's already in result will NOT be cleared.
+		size_t read(size_t n,
+					Entries& result,
+					std::optional<TimePoint> deadline = std::nullopt);
+		bool eof() const { return m_eof && m_begin == m_buffer.size(); }
+		// only known after the first sample is read
+		bool has_label() const { return m_parser && m_parser->has_label(); }
+		size_t n_lines() const { return m_n_lines; }
+
+	private:
+		bool parse(std::string& line, Entries& result);
+		// wait for more input until deadline; false if none arrived.
+		bool receive(std::optional<TimePoint> deadline);
+
+		int m_fd = 0;
+		// received but not yet parsed from m_begin on
+		std::string m_buffer;
+		size_t m_begin = 0;
+		bool m_eof = false;
+		bool m_remove_zeros;
+		bool m_normalize;
+		std::optional<LineParser> m_parser;
+		size_t m_n_lines = 0;
+};
+
+NAMESPACE_END
@@ -1,31 +1,22 @@
 #include "entry.h"
 
 #include <algorithm>
+#include <cmath>
 
 NAMESPACE_BEGIN
 
-void Entry::set_normalize(bool b) {
-		if (b) {
-				if (inv_norm2) return; // already normalized
-				// TODO normalized but feature value was changed? allow update
-
-				real_t norm2 = 0.0;
-				for (auto& f : features) {
-						norm2 += f.value * f.value;
-				}
-				inv_norm2 = 1.0 / norm2;
-				auto inv_norm = std::sqrt(*inv_norm2);
-				for (auto& f : features) {
-						f.normalized_value = f.value * inv_norm;
-				}
-		} else {
-				if (!inv_norm2) return; // not normalized in the beginning
-
-				inv_norm2.reset();
-				for (auto& f : features) {
-						f.normalized_value = f.value;
-				}
+void Entry::normalize() {
+		real_t norm2 = 0.0;
+		for (auto& f : features) {
+				norm2 += f.value * f.value;
+		}
+		// already of unit norm, or nothing to scale
+		if (norm2 == 0 || std::abs(norm2 - 1) < 1e-6) return;
+		real_t inv_norm = 1.0 / std::sqrt(norm2);
+		for (auto& f : features) {
+				f.value *= inv_norm;
 		}
+		scale *= inv_norm;
 }
 void Entry::sort_features() {
 		std::sort(
@@ -14,18 +14,13 @@ struct Feature {
 		Feature(Feature&&) = default;
 		Feature& operator=(const Feature&) = default;
 		Feature& operator=(Feature&&) = default;
-		Feature(size_t id, real_t value) : id(id), value(value) {
-				normalized_value = value;
-		}
+		Feature(size_t id, real_t value) : id(id), value(value) {}
 		Feature(size_t field_id, size_t id, real_t value)
-		: field_id(field_id), id(id), value(value) {
-				normalized_value = value;
-		}
+		: id(id), field_id(field_id), value(value) {}
 
-		size_t field_id = 0;
 		size_t id = 0;
-		real_t value = 0;
-		real_t normalized_value; // could be set by containing Entry
+		u32 field_id = 0;
+		real_t value = 0; // already scaled by containing Entry
 
 		bool operator==(const Feature& rhs) const;
 		bool operator!=(const Feature& rhs) const { return !(rhs == *this); }
@@ -38,24 +33,24 @@ inline bool Feature::operator==(const Feature& rhs) const {
 struct Entry {
 		// {0, 1} for binary classification; ratings for regression, etc.
 		real_t label = 0;
+		// importance of the sample, by which its loss is multiplied
+		real_t weight = 1;
 		FeatureVector features;
-		// cached inverse of norm of feature vector.
-		// only has value when normalizing
+		// values of features have been multiplied by it, e.g. to normalize;
+		// value as in input is value / scale.
+		real_t scale = 1;
 
-		void set_normalize(bool b);
-		real_t get_inv_norm2() const { return inv_norm2.value_or(1.0); }
+		// scale feature vector to unit norm, once; it is a no-op afterwards.
+		void normalize();
 		void sort_features();
 		bool operator==(const Entry& rhs) const;
 		bool operator!=(const Entry& rhs) const { return !(rhs == *this); }
-
-	private:
-		std::optional<real_t> inv_norm2;
 };
 using Entries = std::vector<std::shared_ptr<Entry>>;
 
 inline bool Entry::operator==(const Entry& rhs) const {
-		return label == rhs.label && features == rhs.features
-			&& inv_norm2 == rhs.inv_norm2;
+		return label == rhs.label && weight == rhs.weight
+			&& features == rhs.features && scale == rhs.scale;
 }
 
 NAMESPACE_END
@@ -0,0 +1,31 @@
+#include "feature_columns.h"
+#include "base/exception.hpp"
+
+NAMESPACE_BEGIN
+
+FeatureColumns::FeatureColumns(const Entries& entries, size_t n_features)
+: m_n_rows(entries.size()), m_offsets(n_features + 1, 0) {
+		RELEASE_ASSERT(entries.size() <= Limits<u32>::max());
+		// count, then place each cell right after those of its column
+		for (auto& e : entries) {
+				for (auto& f : e->features) {
+						if (f.id < n_features) ++m_offsets[f.id + 1];
+				}
+		}
+		for (size_t j = 0; j < n_features; ++j) {
+				m_offsets[j + 1] += m_offsets[j];
+		}
+		m_rows.resize(m_offsets.back());
+		m_values.resize(m_offsets.back());
+		std::vector<size_t> next(m_offsets.begin(), m_offsets.end() - 1);
+		for (size_t r = 0; r < entries.size(); ++r) {
+				for (auto& f : entries[r]->features) {
+						if (f.id >= n_features) continue;
+						size_t cell = next[f.id]++;
+						m_rows[cell] = r;
+						m_values[cell] = f.value;
+				}
+		}
+}
+
+NAMESPACE_END
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "entry.h"
+
+NAMESPACE_BEGIN
+
+// samples transposed into compressed sparse columns (CSC): for each feature,
+// rows, i.e. indices of samples, it occurs in along with its values there,
+// so that solvers may go through data a feature at a time.
+class FeatureColumns {
+	public:
+		FeatureColumns() = default;
+		// features of ids not less than n_features are left out.
+		FeatureColumns(const Entries& entries, size_t n_features);
+
+		size_t n_rows() const { return m_n_rows; }
+		size_t n_features() const { return m_offsets.size() - 1; }
+		size_t nnz() const { return m_rows.size(); }
+
+		// cells of feature j are in [begin(j), end(j))
+		size_t begin(size_t j) const { return m_offsets[j]; }
+		size_t end(size_t j) const { return m_offsets[j + 1]; }
+		u32 row(size_t cell) const { return m_rows[cell]; }
+		real_t value(size_t cell) const { return m_values[cell]; }
+
+	private:
+		size_t m_n_rows = 0;
+		std::vector<size_t> m_offsets{0};
+		std::vector<u32> m_rows;
+		std::vector<real_t> m_values;
+};
+
+NAMESPACE_END
@@ -1,7 +1,12 @@
 #include "sampler.h"
+#include "block_file.h"
 
+#include "base/profiler.h"
 #include "base/random.h"
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 NAMESPACE_BEGIN
 
@@ -35,9 +40,6 @@ class InMemorySampler : public Sampler {
 				auto end = m_data->entries().end();
 				if (static_cast<size_t>(end - begin) > n) end = begin + n;
 				m_offset += end - begin;
-				for (auto it = begin; it != end; ++it) {
-						(*it)->set_normalize(normalize());
-				}
 				std::copy(begin, end, std::back_inserter(samples));
 				return end - begin;
 		}
@@ -77,14 +79,207 @@ class CompositeSampler : public Sampler {
 								++m_index;
 						}
 				}
-				auto sz = samples.size();
-				for (size_t i = sz - 1; i >= sz - n_newly_sampled; --i) {
-						samples[i]->set_normalize(normalize());
-				}
 				return n_newly_sampled;
 		}
 };
 
+class BlockSampler : public Sampler {
+	public:
+		BlockSampler(std::shared_ptr<BlockFile> file, bool normalize)
+		: m_file(std::move(file)), m_normalize(normalize) {
+				for (size_t i = 0; i < m_file->n_blocks(); ++i) {
+						m_order.push_back(i);
+				}
+		}
+
+		void restart() override {
+				m_index = 0;
+				m_block.clear();
+				m_offset = 0;
+		}
+		void shuffle() override {
+				std::shuffle(m_order.begin() + m_index, m_order.end(),
+							 random_generator());
+		}
+
+	protected:
+		std::shared_ptr<BlockFile> m_file;
+		bool m_normalize;
+		std::vector<size_t> m_order;
+		size_t m_index = 0; // next block to decode
+		Entries m_block;    // decoded and not yet fully sampled
+		size_t m_offset = 0;
+
+		size_t get_samples(size_t n, Entries& samples) override {
+				size_t n_sampled = 0;
+				while (n_sampled < n) {
+						if (m_offset == m_block.size()) {
+								if (m_index == m_order.size()) break;
+								m_block.clear();
+								m_offset = 0;
+								m_file->read_block(m_order[m_index++], m_block);
+								for (auto& e : m_block) {
+										e->sort_features();
+										if (m_normalize) e->normalize();
+								}
+								continue;
+						}
+						size_t m = std::min(n - n_sampled,
+											m_block.size() - m_offset);
+						auto begin = m_block.begin() + m_offset;
+						samples.insert(samples.end(), begin, begin + m);
+						m_offset += m;
+						n_sampled += m;
+				}
+				return n_sampled;
+		}
+};
+
+class DownSampler : public Sampler {
+	public:
+		DownSampler(std::shared_ptr<Sampler> sampler, real_t negative_rate)
+		: m_sampler(std::move(sampler)),
+		  m_keep(negative_rate),
+		  m_generator(random_generator()()) {}
+
+		void shuffle() override { m_sampler->shuffle(); }
+		void restart() override { m_sampler->restart(); }
+
+	protected:
+		std::shared_ptr<Sampler> m_sampler;
+		std::bernoulli_distribution m_keep;
+		// own generator, as it may run on a prefetching thread
+		std::mt19937 m_generator;
+		Entries m_buffer;
+
+		size_t get_samples(size_t n, Entries& samples) override {
+				size_t n_kept = 0;
+				while (n_kept < n) {
+						m_buffer.clear();
+						if (!m_sampler->get_samples(n - n_kept, m_buffer))
+								break;
+						for (auto& e : m_buffer) {
+								if (e->label > 0 || m_keep(m_generator)) {
+										samples.push_back(std::move(e));
+										++n_kept;
+								}
+						}
+				}
+				return n_kept;
+		}
+};
+
+class PrefetchSampler : public Sampler {
+	public:
+		PrefetchSampler(std::shared_ptr<Sampler> sampler, size_t depth)
+		: m_sampler(std::move(sampler)), m_ring(depth) {
+				ASSERT(depth > 0);
+		}
+		~PrefetchSampler() override { stop(); }
+
+		void shuffle() override {
+				stop();
+				m_sampler->shuffle();
+		}
+		void restart() override {
+				stop();
+				m_sampler->restart();
+		}
+
+	protected:
+		std::shared_ptr<Sampler> m_sampler;
+		// ring buffer of batches; vectors are swapped in and out of it so that
+		// their storage is reused
+		std::vector<Entries> m_ring;
+		size_t m_head = 0; // # batches consumed
+		size_t m_tail = 0; // # batches produced
+		bool m_done = false;
+		bool m_stop = false;
+		std::exception_ptr m_error;
+		size_t m_batch_size = 0;
+		std::thread m_producer;
+		std::mutex m_mutex;
+		std::condition_variable m_produced;
+		std::condition_variable m_consumed;
+
+		size_t get_samples(size_t n, Entries& samples) override {
+				if (!m_producer.joinable() && !m_done) {
+						m_batch_size = n;
+						m_producer = std::thread([this]() { produce(); });
+				}
+				ASSERT(n == m_batch_size);
+				std::unique_lock lock(m_mutex);
+				m_produced.wait(lock, [this]() {
+						return m_head != m_tail || m_done;
+				});
+				if (m_head == m_tail) {
+						if (m_error) std::rethrow_exception(m_error);
+						return 0;
+				}
+				auto& batch = m_ring[m_head++ % m_ring.size()];
+				size_t n_sampled = batch.size();
+				if (samples.empty()) {
+						std::swap(samples, batch);
+				} else {
+						samples.insert(samples.end(), batch.begin(),
+									   batch.end());
+				}
+				batch.clear();
+				lock.unlock();
+				m_consumed.notify_one();
+				return n_sampled;
+		}
+
+		void produce() {
+				profiler::set_thread_name("prefetch");
+				Entries batch;
+				try {
+						while (true) {
+								{
+										PROFILE_SCOPE(Sample);
+										m_sampler->get_samples(m_batch_size,
+															   batch);
+								}
+								std::unique_lock lock(m_mutex);
+								m_consumed.wait(lock, [this]() {
+										return m_stop
+											|| m_tail - m_head < m_ring.size();
+								});
+								if (m_stop) return;
+								if (batch.empty()) break;
+								auto& slot = m_ring[m_tail++ % m_ring.size()];
+								std::swap(batch, slot);
+								lock.unlock();
+								m_produced.notify_one();
+						}
+				} catch (...) {
+						std::unique_lock lock(m_mutex);
+						m_error = std::current_exception();
+				}
+				{
+						std::unique_lock lock(m_mutex);
+						m_done = true;
+				}
+				m_produced.notify_one();
+		}
+
+		// stop producer and discard batches prefetched
+		void stop() {
+				{
+						std::unique_lock lock(m_mutex);
+						m_stop = true;
+				}
+				m_consumed.notify_one();
+				if (m_producer.joinable()) m_producer.join();
+				for (auto& batch : m_ring) {
+						batch.clear();
+				}
+				m_head = m_tail = 0;
+				m_done = m_stop = false;
+				m_error = nullptr;
+		}
+};
+
 std::shared_ptr<Sampler> Sampler::create(std::shared_ptr<DataSet> data) {
 		return std::make_shared<InMemorySampler>(std::move(data));
 }
@@ -92,5 +287,19 @@ std::shared_ptr<Sampler>
 Sampler::create(std::vector<std::shared_ptr<Sampler>> sampler) {
 		return std::make_shared<CompositeSampler>(std::move(sampler));
 }
+std::shared_ptr<Sampler> Sampler::create(std::shared_ptr<BlockFile> file,
+										 bool normalize) {
+		return std::make_shared<BlockSampler>(std::move(file), normalize);
+}
+std::shared_ptr<Sampler> Sampler::prefetch(std::shared_ptr<Sampler> sampler,
+										   size_t depth) {
+		return std::make_shared<PrefetchSampler>(std::move(sampler), depth);
+}
+std::shared_ptr<Sampler> Sampler::downsample(std::shared_ptr<Sampler> sampler,
+											 real_t negative_rate) {
+		RELEASE_ASSERT(negative_rate > 0 && negative_rate <= 1);
+		return std::make_shared<DownSampler>(std::move(sampler),
+											 negative_rate);
+}
 
 NAMESPACE_END
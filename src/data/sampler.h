@@ -4,6 +4,8 @@
 
 NAMESPACE_BEGIN
 
+class BlockFile;
+
 // data sampler (from disk or memory).
 // NOTE: data entry already sampled won't be returned again unless sampler is restarted.
 class Sampler {
@@ -13,6 +15,22 @@ class Sampler {
 		// create a sampler that samples from a series of other samplers.
 		static std::shared_ptr<Sampler>
 		create(std::vector<std::shared_ptr<Sampler>> sampler);
+		// create a sampler that decodes blocks of given file one at a time,
+		// so that data is never wholly in memory; shuffling only shuffles
+		// the order of blocks.
+		static std::shared_ptr<Sampler> create(std::shared_ptr<BlockFile> file,
+											   bool normalize);
+		// create a sampler that runs given sampler on a producer thread, so
+		// that up to `depth` batches ahead are fetched while the
+		// current one is being consumed. batches are of the size first asked.
+		static std::shared_ptr<Sampler>
+		prefetch(std::shared_ptr<Sampler> sampler, size_t depth);
+		// create a sampler that keeps each negative sample, i.e. of label not
+		// above 0, of given sampler with given probability, drawn anew on
+		// every pass; positive samples are all kept.
+		static std::shared_ptr<Sampler>
+		downsample(std::shared_ptr<Sampler> sampler, real_t negative_rate);
+		virtual ~Sampler() = default;
 
 		// get (at most) n samples into given entries.
 		// return actual # samples sampled.
@@ -24,12 +42,6 @@ class Sampler {
 
 		// make reader to sample from the very beginning of data
 		virtual void restart() = 0;
-
-		void set_normalize(bool b) { m_normalize = b; }
-		bool normalize() const { return m_normalize; }
-
-	protected:
-		bool m_normalize = false; // compute norm feature vector
 };
 
 NAMESPACE_END
@@ -0,0 +1,120 @@
+#include "application_impl.h"
+#include "base/logger.h"
+#include "data/sampler.h"
+
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+
+NAMESPACE_BEGIN
+
+real_t Application_impl::train_epoch(int epoch,
+									 Optimizer& optimizer,
+									 Sampler& train) {
+		optimizer.set_epoch(epoch);
+		if (param_server) return param_server->run_epoch(epoch);
+		// ALS goes over all samples a feature at a time; order is of no use
+		if (auto als = dynamic_cast<ALS*>(&optimizer))
+				return als->train_epoch(*model, train, *thread_pool);
+		train.restart();
+		train.shuffle();
+		return model->update(loss, optimizer, train, *thread_pool, batch_size);
+}
+
+void Application_impl::start_workers(Optimizer& optimizer, Sampler& train) {
+		if (ps_socket.empty())
+				ps_socket = fmt::format("/tmp/zlearn-ps-{}.sock", getpid());
+		auto listener = Socket::listen(ps_socket.c_str(), n_workers);
+		logger::info("starting {} workers; parameter server at {}", n_workers,
+					 ps_socket.c_str());
+
+		// workers are forked after initialization so that they start with
+		// exactly the same parameters as the master.
+		// threads don't survive fork, so the sampler must not be prefetching
+		train.restart();
+		for (int rank = 0; rank < n_workers; ++rank) {
+				int pid = fork();
+				if (pid < 0) THROW("failed to fork worker %d", rank);
+				if (pid == 0) {
+						listener.close();
+						run_worker(rank, optimizer, train);
+				}
+				worker_pids.push_back(pid);
+		}
+
+		std::vector<Socket> workers;
+		for (int i = 0; i < n_workers; ++i) {
+				workers.push_back(listener.accept());
+		}
+		listener.close();
+		::unlink(ps_socket.c_str());
+		param_server = std::make_unique<ParameterServer>(
+			*model, std::move(workers), staleness);
+}
+
+void Application_impl::run_worker(int rank,
+								  Optimizer& optimizer,
+								  Sampler& train) {
+		int status = 0;
+		try {
+				profiler::set_thread_name(
+					String::printf("worker-process-%d", rank).c_str());
+				// threads of parent's pool don't exist in forked process
+				int n_threads = std::max<int>(
+					1, thread_pool->size() / n_workers);
+				ThreadPool pool(n_threads);
+
+				Entries all, shard;
+				train.restart();
+				train.get_samples(-1, all);
+				for (size_t i = rank; i < all.size(); i += n_workers) {
+						shard.push_back(all[i]);
+				}
+				auto data = std::make_shared<DataSet>(std::move(shard), true);
+				auto sampler = Sampler::create(data);
+				if (prefetch) sampler = Sampler::prefetch(sampler, prefetch);
+
+				ParameterClient client(*model, Socket::connect(ps_socket.c_str()));
+				logger::info("worker {} started with {} threads, {} samples",
+							 rank, n_threads, data->size());
+				auto sync = [&](Entries& batch) { client.sync(batch); };
+				while (int epoch = client.wait_epoch()) {
+						optimizer.set_epoch(epoch);
+						sampler->restart();
+						sampler->shuffle();
+						auto loss_mean = model->update(loss, optimizer, *sampler,
+													   pool, sync_every, sync);
+						client.end_epoch(loss_mean * data->size(),
+										 data->size());
+				}
+				pool.stop();
+		} catch (const std::exception& e) {
+				logger::error("worker {}: {}", rank, e.what());
+				status = 1;
+		}
+		logger::console->flush();
+		// skip destructors of objects shared with parent
+		_exit(status);
+}
+
+void Application_impl::stop_workers() {
+		if (worker_pids.empty()) return;
+		try {
+				if (param_server) param_server->stop();
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				for (auto pid : worker_pids) {
+						kill(pid, SIGTERM);
+				}
+		}
+		for (auto pid : worker_pids) {
+				int status;
+				waitpid(pid, &status, 0);
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+						logger::warn("worker process {} exited abnormally", pid);
+		}
+		worker_pids.clear();
+		param_server.reset();
+}
+
+NAMESPACE_END
@@ -1,8 +1,12 @@
 #include "ffm.h"
 #include "base/logger.h"
+#include "base/profiler.h"
 #include "base/random.h"
 #include "data/sampler.h"
 
+#include <algorithm>
+#include <utility>
+
 NAMESPACE_BEGIN
 
 void FFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
@@ -15,6 +19,8 @@ void FFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
 				b[i] = extra[i - 1];
 		}
 
+		if (sparse) zero_block.setZero(k * (1 + n_extras));
+
 		Entries entries;
 		size_t max_feature_id = 0;
 		size_t max_field_id = 0;
@@ -23,63 +29,237 @@ void FFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
 					std::max(max_feature_id, DataSet::max_feature_id(entries));
 				max_field_id =
 					std::max(max_field_id, DataSet::max_field_id(entries));
+				// allocate ahead so that training seldom does
+				if (sparse) allocate_pairs(entries);
 				entries.clear();
 		}
 		check_feature_id(max_feature_id);
 		check_field_id(max_field_id);
 
-		logger::info("FFM initialized; "
-					 "{} features, {} fields, k={}",
-					 n, n_f, k);
+		if (!field_pairs.empty()) {
+				logger::info("{} of {} pairs of fields interact",
+							 field_pairs.count(n_f), n_f * (n_f + 1) / 2);
+		}
+		if (sparse) {
+				logger::info("FFM initialized; "
+							 "{} features, {} fields, {} pairs observed, k={}",
+							 n, n_f, n_blocks, k);
+		} else {
+				logger::info("FFM initialized; "
+							 "{} features, {} fields, k={}",
+							 n, n_f, k);
+		}
+}
+
+void FFM::grow(const Entries& entries) {
+		Model::grow(entries);
+		if (sparse) allocate_pairs(entries);
+}
+void FFM::allocate_pairs(const Entries& entries) {
+		for (auto& e : entries) {
+				for (auto& f1 : e->features) {
+						for (auto& f2 : e->features) {
+								if (&f1 == &f2) continue;
+								if (!field_pairs(f1.field_id, f2.field_id))
+										continue;
+								block(f1.id, f2.field_id);
+						}
+				}
+		}
+}
+
+real_t* FFM::block(index_t feature_id, index_t field_id) {
+		if (!sparse) {
+				ASSERT(field_id < n_f && field_slot[field_id] != no_slot);
+				return v.data() + feature_id * v.cols()
+					+ field_slot[field_id] * k * (1 + m_extras.size());
+		}
+		auto [it, inserted] =
+			block_index.try_emplace(block_key(feature_id, field_id), n_blocks);
+		if (inserted) {
+				PROFILE_SCOPE(Grow);
+				if (n_blocks == chunks.size() * chunk_size) {
+						chunks.emplace_back(chunk_size, k * (1 + m_extras.size()));
+						place(chunks.back());
+				}
+				init_block(sparse_block(n_blocks));
+				++n_blocks;
+		}
+		return sparse_block(it->second);
+}
+const real_t* FFM::block(index_t feature_id, index_t field_id) const {
+		if (!sparse) {
+				ASSERT(field_id < n_f && field_slot[field_id] != no_slot);
+				return v.data() + feature_id * v.cols()
+					+ field_slot[field_id] * k * (1 + m_extras.size());
+		}
+		auto it = block_index.find(block_key(feature_id, field_id));
+		if (it == block_index.end()) return zero_block.data();
+		return sparse_block(it->second);
+}
+
+std::vector<u64> FFM::sorted_block_keys() const {
+		std::vector<u64> ret;
+		ret.reserve(block_index.size());
+		for (auto& pair : block_index) {
+				ret.push_back(pair.first);
+		}
+		std::sort(ret.begin(), ret.end());
+		return ret;
+}
+
+void FFM::init_block(real_t* block) {
+		size_t n_extras = m_extras.size();
+		auto& G = random_generator();
+		std::uniform_real_distribution<real_t> dist(0.0, 0.66 / std::sqrt(k));
+		for (size_t c = 0; c < k; ++c) {
+				block[c] = dist(G);
+		}
+		for (size_t i = 1; i <= n_extras; ++i) {
+				std::fill_n(block + i * k, k, m_extras[i - 1]);
+		}
+}
+
+bool FFM::aggregated(const Entry& entry) const {
+		switch (engine) {
+		case Engine::Pairwise: return false;
+		case Engine::Aggregated: return true;
+		case Engine::Auto: break;
+		}
+		size_t d = entry.features.size();
+		if (d < 3) return false;
+		thread_local std::vector<u32> fields;
+		fields.clear();
+		for (auto& f : entry.features) {
+				if (f.id < n && f.field_id < n_f) fields.push_back(f.field_id);
+		}
+		std::sort(fields.begin(), fields.end());
+		size_t m = std::unique(fields.begin(), fields.end()) - fields.begin();
+		// # k-vector operations of either way
+		return d * m + m * (m + 1) / 2 + d < d * (d - 1) / 2;
+}
+
+FFM::FieldSums& FFM::field_sums() {
+		thread_local FieldSums sums;
+		return sums;
+}
+
+void FFM::sum_by_field(const Entry& entry, FieldSums& sums) const {
+		const auto& features = entry.features;
+		auto& fields = sums.fields;
+		fields.clear();
+		// features unknown to model, of new ids or fields, are skipped
+		for (auto& f : features) {
+				if (f.id < n && f.field_id < n_f) fields.push_back(f.field_id);
+		}
+		std::sort(fields.begin(), fields.end());
+		fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+		size_t m = fields.size();
+		sums.count.assign(m, 0);
+		sums.slot.resize(features.size());
+		sums.S.setZero(m * m, k);
+		for (size_t i = 0; i < features.size(); ++i) {
+				auto& x = features[i];
+				if (x.id >= n || x.field_id >= n_f) {
+						sums.slot[i] = no_slot;
+						continue;
+				}
+				size_t a = std::lower_bound(fields.begin(), fields.end(),
+											x.field_id)
+					- fields.begin();
+				sums.slot[i] = a;
+				sums.count[a]++;
+				for (size_t b = 0; b < m; ++b) {
+						if (!field_pairs(fields[a], fields[b])) continue;
+						sums.S.row(a * m + b) +=
+							x.value * get_v(x.id, fields[b]);
+				}
+		}
+}
+
+real_t FFM::aggregated_interactions(const Entry& entry) const {
+		auto& sums = field_sums();
+		sum_by_field(entry, sums);
+		size_t m = sums.fields.size();
+		real_t y = 0;
+		for (size_t a = 0; a < m; ++a) {
+				for (size_t b = a + 1; b < m; ++b) {
+						y += sums.S.row(a * m + b).dot(sums.S.row(b * m + a));
+				}
+				y += sums.S.row(a * m + a).squaredNorm() / 2;
+		}
+		// pairs of a feature with itself are not interactions
+		for (size_t i = 0; i < entry.features.size(); ++i) {
+				auto& x = entry.features[i];
+				if (sums.slot[i] == no_slot) continue;
+				auto field = sums.fields[sums.slot[i]];
+				if (!field_pairs(field, field)) continue;
+				auto v = get_v(x.id, field);
+				y -= x.value * x.value * v.squaredNorm() / 2;
+		}
+		return y;
 }
 
 real_t FFM::predict(Entry& entry) {
 		const auto& features = entry.features;
-		real_t inv_norm2 = entry.get_inv_norm2();
-		real_t inv_norm = std::sqrt(inv_norm2);
 
-		real_t y_l = 0;      // linear part
-		Vector<Dynamic> y_v; // latent part
+		// linear part
+		real_t y_l = sparse_dot(w.data(), w.cols(), n, features);
+		if (aggregated(entry)) {
+				return aggregated_interactions(entry) + y_l + b.coeff(0);
+		}
+
+		// latent part; kept across calls, as predicting never allocates
+		thread_local Vector<Dynamic> latent;
+		auto& y_v = latent;
 		y_v.setZero(k);
 		for (auto it1 = features.begin(); it1 != features.end(); ++it1) {
 				auto& f1 = *it1;
-				if (f1.id >= n) continue;
-				y_l += w.row(f1.id).coeff(0) * f1.value;
+				if (f1.id >= n || f1.field_id >= n_f) continue;
 				for (auto it2 = it1 + 1; it2 != features.end(); ++it2) {
 						auto& f2 = *it2;
-						if (f2.id >= n) continue;
-						auto v_i_fj = get_v(f1.id, f2.field_id);
-						auto v_j_fi = get_v(f2.id, f1.field_id);
+						if (f2.id >= n || f2.field_id >= n_f) continue;
+						if (!field_pairs(f1.field_id, f2.field_id)) continue;
+						// never allocate when merely predicting
+						auto v_i_fj = std::as_const(*this).get_v(f1.id, f2.field_id);
+						auto v_j_fi = std::as_const(*this).get_v(f2.id, f1.field_id);
 						y_v +=
 							f1.value * f2.value * v_i_fj.cwiseProduct(v_j_fi);
 				}
 		}
-		return inv_norm2 * y_v.sum() + inv_norm * y_l + b.coeff(0);
+		return y_v.sum() + y_l + b.coeff(0);
 }
 
 void FFM::check_feature_id(size_t id) {
 		if (id < n) return;
+		PROFILE_SCOPE(Grow);
 		size_t n_extras = m_extras.size();
 
 		w.conservativeResize(id + 1, 1 + n_extras);
+		place(w);
 		auto W = w.bottomRows(id + 1 - n);
 		W.col(0).fill(0);
 		for (size_t i = 1; i <= n_extras; ++i) {
 				W.col(i).fill(m_extras[i - 1]);
 		}
+		if (sparse) {
+				n = id + 1;
+				return;
+		}
 
-		v.conservativeResize(id + 1, k * (1 + n_extras) * n_f);
+		v.conservativeResize(id + 1, k * (1 + n_extras) * n_slots);
+		place(v);
 		auto V = v.bottomRows(id + 1 - n);
 		auto G = random_generator();
 		std::uniform_real_distribution<real_t> dist(0.0, 0.66 / std::sqrt(k));
 		for (index_t r = 0; r < V.rows(); ++r) {
-				for (size_t f = 0; f < n_f; ++f) {
+				for (size_t f = 0; f < n_slots; ++f) {
 						for (index_t c = 0; c < k; ++c) {
-								V(f * k * (1 + n_extras), c) = dist(G);
+								V(r, f * k * (1 + n_extras) + c) = dist(G);
 						}
 				}
 		}
-		for (size_t f = 0; f < n_f; ++f) {
+		for (size_t f = 0; f < n_slots; ++f) {
 				for (size_t i = 1; i <= n_extras; ++i) {
 						V.middleCols(f * k * (1 + n_extras) + i * k, k)
 							.fill(m_extras[i - 1]);
@@ -89,19 +269,27 @@ void FFM::check_feature_id(size_t id) {
 }
 void FFM::check_field_id(size_t id) {
 		if (id < n_f) return;
+		size_t old_slots = n_slots;
+		assign_slots(id + 1);
+		if (sparse || n_slots == old_slots) {
+				n_f = id + 1;
+				return;
+		}
+		PROFILE_SCOPE(Grow);
 		size_t n_extras = m_extras.size();
 
-		v.conservativeResize(n, k * (1 + n_extras) * (id + 1));
+		v.conservativeResize(n, k * (1 + n_extras) * n_slots);
+		place(v);
 		auto G = random_generator();
 		std::uniform_real_distribution<real_t> dist(0.0, 0.66 / std::sqrt(k));
 		for (index_t r = 0; r < v.rows(); ++r) {
-				for (size_t f = n_f; f <= id; ++f) {
+				for (size_t f = old_slots; f < n_slots; ++f) {
 						for (index_t c = 0; c < k; ++c) {
 								v(r, f * k * (1 + n_extras) + c) = dist(G);
 						}
 				}
 		}
-		for (size_t f = n_f; f <= id; ++f) {
+		for (size_t f = old_slots; f < n_slots; ++f) {
 				for (size_t i = 1; i <= n_extras; ++i) {
 						v.middleCols(f * k * (1 + n_extras) + i * k, k)
 							.fill(m_extras[i - 1]);
@@ -110,5 +298,25 @@ void FFM::check_field_id(size_t id) {
 
 		n_f = id + 1;
 }
+void FFM::assign_slots(size_t n_fields) {
+		for (size_t f = field_slot.size(); f < n_fields; ++f) {
+				field_slot.push_back(field_pairs.referenced(f) ? n_slots++
+															   : no_slot);
+		}
+}
+
+void FFM::reset_extras(std::vector<real_t> extras) {
+		relayout_extras(b, 1, m_extras.size(), extras);
+		relayout_extras(w, 1, m_extras.size(), extras);
+		if (sparse) {
+				for (auto& chunk : chunks) {
+						relayout_extras(chunk, k, m_extras.size(), extras);
+				}
+				zero_block.setZero(k * (1 + extras.size()));
+		} else {
+				relayout_extras(v, k, m_extras.size(), extras);
+		}
+		m_extras = std::move(extras);
+}
 
 NAMESPACE_END
@@ -1,18 +1,28 @@
 #pragma once
 
 #include "base/algebra.h"
+#include "field_pairs.h"
 #include "model.h"
 #include "optimizer/optimizer.h"
 
+#include <deque>
+#include <tsl/robin_map.h>
+
 NAMESPACE_BEGIN
 
 class FFM : public Model {
 	public:
-		FFM(size_t k) : k(k) {}
+		FFM(size_t k, bool sparse = false) : k(k), sparse(sparse) {}
 
 		size_t k;       // # latent factors
 		size_t n = 0;   // # features
 		size_t n_f = 0; // # fields
+		// only allocate latent vectors for observed (feature, field) pairs
+		bool sparse;
+		// only features of these pairs of fields interact; latent vectors
+		// w.r.t. fields that interact with none are not even allocated.
+		// NOTE: set before initialize(); saved with model.
+		FieldPairs field_pairs;
 
 		// given feature vector, x, of size n:
 		// y= ∑(v_i_fj * v_j_fi) x_i x_j + L, i=1,...,n; j=i+1,...,n
@@ -21,61 +31,197 @@ class FFM : public Model {
 		Vector<Dynamic> b;
 		Matrix<Dynamic, Dynamic> w;
 		Matrix<Dynamic, Dynamic> v;
-		// layout of v_i for i=1,...,n:
-		// size=(n, k*(1+n_extra)*n_f)
+		// layout of v_i for i=1,...,n, with a slot for each field referenced
+		// by field_pairs, fn being the last one:
+		// size=(n, k*(1+n_extra)*n_slots)
 		//  <-  k -> <-  k  ->     <-  k  ->       <-  k -> <-  k  ->     <-  k  ->
 		// |--------|---------|---|---------|-----|--------|---------|---|---------|
 		// | v_i_f0 | ex_1_f0 |...| ex_n_f0 | ... | v_i_fn | ex_1_fn |...| ex_n_fn |
 		// |--------|---------|---|---------|-----|--------|---------|---|---------|
+		// when sparse, v is empty and each observed pair owns a block, i.e. a
+		// row of chunks, which never moves once allocated:
+		// size=(chunk_size, k*(1+n_extra)) for each chunk
+		//  <-  k  -> <-  k  ->     <-  k  ->
+		// |---------|---------|---|---------|
+		// | v_i_fj  | ex_1_fj |...| ex_n_fj |
+		// |---------|---------|---|---------|
+		// number of block of pair (i, fj) is looked up from block_index.
+		static constexpr index_t chunk_size = 4096;
+		std::deque<Matrix<Dynamic, Dynamic>> chunks;
+		size_t n_blocks = 0; // # blocks in use; the rest is reserved
+		tsl::robin_map<u64, index_t> block_index;
+
+		// how interactions of a sample of d features in m fields are done:
+		// - Pairwise: over all pairs of features, in O(d^2*k);
+		// - Aggregated: by sums of latent vectors over features of each
+		//   field, S_f_g = ∑ v_i_g x_i for i in field f, so that
+		//   y = ∑ S_f_g * S_g_f (f<g) + ∑ (|S_f_f|^2 - ∑ |v_i_f x_i|^2) / 2,
+		//   in O(d*m*k + m^2*k); it pays off when fields hold many features
+		//   each, e.g. bags of words.
+		// Auto takes the cheaper one for each sample.
+		enum class Engine {
+				Auto,
+				Pairwise,
+				Aggregated,
+		};
+		Engine engine = Engine::Auto;
+		// whether interactions of given sample are aggregated by field
+		bool aggregated(const Entry& entry) const;
+		// call f(feature id, field id, g) for every latent vector v_i_fj
+		// that interactions of given sample depend on, with g being the
+		// gradient of them w.r.t. it multiplied by pg, as done by
+		// aggregation; f may modify g in place, e.g. to add regularization.
+		// NOTE: all features must have been checked.
+		template <typename F>
+		void aggregated_gradient(const Entry& entry, real_t pg, F&& f);
+
+		static u64 block_key(index_t feature_id, index_t field_id) {
+				return u64(feature_id) << 32 | u64(field_id);
+		}
 
-		auto get_v(index_t feature_id, index_t field_id, size_t nth_extra = 0) {
-				return v.row(feature_id)
-					.segment(field_id * k * (1 + m_extras.size())
-								 + k * nth_extra,
-							 k);
+		// latent vector of a feature w.r.t. a field; when sparse, the block of
+		// an unobserved pair is allocated on first access.
+		// NOTE: like check_feature_id(), allocation is not thread-safe.
+		Eigen::Map<Vector<Dynamic>> get_v(index_t feature_id,
+										  index_t field_id,
+										  size_t nth_extra = 0) {
+				return Eigen::Map<Vector<Dynamic>>(
+					block(feature_id, field_id) + k * nth_extra, k);
 		}
-		auto get_v(index_t feature_id,
-				   index_t field_id,
-				   size_t nth_extra = 0) const {
-				return v.row(feature_id)
-					.segment(field_id * k * (1 + m_extras.size())
-								 + k * nth_extra,
-							 k);
+		// when sparse, unobserved pairs read as zero vector.
+		Eigen::Map<const Vector<Dynamic>> get_v(index_t feature_id,
+												index_t field_id,
+												size_t nth_extra = 0) const {
+				return Eigen::Map<const Vector<Dynamic>>(
+					block(feature_id, field_id) + k * nth_extra, k);
 		}
 
 		size_t n_parameters() const override {
-				return b.size() + w.size() + v.size();
+				size_t block_size = k * (1 + m_extras.size());
+				return b.size() + w.size() + v.size() + n_blocks * block_size;
+		}
+		size_t n_touched_parameters(size_t nnz) const override {
+				// each pair touches one latent block of both features
+				size_t block = k * (1 + m_extras.size());
+				return b.size() + nnz * w.cols() + nnz * (nnz - 1) * block;
 		}
 
 		void initialize(Sampler& sampler, std::vector<real_t> extra) override;
 		void check_feature_id(size_t id) override;
+		void grow(const Entries& entries) override;
 		void check_field_id(size_t id) override;
 		real_t predict(Entry& entry) override;
 		void serialize_txt(const String& filename) const override;
-		void serialize(const String& filename) const override;
+		void serialize(const String& filename,
+					   bool with_extras = false) const override;
 		void deserialize(const String& filename) override;
 
 		void take_snapshot() override {
 				b_copy = b;
 				w_copy = w;
 				v_copy = v;
+				chunks_copy = chunks;
+				n_blocks_copy = n_blocks;
+				block_index_copy = block_index;
 		}
 		void restore_snapshot() override {
 				b = b_copy;
 				w = w_copy;
 				v = v_copy;
+				chunks = chunks_copy;
+				n_blocks = n_blocks_copy;
+				block_index = block_index_copy;
 		}
 		size_t max_feature_id() override { return n - 1; }
 		virtual size_t max_field_id() override { return n_f - 1; }
 
+		std::vector<ParameterTable> parameter_tables() override {
+				if (sparse) THROW("parameters of sparse FFM are not in tables");
+				return {
+					{b.data(), 1, size_t(b.size()), 1, size_t(b.size()), false},
+					{w.data(), size_t(w.rows()), size_t(w.cols()), 1,
+					 size_t(w.cols()), true},
+					{v.data(), size_t(v.rows()), size_t(v.cols()), k,
+					 k * (1 + m_extras.size()), true},
+				};
+		}
+
 	private:
+		void reset_extras(std::vector<real_t> extras) override;
+
+		// latent vectors of a sample summed by field, see Engine
+		struct FieldSums {
+				std::vector<u32> fields; // distinct fields, in ascending order
+				std::vector<u32> count;  // # features of each field
+				std::vector<u32> slot;   // index of field, or no_slot, of each
+				// row f*m+g is S_f_g with m being # fields
+				Matrix<Dynamic, Dynamic> S;
+		};
+		// per thread, reused by samples
+		static FieldSums& field_sums();
+		void sum_by_field(const Entry& entry, FieldSums& sums) const;
+		real_t aggregated_interactions(const Entry& entry) const;
+
+		void allocate_pairs(const Entries& entries);
+
+		static constexpr u32 no_slot = -1;
+		// slot of each field in v, or no_slot if not referenced
+		std::vector<u32> field_slot;
+		size_t n_slots = 0;
+		// assign slots to fields up to given #
+		void assign_slots(size_t n_fields);
+
 		Vector<Dynamic> b_copy;
 		Matrix<Dynamic, Dynamic> w_copy;
 		Matrix<Dynamic, Dynamic> v_copy;
+		std::deque<Matrix<Dynamic, Dynamic>> chunks_copy;
+		size_t n_blocks_copy = 0;
+		tsl::robin_map<u64, index_t> block_index_copy;
+		// all zero block for unobserved pairs when sparse
+		Vector<Dynamic> zero_block;
 
-		void optimize(Optimizer& optimizer, Entry& entry, real_t pg) override {
-				optimizer.optimize(*this, entry, pg);
+		real_t* sparse_block(index_t i) {
+				return chunks[i / chunk_size].row(i % chunk_size).data();
 		}
+		const real_t* sparse_block(index_t i) const {
+				return chunks[i / chunk_size].row(i % chunk_size).data();
+		}
+		real_t* block(index_t feature_id, index_t field_id);
+		const real_t* block(index_t feature_id, index_t field_id) const;
+		void init_block(real_t* block);
+		// keys of observed pairs, in ascending order
+		std::vector<u64> sorted_block_keys() const;
 };
 
+template <typename F>
+void FFM::aggregated_gradient(const Entry& entry, real_t pg, F&& f) {
+		auto& sums = field_sums();
+		sum_by_field(entry, sums);
+		size_t m = sums.fields.size();
+		Vector<Dynamic> g(k);
+		const auto& features = entry.features;
+		for (size_t i = 0; i < features.size(); ++i) {
+				auto& x = features[i];
+				size_t a = sums.slot[i];
+				if (a == no_slot) continue;
+				for (size_t b = 0; b < m; ++b) {
+						if (!field_pairs(sums.fields[a], sums.fields[b])) {
+								continue;
+						} else if (a != b) {
+								g = sums.S.row(b * m + a);
+						} else if (sums.count[a] > 1) {
+								// excluding the feature itself
+								g = sums.S.row(a * m + a)
+									- x.value
+										* std::as_const(*this).get_v(
+											x.id, sums.fields[a]);
+						} else {
+								continue;
+						}
+						g *= pg * x.value;
+						f(x.id, sums.fields[b], g);
+				}
+		}
+}
+
 NAMESPACE_END
@@ -0,0 +1,128 @@
+#include "field_pairs.h"
+#include "base/io_util.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+constexpr size_t wildcard = -1;
+
+size_t parse_field(const std::string& token, const std::string& pair) {
+		if (token == "*") return wildcard;
+		if (token.empty()
+			|| !std::all_of(token.begin(), token.end(), ::isdigit))
+				THROW("bad field pair '%s'", pair.c_str());
+		return std::stoul(token);
+}
+
+} // namespace
+
+FieldPairs FieldPairs::parse(const std::string& spec) {
+		std::string text = spec;
+		std::replace(text.begin(), text.end(), ',', ' ');
+		std::istringstream tokens(text);
+		std::vector<std::pair<size_t, size_t>> pairs;
+		std::string token;
+		while (tokens >> token) {
+				auto colon = token.find(':');
+				if (colon == std::string::npos)
+						THROW("bad field pair '%s'", token.c_str());
+				pairs.emplace_back(parse_field(token.substr(0, colon), token),
+								   parse_field(token.substr(colon + 1), token));
+		}
+
+		FieldPairs ret;
+		for (auto [f, g] : pairs) {
+				// every field with every other is the same as no mask
+				if (f == wildcard && g == wildcard) return FieldPairs();
+				if (f != wildcard) ret.m_size = std::max(ret.m_size, f + 1);
+				if (g != wildcard) ret.m_size = std::max(ret.m_size, g + 1);
+		}
+		ret.m_masked = true;
+		ret.m_mask.assign(ret.m_size * ret.m_size, 0);
+		ret.m_wild.assign(ret.m_size, 0);
+		for (auto [f, g] : pairs) {
+				if (f == wildcard) std::swap(f, g);
+				if (g != wildcard) {
+						ret.add(f, g);
+						continue;
+				}
+				ret.m_wild[f] = 1;
+				ret.m_any_wild = true;
+				for (size_t h = 0; h < ret.m_size; ++h) {
+						ret.add(f, h);
+				}
+		}
+		return ret;
+}
+
+FieldPairs FieldPairs::load(const std::string& path) {
+		auto file = must_open_file(path, std::ios::in);
+		std::string spec, line;
+		while (std::getline(*file, line)) {
+				spec += line.substr(0, line.find('#'));
+				spec += ' ';
+		}
+		return parse(spec);
+}
+
+FieldPairs FieldPairs::from_spec_or_file(const std::string& spec) {
+		if (filesystem::is_regular_file(spec)) return load(spec);
+		return parse(spec);
+}
+
+void FieldPairs::add(size_t f, size_t g) {
+		m_mask[f * m_size + g] = 1;
+		m_mask[g * m_size + f] = 1;
+}
+
+bool FieldPairs::referenced(size_t g) const {
+		if (!m_masked) return true;
+		if (g >= m_size) return m_any_wild;
+		if (m_wild[g]) return true;
+		auto row = m_mask.begin() + g * m_size;
+		return std::find(row, row + m_size, 1) != row + m_size;
+}
+
+size_t FieldPairs::count(size_t n_fields) const {
+		size_t ret = 0;
+		for (size_t f = 0; f < n_fields; ++f) {
+				for (size_t g = f; g < n_fields; ++g) {
+						ret += (*this)(f, g);
+				}
+		}
+		return ret;
+}
+
+std::string FieldPairs::to_string() const {
+		if (!m_masked) return "";
+		std::string ret;
+		auto append = [&](const std::string& pair) {
+				if (!ret.empty()) ret += ',';
+				ret += pair;
+		};
+		for (size_t f = 0; f < m_size; ++f) {
+				if (m_wild[f]) append(std::to_string(f) + ":*");
+		}
+		for (size_t f = 0; f < m_size; ++f) {
+				for (size_t g = f; g < m_size; ++g) {
+						if (m_wild[f] || m_wild[g] || !m_mask[f * m_size + g])
+								continue;
+						append(std::to_string(f) + ':' + std::to_string(g));
+				}
+		}
+		// nothing interacts at all
+		if (ret.empty()) ret = ",";
+		return ret;
+}
+
+bool FieldPairs::operator==(const FieldPairs& rhs) const {
+		return m_masked == rhs.m_masked && m_size == rhs.m_size
+			&& m_mask == rhs.m_mask && m_wild == rhs.m_wild;
+}
+
+NAMESPACE_END
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "base/common.h"
+
+#include <string>
+#include <vector>
+
+NAMESPACE_BEGIN
+
+// pairs of fields whose features interact in FM and FFM; when empty, all of
+// them do, including features of the same field.
+class FieldPairs {
+	public:
+		FieldPairs() = default;
+
+		// spec is a list of pairs of field ids, e.g. "0:1,0:2,3:3,4:*",
+		// separated by commas or whitespace, where * stands for every field.
+		// lines of a file are read likewise, with # starting a comment.
+		static FieldPairs parse(const std::string& spec);
+		static FieldPairs load(const std::string& path);
+		// spec if it names no file, or the file it names
+		static FieldPairs from_spec_or_file(const std::string& spec);
+
+		bool empty() const { return !m_masked; }
+		// whether features of fields f and g interact
+		bool operator()(size_t f, size_t g) const {
+				if (!m_masked) return true;
+				if (f < m_size && g < m_size) return m_mask[f * m_size + g];
+				if (f < m_size) return m_wild[f];
+				if (g < m_size) return m_wild[g];
+				return false;
+		}
+		// whether latent vectors of features w.r.t. field g are ever used,
+		// i.e. g interacts with any field
+		bool referenced(size_t g) const;
+		// # pairs (f, g), f <= g, among given # fields that interact
+		size_t count(size_t n_fields) const;
+
+		// canonical spec, without whitespace; empty if not masked
+		std::string to_string() const;
+
+		bool operator==(const FieldPairs& rhs) const;
+		bool operator!=(const FieldPairs& rhs) const { return !(*this == rhs); }
+
+	private:
+		bool m_masked = false;
+		size_t m_size = 0;        // fields mentioned are in [0, m_size)
+		std::vector<u8> m_mask;   // m_size x m_size, symmetric
+		std::vector<u8> m_wild;   // fields interacting with every field
+		bool m_any_wild = false;
+
+		void add(size_t f, size_t g);
+};
+
+NAMESPACE_END
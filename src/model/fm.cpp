@@ -1,8 +1,11 @@
 #include "fm.h"
 #include "base/logger.h"
+#include "base/profiler.h"
 #include "base/random.h"
 #include "data/sampler.h"
 
+#include <algorithm>
+
 NAMESPACE_BEGIN
 
 void FM::initialize(Sampler& sampler, std::vector<real_t> extra) {
@@ -32,32 +35,105 @@ void FM::initialize(Sampler& sampler, std::vector<real_t> extra) {
 }
 
 real_t FM::predict(Entry& entry) {
-		real_t inv_norm2 = entry.get_inv_norm2();
-		real_t inv_norm = std::sqrt(inv_norm2);
+		// linear part
+		real_t y_l = sparse_dot(w.data(), w.cols(), n, entry.features);
+		if (!field_pairs.empty()) {
+				auto& P = partner_sums(entry);
+				real_t y_v = 0;
+				for (size_t i = 0; i < entry.features.size(); ++i) {
+						auto& f = entry.features[i];
+						if (f.id >= n) continue;
+						y_v += f.value * v.row(f.id).head(k).dot(P.row(i));
+				}
+				return 0.5 * y_v + y_l + b.coeff(0);
+		}
 
-		real_t y_l = 0; // linear part
-		Vector<Dynamic> s = allocate_s();
-		for (const auto& f : entry.features) {
-				if (f.id >= n) continue;
-				y_l += w.row(f.id).coeff(0) * f.value;
-				s += v.row(f.id).head(k) * f.value;
+		// latent part, with vectors of k fixed-size if possible
+		real_t y_v = with_fixed_size(k, [&](auto size) {
+				constexpr int K = decltype(size)::value;
+				Vector<K> s = Vector<K>::Zero(k);
+				real_t self = 0; // ∑ |v_i x_i|^2
+				for (const auto& f : entry.features) {
+						if (f.id >= n) continue;
+						auto vx = get_v<K>(f.id) * f.value;
+						s += vx;
+						self += vx.squaredNorm();
+				}
+				return s.squaredNorm() - self;
+		});
+		return 0.5 * y_v + y_l + b.coeff(0);
+}
+
+const Matrix<Dynamic, Dynamic>& FM::partner_sums(const Entry& entry) const {
+		thread_local Matrix<Dynamic, Dynamic> P;
+		thread_local Matrix<Dynamic, Dynamic> S; // sum of v_i x_i by field
+		thread_local Matrix<Dynamic, Dynamic> Q; // rows of S interacting
+		thread_local std::vector<u32> fields;
+		const auto& features = entry.features;
+		P.resize(features.size(), k);
+
+		if (field_pairs.empty()) {
+				// all features interact; rows are the sum less each feature
+				with_fixed_size(k, [&](auto size) {
+						constexpr int K = decltype(size)::value;
+						Vector<K> s = Vector<K>::Zero(k);
+						for (auto& f : features) {
+								if (f.id < n) s += get_v<K>(f.id) * f.value;
+						}
+						for (size_t i = 0; i < features.size(); ++i) {
+								auto& f = features[i];
+								auto P_i = P.row(i).head<K>(k);
+								if (f.id < n)
+										P_i = s - get_v<K>(f.id) * f.value;
+								else
+										P_i = s;
+						}
+				});
+				return P;
 		}
 
-		Vector<Dynamic> y_v; // latent part
-		y_v.setZero(k);
-		for (const auto& f : entry.features) {
+		fields.clear();
+		for (auto& f : features) {
+				fields.push_back(f.field_id);
+		}
+		std::sort(fields.begin(), fields.end());
+		fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+		size_t m = fields.size();
+		auto slot = [&](const Feature& f) {
+				return size_t(std::lower_bound(fields.begin(), fields.end(),
+											   f.field_id)
+							  - fields.begin());
+		};
+		S.setZero(m, k);
+		for (auto& f : features) {
 				if (f.id >= n) continue;
-				auto wx = v.row(f.id).head(k) * f.value;
-				y_v += wx.cwiseProduct(s - wx);
+				S.row(slot(f)) += v.row(f.id).head(k) * f.value;
+		}
+		Q.setZero(m, k);
+		for (size_t a = 0; a < m; ++a) {
+				for (size_t b = 0; b < m; ++b) {
+						if (field_pairs(fields[a], fields[b]))
+								Q.row(a) += S.row(b);
+				}
 		}
-		return 0.5 * y_v.sum() * inv_norm2 + y_l * inv_norm + b.coeff(0);
+		for (size_t i = 0; i < features.size(); ++i) {
+				auto& f = features[i];
+				size_t a = slot(f);
+				P.row(i) = Q.row(a);
+				// a feature does not interact with itself
+				if (f.id < n && field_pairs(fields[a], fields[a]))
+						P.row(i) -= v.row(f.id).head(k) * f.value;
+		}
+		return P;
 }
 
 void FM::check_feature_id(size_t id) {
 		if (id < n) return;
+		PROFILE_SCOPE(Grow);
 		size_t n_extras = m_extras.size();
 
 		w.conservativeResize(id + 1, 1 + n_extras);
+		place(w);
 		auto W = w.bottomRows(id + 1 - n);
 		W.col(0).fill(0);
 		for (size_t i = 1; i <= n_extras; ++i) {
@@ -65,6 +141,7 @@ void FM::check_feature_id(size_t id) {
 		}
 
 		v.conservativeResize(id + 1, k * (1 + n_extras));
+		place(v);
 		auto V = v.bottomRows(id + 1 - n);
 		auto G = random_generator();
 		std::uniform_real_distribution<real_t> dist(0.0, 0.66 / std::sqrt(k));
@@ -81,4 +158,11 @@ void FM::check_feature_id(size_t id) {
 }
 void FM::check_field_id(size_t) {}
 
+void FM::reset_extras(std::vector<real_t> extras) {
+		relayout_extras(b, 1, m_extras.size(), extras);
+		relayout_extras(w, 1, m_extras.size(), extras);
+		relayout_extras(v, k, m_extras.size(), extras);
+		m_extras = std::move(extras);
+}
+
 NAMESPACE_END
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base/algebra.h"
+#include "field_pairs.h"
 #include "model.h"
 #include "optimizer/optimizer.h"
 
@@ -15,6 +16,8 @@ class FM : public Model {
 		// given feature vector, x, of size n:
 		// y= ∑(v_i * v_j) x_i * x_j + L, i=1,...,n; j=i+1,...,n
 		// where v_? is of size k; L = w*x+b
+		// only features of these pairs of fields interact; saved with model.
+		FieldPairs field_pairs;
 
 		Vector<Dynamic> b;
 		Matrix<Dynamic, Dynamic> w;
@@ -29,19 +32,33 @@ class FM : public Model {
 		size_t n_parameters() const override {
 				return b.size() + w.size() + v.size();
 		}
+		size_t n_touched_parameters(size_t nnz) const override {
+				return b.size() + nnz * (w.cols() + v.cols());
+		}
 
-		Vector<Dynamic> allocate_s() const {
-				Vector<Dynamic> s;
-				s.setZero(k);
-				return s;
+		// v_i, or its nth extra, as a vector of size K, which is either k
+		// or Dynamic; see with_fixed_size().
+		template <int K = Dynamic>
+		auto get_v(index_t i, size_t nth_extra = 0) {
+				return v.row(i).segment<K>(nth_extra * k, k);
+		}
+		template <int K = Dynamic>
+		auto get_v(index_t i, size_t nth_extra = 0) const {
+				return v.row(i).segment<K>(nth_extra * k, k);
 		}
+		// row i is the sum of v_j x_j over features j of given sample that
+		// interact with its i-th feature, i.e. the gradient of interactions
+		// w.r.t. v_i over x_i. it is per thread and reused by samples.
+		// NOTE: all features must have been checked.
+		const Matrix<Dynamic, Dynamic>& partner_sums(const Entry& entry) const;
 
 		void initialize(Sampler& sampler, std::vector<real_t> extra) override;
 		void check_feature_id(size_t id) override;
 		void check_field_id(size_t id) override;
 		real_t predict(Entry&) override;
 		void serialize_txt(const String& filename) const override;
-		void serialize(const String& filename) const override;
+		void serialize(const String& filename,
+					   bool with_extras = false) const override;
 		void deserialize(const String& filename) override;
 
 		void take_snapshot() override {
@@ -56,14 +73,22 @@ class FM : public Model {
 		}
 		size_t max_feature_id() override { return n - 1; }
 
+		std::vector<ParameterTable> parameter_tables() override {
+				return {
+					{b.data(), 1, size_t(b.size()), 1, size_t(b.size()), false},
+					{w.data(), size_t(w.rows()), size_t(w.cols()), 1,
+					 size_t(w.cols()), true},
+					{v.data(), size_t(v.rows()), size_t(v.cols()), k,
+					 size_t(v.cols()), true},
+				};
+		}
+
 	private:
+		void reset_extras(std::vector<real_t> extras) override;
+
 		Vector<Dynamic> b_copy;
 		Matrix<Dynamic, Dynamic> w_copy;
 		Matrix<Dynamic, Dynamic> v_copy;
-
-		void optimize(Optimizer& optimizer, Entry& entry, real_t pg) override {
-				optimizer.optimize(*this, entry, pg);
-		}
 };
 
 NAMESPACE_END
@@ -0,0 +1,162 @@
+#include "fwfm.h"
+#include "base/logger.h"
+#include "base/profiler.h"
+#include "base/random.h"
+#include "data/sampler.h"
+
+#include <algorithm>
+
+NAMESPACE_BEGIN
+
+void FwFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
+		m_extras = extra;
+		size_t n_extras = m_extras.size();
+
+		b.resize(1 + n_extras);
+		b[0] = 0;
+		for (size_t i = 1; i <= n_extras; ++i) {
+				b[i] = extra[i - 1];
+		}
+
+		Entries entries;
+		size_t max_feature_id = 0;
+		size_t max_field_id = 0;
+		while (sampler.get_samples(-1, entries)) {
+				max_feature_id =
+					std::max(max_feature_id, DataSet::max_feature_id(entries));
+				max_field_id =
+					std::max(max_field_id, DataSet::max_field_id(entries));
+				entries.clear();
+		}
+		check_feature_id(max_feature_id);
+		check_field_id(max_field_id);
+
+		logger::info("FwFM initialized; {} features, {} fields, k={}", n, n_f,
+					 k);
+}
+
+const FwFM::Sums& FwFM::sums(const Entry& entry, bool with_partners) const {
+		thread_local Sums sums;
+		thread_local Matrix<Dynamic, Dynamic> Q; // ∑ r_a_b S_b of each field a
+		const auto& features = entry.features;
+		auto& fields = sums.fields;
+		fields.clear();
+		for (auto& f : features) {
+				if (f.id < n && f.field_id < n_f) fields.push_back(f.field_id);
+		}
+		std::sort(fields.begin(), fields.end());
+		fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+		size_t m = fields.size();
+
+		sums.slot.resize(features.size());
+		sums.S.setZero(m, k);
+		sums.self_norm.assign(m, 0);
+		sums.count.assign(m, 0);
+		for (size_t i = 0; i < features.size(); ++i) {
+				auto& x = features[i];
+				if (x.id >= n || x.field_id >= n_f) {
+						sums.slot[i] = no_slot;
+						continue;
+				}
+				size_t a = std::lower_bound(fields.begin(), fields.end(),
+											x.field_id)
+					- fields.begin();
+				sums.slot[i] = a;
+				sums.count[a]++;
+				auto vx = v.row(x.id).head(k) * x.value;
+				sums.S.row(a) += vx;
+				sums.self_norm[a] += vx.squaredNorm();
+		}
+		if (!with_partners) return sums;
+
+		Q.setZero(m, k);
+		for (size_t a = 0; a < m; ++a) {
+				for (size_t b = 0; b < m; ++b) {
+						real_t r_ab = get_r(fields[a], fields[b]);
+						Q.row(a) += r_ab * sums.S.row(b);
+				}
+		}
+		sums.P.setZero(features.size(), k);
+		for (size_t i = 0; i < features.size(); ++i) {
+				auto& x = features[i];
+				size_t a = sums.slot[i];
+				if (a == no_slot) continue;
+				// a feature does not interact with itself
+				real_t r_aa = get_r(fields[a], fields[a]);
+				sums.P.row(i) =
+					Q.row(a) - r_aa * x.value * v.row(x.id).head(k);
+		}
+		return sums;
+}
+
+real_t FwFM::predict(Entry& entry) {
+		// linear part
+		real_t y_l = sparse_dot(w.data(), w.cols(), n, entry.features);
+
+		real_t y_v = 0; // latent part
+		auto& s = sums(entry, false);
+		field_weight_gradient(s, 1, [&](index_t f, index_t g, real_t dot) {
+				y_v += get_r(f, g) * dot;
+		});
+		return y_v + y_l + b.coeff(0);
+}
+
+void FwFM::check_feature_id(size_t id) {
+		if (id < n) return;
+		PROFILE_SCOPE(Grow);
+		size_t n_extras = m_extras.size();
+
+		w.conservativeResize(id + 1, 1 + n_extras);
+		place(w);
+		auto W = w.bottomRows(id + 1 - n);
+		W.col(0).fill(0);
+		for (size_t i = 1; i <= n_extras; ++i) {
+				W.col(i).fill(m_extras[i - 1]);
+		}
+
+		v.conservativeResize(id + 1, k * (1 + n_extras));
+		place(v);
+		auto V = v.bottomRows(id + 1 - n);
+		auto G = random_generator();
+		std::uniform_real_distribution<real_t> dist(0.0, 0.66 / std::sqrt(k));
+		for (index_t r = 0; r < V.rows(); ++r) {
+				for (size_t c = 0; c < k; ++c) {
+						V(r, c) = dist(G);
+				}
+		}
+		for (size_t i = 1; i <= n_extras; ++i) {
+				V.middleCols(k * i, k).fill(m_extras[i - 1]);
+		}
+
+		n = id + 1;
+}
+void FwFM::check_field_id(size_t id) {
+		if (id < n_f) return;
+		PROFILE_SCOPE(Grow);
+		size_t n_extras = m_extras.size();
+
+		r.conservativeResize(id + 1, (1 + n_extras) * (id + 1));
+		// cells of f > g are unused, yet kept defined
+		r.bottomRows(id + 1 - n_f).setZero();
+		r.rightCols((1 + n_extras) * (id + 1 - n_f)).setZero();
+		// pairs with new fields start as of FM
+		for (size_t f = 0; f <= id; ++f) {
+				for (size_t g = std::max(f, n_f); g <= id; ++g) {
+						get_r(f, g) = 1;
+						for (size_t i = 1; i <= n_extras; ++i) {
+								get_r(f, g, i) = m_extras[i - 1];
+						}
+				}
+		}
+		n_f = id + 1;
+}
+
+void FwFM::reset_extras(std::vector<real_t> extras) {
+		relayout_extras(b, 1, m_extras.size(), extras);
+		relayout_extras(w, 1, m_extras.size(), extras);
+		relayout_extras(v, k, m_extras.size(), extras);
+		relayout_extras(r, 1, m_extras.size(), extras);
+		m_extras = std::move(extras);
+}
+
+NAMESPACE_END
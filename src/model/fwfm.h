@@ -0,0 +1,144 @@
+#pragma once
+
+#include "base/algebra.h"
+#include "model.h"
+#include "optimizer/optimizer.h"
+
+#include <algorithm>
+#include <utility>
+
+NAMESPACE_BEGIN
+
+// field-weighted FM: a latent vector per feature as FM, while each pair of
+// fields has a weight of its interactions, at a fraction of memory of FFM.
+class FwFM : public Model {
+	public:
+		FwFM(size_t k) : k(k) {}
+
+		size_t k;       // # latent factors
+		size_t n = 0;   // # features
+		size_t n_f = 0; // # fields
+		// given feature vector, x, of size n:
+		// y= ∑ r_fi_fj (v_i * v_j) x_i x_j + L, i=1,...,n; j=i+1,...,n
+		// where v_i is of size k; r is symmetric; L = w*x+b
+		// with S_f = ∑ v_i x_i for i in field f, it is computed as
+		// y= ∑ r_f_g (S_f * S_g) (f<g) + ∑ r_f_f (|S_f|^2 - ∑ |v_i x_i|^2) / 2
+		// in O(d*k + m^2*k) for d features in m fields.
+
+		Vector<Dynamic> b;
+		Matrix<Dynamic, Dynamic> w;
+		Matrix<Dynamic, Dynamic> v;
+		// layout of v_i for i=1,...,n:
+		// size=(n, k*(1+n_extra))
+		//  <- k -> <-  k  ->       <-  k  ->
+		// |-------|---------|-----|---------|
+		// |  v_i  | extra_1 | ... | extra_m |
+		// |-------|---------|-----|---------|
+		Matrix<Dynamic, Dynamic> r;
+		// layout of r_f for f=1,...,n_f, of which only r_f_g, f<=g, is used:
+		// size=(n_f, (1+n_extra)*n_f)
+		// |--------|---------|---|---------|-----|--------|---|---------|
+		// | r_f_f0 | ex_1_f0 |...| ex_n_f0 | ... | r_f_fn |...| ex_n_fn |
+		// |--------|---------|---|---------|-----|--------|---|---------|
+
+		real_t& get_r(index_t f, index_t g, size_t nth_extra = 0) {
+				if (f > g) std::swap(f, g);
+				return r.coeffRef(f, g * (1 + m_extras.size()) + nth_extra);
+		}
+		real_t get_r(index_t f, index_t g, size_t nth_extra = 0) const {
+				if (f > g) std::swap(f, g);
+				return r.coeff(f, g * (1 + m_extras.size()) + nth_extra);
+		}
+
+		// latent vectors of a sample summed by field, see above
+		struct Sums {
+				std::vector<u32> fields; // distinct fields, in ascending order
+				std::vector<u32> count; // # features of each field
+				// index of field of each feature; no_slot if it is unknown
+				std::vector<u32> slot;
+				Matrix<Dynamic, Dynamic> S;    // row a is S_fields[a]
+				std::vector<real_t> self_norm; // ∑ |v_i x_i|^2 of each field
+				// row i is ∑ r_fi_fj v_j x_j over other features j, i.e. the
+				// gradient of interactions w.r.t. v_i over x_i
+				Matrix<Dynamic, Dynamic> P;
+		};
+		static constexpr u32 no_slot = -1;
+		// sums of given sample, with P if asked for; per thread and reused
+		// by samples. NOTE: all features must have been checked for P.
+		const Sums& sums(const Entry& entry, bool with_partners) const;
+		// call f(field f, field g, gradient) for every r_f_g, f<=g, that
+		// interactions of sample of given sums depend on, with gradient
+		// w.r.t. it multiplied by pg.
+		template <typename F>
+		void field_weight_gradient(const Sums& sums, real_t pg, F&& f) const;
+
+		size_t n_parameters() const override {
+				return b.size() + w.size() + v.size() + r.size();
+		}
+		size_t n_touched_parameters(size_t nnz) const override {
+				size_t pairs = std::min(nnz * (nnz + 1) / 2, n_f * n_f);
+				return b.size() + nnz * (w.cols() + v.cols())
+					+ pairs * (1 + m_extras.size());
+		}
+
+		void initialize(Sampler& sampler, std::vector<real_t> extra) override;
+		void check_feature_id(size_t id) override;
+		void check_field_id(size_t id) override;
+		real_t predict(Entry&) override;
+		void serialize_txt(const String& filename) const override;
+		void serialize(const String& filename,
+					   bool with_extras = false) const override;
+		void deserialize(const String& filename) override;
+
+		void take_snapshot() override {
+				b_copy = b;
+				w_copy = w;
+				v_copy = v;
+				r_copy = r;
+		}
+		void restore_snapshot() override {
+				b = b_copy;
+				w = w_copy;
+				v = v_copy;
+				r = r_copy;
+		}
+		size_t max_feature_id() override { return n - 1; }
+		size_t max_field_id() override { return n_f - 1; }
+
+		std::vector<ParameterTable> parameter_tables() override {
+				return {
+					{b.data(), 1, size_t(b.size()), 1, size_t(b.size()), false},
+					{w.data(), size_t(w.rows()), size_t(w.cols()), 1,
+					 size_t(w.cols()), true},
+					{v.data(), size_t(v.rows()), size_t(v.cols()), k,
+					 size_t(v.cols()), true},
+					{r.data(), size_t(r.rows()), size_t(r.cols()), 1,
+					 1 + m_extras.size(), false},
+				};
+		}
+
+	private:
+		void reset_extras(std::vector<real_t> extras) override;
+
+		Vector<Dynamic> b_copy;
+		Matrix<Dynamic, Dynamic> w_copy;
+		Matrix<Dynamic, Dynamic> v_copy;
+		Matrix<Dynamic, Dynamic> r_copy;
+};
+
+template <typename F>
+void FwFM::field_weight_gradient(const Sums& sums, real_t pg, F&& f) const {
+		size_t m = sums.fields.size();
+		for (size_t a = 0; a < m; ++a) {
+				auto S_a = sums.S.row(a);
+				for (size_t b = a + 1; b < m; ++b) {
+						f(sums.fields[a], sums.fields[b],
+						  pg * S_a.dot(sums.S.row(b)));
+				}
+				if (sums.count[a] < 2) continue;
+				real_t self = (S_a.squaredNorm() - sums.self_norm[a]) / 2;
+				f(sums.fields[a], sums.fields[a], pg * self);
+		}
+}
+
+NAMESPACE_END
@@ -1,57 +1,86 @@
 #define LOGGER_OSTREAM
 #include "hofm.h"
 #include "base/logger.h"
+#include "base/profiler.h"
 #include "base/random.h"
 
 NAMESPACE_BEGIN
 
-Matrix<Dynamic, Dynamic> HOFM::get_dp_eval(Entry& entry, size_t m) const {
-		auto& features = entry.features;
-		auto end = std::partition(features.begin(), features.end(),
-								  [this](auto& f) { return f.id < n; });
-		size_t d = end - features.begin();
+HOFM::DP& HOFM::scratch() {
+		thread_local DP dp;
+		return dp;
+}
 
-		Matrix<Dynamic, Dynamic> dp;
-		dp.setZero(m + 1, (d + 1) * k);
+HOFM::DP& HOFM::get_dp(const Entry& entry, bool with_grad) const {
+		auto& dp = scratch();
+		const auto& features = entry.features;
+		if (dp.model != this || dp.entry != &entry || dp.n != n) {
+				// collect valid features once for all orders
+				dp.index.clear();
+				for (size_t i = 0; i < features.size(); ++i) {
+						if (features[i].id < n) dp.index.push_back(i);
+				}
+				dp.model = this;
+				dp.entry = &entry;
+				dp.n = n;
+				dp.d = dp.index.size();
+				dp.has_grad = false;
+				dp.a.resize(order - 1);
+				dp.a_adj.resize(order - 1);
+				for (size_t m = 2; m <= order; ++m) {
+						forward(features, dp.index, m, dp.a[m - 2]);
+				}
+		}
+		if (with_grad && !dp.has_grad) {
+				for (size_t m = 2; m <= order; ++m) {
+						backward(features, dp.index, m, dp.a_adj[m - 2]);
+				}
+				dp.has_grad = true;
+		}
+		return dp;
+}
 
-		dp.row(0).setOnes();
+void HOFM::forward(const FeatureVector& features,
+				   const std::vector<size_t>& index,
+				   size_t m,
+				   Matrix<Dynamic, Dynamic>& a) const {
+		size_t d = index.size();
+		a.setZero(m + 1, (d + 1) * k);
+		a.row(0).setOnes();
 		for (size_t t = 1; t <= m; ++t) {
 				for (size_t j = t; j <= d; ++j) {
-						auto& f = features[j - 1];
-						auto a_j_t = dp.row(t).segment(j * k, k);
-						auto a_jm1_t = dp.row(t).segment((j - 1) * k, k);
-						auto a_jm1_tm1 = dp.row(t - 1).segment((j - 1) * k, k);
-						auto p = get_p(m, f.id);
+						auto& f = features[index[j - 1]];
+						auto a_j_t = a.row(t).segment(j * k, k);
+						auto a_jm1_t = a.row(t).segment((j - 1) * k, k);
+						auto a_jm1_tm1 = a.row(t - 1).segment((j - 1) * k, k);
 						a_j_t = a_jm1_t
-							+ a_jm1_tm1.cwiseProduct(p) * f.normalized_value;
+							+ a_jm1_tm1.cwiseProduct(get_p(m, f.id))
+								* f.value;
 				}
 		}
-		return dp;
 }
 
-Matrix<Dynamic, Dynamic> HOFM::get_dp_grad(Entry& entry, size_t m) const {
-		auto& features = entry.features;
-		auto end = std::partition(features.begin(), features.end(),
-								  [this](auto& f) { return f.id < n; });
-		size_t d = end - features.begin();
-
-		Matrix<Dynamic, Dynamic> dp;
+void HOFM::backward(const FeatureVector& features,
+					const std::vector<size_t>& index,
+					size_t m,
+					Matrix<Dynamic, Dynamic>& a_adj) const {
+		size_t d = index.size();
 		// there're k redundant columns for more convenient indexing
-		dp.setZero(m + 1, (d + 1) * k);
-
-		dp.row(m).tail(k).setOnes();
+		a_adj.setZero(m + 1, (d + 1) * k);
+		// kernel of order m depends on each a(m, j) with weight 1
+		if (d >= m) a_adj.row(m).segment(m * k, (d + 1 - m) * k).setOnes();
 		for (int t = m - 1; t >= 0; --t) {
 				for (int j = d - 1; j >= t; --j) {
-						auto& f = features[j]; // NOTE: using x_{j+1}
-						auto a_j_t = dp.row(t).segment(j * k, k);
-						auto a_jp1_t = dp.row(t).segment((j + 1) * k, k);
-						auto a_jp1_tp1 = dp.row(t + 1).segment((j + 1) * k, k);
+						auto& f = features[index[j]]; // NOTE: using x_{j+1}
+						auto a_j_t = a_adj.row(t).segment(j * k, k);
+						auto a_jp1_t = a_adj.row(t).segment((j + 1) * k, k);
+						auto a_jp1_tp1 =
+							a_adj.row(t + 1).segment((j + 1) * k, k);
 						a_j_t = a_jp1_t
 							+ a_jp1_tp1.cwiseProduct(get_p(m, f.id))
-								* f.normalized_value;
+								* f.value;
 				}
 		}
-		return dp;
 }
 
 void HOFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
@@ -85,30 +114,29 @@ void HOFM::initialize(Sampler& sampler, std::vector<real_t> extra) {
 }
 
 real_t HOFM::predict(Entry& entry) {
-		real_t inv_norm2 = entry.get_inv_norm2();
-		real_t inv_norm = std::sqrt(inv_norm2);
 		const auto& features = entry.features;
 
-		real_t y_l = 0; // linear part
-		for (auto& f : features) {
-				if (f.id >= n) continue;
-				y_l += w.row(f.id).coeff(0) * f.value;
-		}
+		// linear part
+		real_t y_l = sparse_dot(w.data(), w.cols(), n, features);
 
 		Vector<Dynamic> y_v; // latent part
 		y_v.setZero(k);
+		// entry may be a new sample at the address of a stale one
+		scratch().invalidate();
+		auto& dp = get_dp(entry, false);
 		for (size_t m = 2; m <= order; ++m) {
-				auto dp = get_dp_eval(entry, m);
-				y_v += dp.row(m).tail(k);
+				y_v += dp.a[m - 2].row(m).tail(k);
 		}
-		return y_v.sum() + inv_norm * y_l + b.coeff(0);
+		return y_v.sum() + y_l + b.coeff(0);
 }
 
 void HOFM::check_feature_id(size_t id) {
 		if (id < n) return;
+		PROFILE_SCOPE(Grow);
 		size_t n_extras = m_extras.size();
 
 		w.conservativeResize(id + 1, 1 + n_extras);
+		place(w);
 		auto W = w.bottomRows(id + 1 - n);
 		W.col(0).fill(0);
 		for (size_t i = 1; i <= n_extras; ++i) {
@@ -117,6 +145,7 @@ void HOFM::check_feature_id(size_t id) {
 
 		for (auto& p : v) {
 				p.conservativeResize(id + 1, k * (1 + n_extras));
+				place(p);
 				auto P = p.bottomRows(id + 1 - n);
 				auto G = random_generator();
 				std::uniform_real_distribution<real_t> dist(
@@ -136,4 +165,13 @@ void HOFM::check_feature_id(size_t id) {
 }
 void HOFM::check_field_id(size_t) {}
 
+void HOFM::reset_extras(std::vector<real_t> extras) {
+		relayout_extras(b, 1, m_extras.size(), extras);
+		relayout_extras(w, 1, m_extras.size(), extras);
+		for (auto& p : v) {
+				relayout_extras(p, k, m_extras.size(), extras);
+		}
+		m_extras = std::move(extras);
+}
+
 NAMESPACE_END
@@ -32,8 +32,33 @@ class HOFM : public Model {
 				return v[m - 2].row(feature_id).segment(nth_extra * k, k);
 		}
 
-		Matrix<Dynamic, Dynamic> get_dp_eval(Entry& entry, size_t m) const;
-		Matrix<Dynamic, Dynamic> get_dp_grad(Entry& entry, size_t m) const;
+		// dynamic programming tables of ANOVA kernels of a sample for all
+		// orders, computed once by predict and reused by optimizers.
+		// for order m, both tables are of size (m+1, (d+1)*k) where the
+		// k-wide block (t, j) of a is the ANOVA kernel of order t over the
+		// first j valid features, and that of a_adj is the derivative of the
+		// kernel of order m w.r.t. block (t, j) of a.
+		// the sample itself is never modified, so that it could be shared
+		// between threads.
+		struct DP {
+				const HOFM* model = nullptr;
+				const Entry* entry = nullptr; // sample the tables are for
+				size_t n = 0;                 // # features of model back then
+				// positions of valid features (id < n) in entry.features;
+				// j-th valid feature is entry.features[index[j - 1]].
+				std::vector<size_t> index;
+				size_t d = 0; // # valid features, i.e. index.size()
+				bool has_grad = false;
+				std::vector<Matrix<Dynamic, Dynamic>> a;     // indexed by m-2
+				std::vector<Matrix<Dynamic, Dynamic>> a_adj; // indexed by m-2
+
+				// parameters changed; tables must be computed again
+				void invalidate() { entry = nullptr; }
+		};
+		// tables of given sample; scratch space is per thread and reused.
+		// tables computed by the last predict on this thread are reused
+		// if they are for the same sample and the model has not changed.
+		DP& get_dp(const Entry& entry, bool with_grad) const;
 
 		size_t n_parameters() const override {
 				size_t ret = b.size() + w.size();
@@ -42,13 +67,21 @@ class HOFM : public Model {
 				}
 				return ret;
 		}
+		size_t n_touched_parameters(size_t nnz) const override {
+				size_t ret = b.size() + nnz * w.cols();
+				for (auto& p : v) {
+						ret += nnz * p.cols();
+				}
+				return ret;
+		}
 
 		void initialize(Sampler& sampler, std::vector<real_t> extra) override;
 		void check_feature_id(size_t id) override;
 		void check_field_id(size_t id) override;
 		real_t predict(Entry& entry) override;
 		void serialize_txt(const String& filename) const override;
-		void serialize(const String& filename) const override;
+		void serialize(const String& filename,
+					   bool with_extras = false) const override;
 		void deserialize(const String& filename) override;
 
 		void take_snapshot() override {
@@ -63,14 +96,36 @@ class HOFM : public Model {
 		}
 		size_t max_feature_id() override { return n - 1; }
 
+		std::vector<ParameterTable> parameter_tables() override {
+				std::vector<ParameterTable> ret = {
+					{b.data(), 1, size_t(b.size()), 1, size_t(b.size()), false},
+					{w.data(), size_t(w.rows()), size_t(w.cols()), 1,
+					 size_t(w.cols()), true},
+				};
+				for (auto& p : v) {
+						ret.push_back({p.data(), size_t(p.rows()),
+									   size_t(p.cols()), k, size_t(p.cols()),
+									   true});
+				}
+				return ret;
+		}
+
 	private:
+		void reset_extras(std::vector<real_t> extras) override;
+
 		Vector<Dynamic> b_copy;
 		Matrix<Dynamic, Dynamic> w_copy;
 		std::vector<Matrix<Dynamic, Dynamic>> v_copy;
 
-		void optimize(Optimizer& optimizer, Entry& entry, real_t pg) override {
-				optimizer.optimize(*this, entry, pg);
-		}
+		static DP& scratch();
+		void forward(const FeatureVector& features,
+					 const std::vector<size_t>& index,
+					 size_t m,
+					 Matrix<Dynamic, Dynamic>& a) const;
+		void backward(const FeatureVector& features,
+					  const std::vector<size_t>& index,
+					  size_t m,
+					  Matrix<Dynamic, Dynamic>& a_adj) const;
 };
 
 NAMESPACE_END
@@ -1,5 +1,6 @@
 #include "lm.h"
 #include "base/logger.h"
+#include "base/profiler.h"
 #include "data/sampler.h"
 
 NAMESPACE_BEGIN
@@ -31,21 +32,17 @@ void LM::initialize(Sampler& sampler, std::vector<real_t> extras) {
 }
 
 real_t LM::predict(Entry& entry) {
-		real_t inv_norm = std::sqrt(entry.get_inv_norm2());
-
-		real_t y_l = 0; // linear part
-		for (auto& f : entry.features) {
-				if (f.id >= n) continue;
-				y_l += w.row(f.id).coeff(0) * f.value;
-		}
-		y_l = y_l * inv_norm + b.coeff(0);
-		return y_l;
+		// linear part
+		real_t y_l = sparse_dot(w.data(), w.cols(), n, entry.features);
+		return y_l + b.coeff(0);
 }
 
 void LM::check_feature_id(size_t id) {
 		if (id < n) return;
+		PROFILE_SCOPE(Grow);
 		size_t n_extras = m_extras.size();
 		w.conservativeResize(id + 1, 1 + n_extras);
+		place(w);
 		auto W = w.bottomRows(id + 1 - n);
 		W.col(0).fill(0);
 		for (size_t i = 1; i <= n_extras; ++i) {
@@ -55,4 +52,10 @@ void LM::check_feature_id(size_t id) {
 }
 void LM::check_field_id(size_t) {}
 
+void LM::reset_extras(std::vector<real_t> extras) {
+		relayout_extras(b, 1, m_extras.size(), extras);
+		relayout_extras(w, 1, m_extras.size(), extras);
+		m_extras = std::move(extras);
+}
+
 NAMESPACE_END
@@ -15,13 +15,17 @@ class LM : public Model {
 		Matrix<Dynamic, Dynamic> w;
 
 		size_t n_parameters() const override { return w.size() + b.size(); }
+		size_t n_touched_parameters(size_t nnz) const override {
+				return b.size() + nnz * w.cols();
+		}
 
 		void initialize(Sampler& sampler, std::vector<real_t> extras) override;
 		void check_feature_id(size_t id) override;
 		void check_field_id(size_t id) override;
 		real_t predict(Entry&) override;
 		void serialize_txt(const String& filename) const override;
-		void serialize(const String& filename) const override;
+		void serialize(const String& filename,
+					   bool with_extras = false) const override;
 		void deserialize(const String& filename) override;
 
 		void take_snapshot() override {
@@ -34,13 +38,19 @@ class LM : public Model {
 		}
 		size_t max_feature_id() override { return n - 1; }
 
+		std::vector<ParameterTable> parameter_tables() override {
+				return {
+					{b.data(), 1, size_t(b.size()), 1, size_t(b.size()), false},
+					{w.data(), size_t(w.rows()), size_t(w.cols()), 1,
+					 size_t(w.cols()), true},
+				};
+		}
+
 	private:
+		void reset_extras(std::vector<real_t> extras) override;
+
 		Vector<Dynamic> b_copy;
 		Matrix<Dynamic, Dynamic> w_copy;
-
-		void optimize(Optimizer& optimizer, Entry& entry, real_t pg) override {
-				optimizer.optimize(*this, entry, pg);
-		}
 };
 
 NAMESPACE_END
@@ -0,0 +1,61 @@
+#include "loss.h"
+#include "base/algebra.h"
+#include "base/enum_db.h"
+
+NAMESPACE_BEGIN
+
+ENUM_DB_DEFINITION(Loss) = {
+	{Loss::Squared, "MSE"}, {Loss::CrossEntropy, "log loss"},
+	{Loss::Hinge, "hinge"}, {Loss::Poisson, "poisson"},
+	{Loss::Huber, "huber"},
+};
+
+real_t loss_and_grad(Loss loss,
+					 size_t n,
+					 const real_t* pred,
+					 const real_t* label,
+					 const real_t* weight,
+					 real_t* pg) {
+		using Array = Eigen::Array<real_t, Dynamic, 1>;
+		if (n == 0) return 0;
+		Eigen::Map<const Array> P(pred, n), Y(label, n), W(weight, n);
+		Array L, G; // loss and its gradient, both unweighted
+		switch (loss) {
+		case Loss::Squared: {
+				Array E = P - Y;
+				L = real_t(0.5) * E.square();
+				if (pg) G = std::move(E);
+		} break;
+		case Loss::CrossEntropy: {
+				Array S = (Y > 0).select(Array::Ones(n), -Array::Ones(n));
+				// log(1 + exp(z)), without overflow
+				Array Z = -S * P;
+				L = Z.max(0) + (-Z.abs()).exp().log1p();
+				if (pg) G = -S / (1 + (-Z).exp());
+		} break;
+		case Loss::Hinge: {
+				Array S = (Y > 0).select(Array::Ones(n), -Array::Ones(n));
+				Array M = S * P;
+				L = (1 - M).max(0);
+				if (pg) G = (M < 1).select(-S, Array::Zero(n));
+		} break;
+		case Loss::Poisson: {
+				Array R = P.min(poisson_max_pred).exp();
+				L = R - Y * P;
+				if (pg) G = R - Y;
+		} break;
+		case Loss::Huber: {
+				Array E = P - Y;
+				Array A = E.abs();
+				L = (A <= huber_delta)
+						.select(real_t(0.5) * E.square(),
+								huber_delta * (A - huber_delta / 2));
+				if (pg) G = E.max(-huber_delta).min(huber_delta);
+		} break;
+		default: UNREACHABLE("bad loss");
+		}
+		if (pg) Eigen::Map<Array>(pg, n) = W * G;
+		return (W * L).sum();
+}
+
+NAMESPACE_END
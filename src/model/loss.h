@@ -0,0 +1,56 @@
+#pragma once
+
+#include "base/exception.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+NAMESPACE_BEGIN
+
+// predictions are raw scores: margins for CrossEntropy and Hinge, and
+// log of rates for Poisson. labels of binary losses are positive or not.
+enum class Loss {
+		Squared,
+		CrossEntropy,
+		Hinge,
+		Poisson,
+		Huber,
+};
+
+// errors beyond it are penalized linearly by Huber loss
+constexpr real_t huber_delta = 1;
+// exp of larger predictions of Poisson loss overflows
+constexpr real_t poisson_max_pred = 80;
+
+// weighted sum of loss over n predictions. if pg is not null, partial
+// gradient of each weighted loss w.r.t. its prediction is written to it.
+// whole arrays are processed at a time so that exp/log are vectorized.
+real_t loss_and_grad(Loss loss,
+					 size_t n,
+					 const real_t* pred,
+					 const real_t* label,
+					 const real_t* weight,
+					 real_t* pg = nullptr);
+
+// partial gradient of weighted loss of a single prediction, as needed
+// right after predicting when training sample by sample.
+inline real_t
+loss_grad(Loss loss, real_t pred, real_t label, real_t weight = 1) {
+		real_t y = label > 0 ? 1 : -1;
+		switch (loss) {
+		case Loss::Squared: return weight * (pred - label);
+		case Loss::CrossEntropy: return -y * weight / (1 + std::exp(y * pred));
+		case Loss::Hinge: return y * pred < 1 ? -y * weight : 0;
+		case Loss::Poisson: {
+				real_t rate = std::exp(std::min(pred, poisson_max_pred));
+				return weight * (rate - label);
+		}
+		case Loss::Huber: {
+				real_t error = pred - label;
+				return weight * std::clamp(error, -huber_delta, huber_delta);
+		}
+		}
+		UNREACHABLE("bad loss");
+}
+
+NAMESPACE_END
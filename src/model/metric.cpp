@@ -5,45 +5,255 @@
 #include "data/sampler.h"
 #include "model/model.h"
 
+#include <map>
+
 NAMESPACE_BEGIN
 
-struct Metric_impl {
-		real_t sum = 0;   // meaning depends to metric type
-		size_t count = 0; // indicates how many samples sum consist
+namespace {
+
+// counts of positives and negatives by bucket of sigmoid(predicted). a sparse
+// one keeps only buckets seen, as slices are many and mostly small.
+class Histogram {
+	public:
+		struct Cell {
+				u64 positives = 0;
+				u64 negatives = 0;
+		};
+
+		Histogram(size_t size, bool sparse)
+		: m_size(size), m_dense(sparse ? 0 : size) {}
+
+		size_t size() const { return m_size; }
+		void add(real_t prob, bool positive) {
+				size_t idx = std::min(size_t(prob * m_size), m_size - 1);
+				auto& cell = m_dense.empty() ? m_sparse[idx] : m_dense[idx];
+				++(positive ? cell.positives : cell.negatives);
+		}
+		// f(bucket, cell) on buckets in ascending order
+		template <typename F>
+		void for_each(F&& f) const {
+				for (size_t i = 0; i < m_dense.size(); ++i) {
+						f(i, m_dense[i]);
+				}
+				for (auto& [i, cell] : m_sparse) {
+						f(i, cell);
+				}
+		}
+		template <typename F>
+		void for_each_descending(F&& f) const {
+				for (size_t i = m_dense.size(); i-- > 0;) {
+						f(i, m_dense[i]);
+				}
+				for (auto it = m_sparse.rbegin(); it != m_sparse.rend(); ++it) {
+						f(it->first, it->second);
+				}
+		}
+
+	private:
+		size_t m_size;
+		std::vector<Cell> m_dense;
+		std::map<size_t, Cell> m_sparse;
+};
+
+// sufficient statistics from which every metric could be derived,
+// so that all requested metrics are computed in one pass.
+struct Accumulator {
+		size_t count = 0;
+		size_t n_positives = 0;
+		double abs_error = 0;
+		double abs_percentage_error = 0;
+		double squared_error = 0;
+		double log_loss = 0;
+		double predicted_ctr = 0;
+
+		// histogram of sigmoid(predicted); only for ranking metrics
+		Histogram histogram;
+
+		explicit Accumulator(size_t bucket_size = 0, bool sparse = false)
+		: histogram(bucket_size, sparse) {}
+
+		void add(real_t P, real_t T) {
+				++count;
+				double e = P - T;
+				abs_error += std::abs(e);
+				abs_percentage_error += std::abs(e) / T;
+				squared_error += e * e;
+				real_t y = T > 0 ? 1.0 : -1.0;
+				real_t z = -y * P; // log(1+exp(z)) without overflow
+				log_loss += z > 0 ? z + std::log1p(std::exp(-z))
+								  : std::log1p(std::exp(z));
+				real_t prob = sigmoid(P);
+				predicted_ctr += prob;
+				n_positives += T > 0;
+				if (histogram.size()) histogram.add(prob, T > 0);
+		}
+
+		// confusion matrix at threshold of sigmoid(predicted) >= 0.5
+		void confusion(u64& tp, u64& fp, u64& tn, u64& fn) const {
+				tp = fp = tn = fn = 0;
+				size_t half = histogram.size() / 2;
+				histogram.for_each([&](size_t i, const Histogram::Cell& c) {
+						if (i >= half) {
+								tp += c.positives;
+								fp += c.negatives;
+						} else {
+								fn += c.positives;
+								tn += c.negatives;
+						}
+				});
+		}
+
+		real_t value(Metric::Type type) const {
+				switch (type) {
+				case Metric::Accuracy: {
+						u64 tp, fp, tn, fn;
+						confusion(tp, fp, tn, fn);
+						return real_t(tp + tn) / (tp + fp + tn + fn);
+				}
+				case Metric::Precision: {
+						u64 tp, fp, tn, fn;
+						confusion(tp, fp, tn, fn);
+						return real_t(tp) / (tp + fp);
+				}
+				case Metric::Recall: {
+						u64 tp, fp, tn, fn;
+						confusion(tp, fp, tn, fn);
+						return real_t(tp) / (tp + fn);
+				}
+				case Metric::MAE: return abs_error / count;
+				case Metric::MAPE: return abs_percentage_error / count;
+				case Metric::RMSD: return std::sqrt(squared_error / count);
+				case Metric::LogLoss: return log_loss / count;
+				case Metric::NE: {
+						// undefined without both positives and negatives
+						if (n_positives == 0 || n_positives == count)
+								return NAN;
+						double p = double(n_positives) / count;
+						double entropy =
+							-(p * std::log(p) + (1 - p) * std::log1p(-p));
+						return log_loss / count / entropy;
+				}
+				case Metric::Calibration:
+						if (n_positives == 0) return NAN;
+						return predicted_ctr / n_positives;
+				case Metric::AUC: {
+						u64 positive_sum = 0;
+						u64 negative_sum = 0;
+						double auc = 0.0;
+						histogram.for_each(
+							[&](size_t, const Histogram::Cell& c) {
+									auto t = positive_sum;
+									positive_sum += c.positives;
+									negative_sum += c.negatives;
+									auc += (t + positive_sum) * c.negatives;
+							});
+						auc /= 2;
+						return 1.0 - auc / (positive_sum * negative_sum);
+				}
+				case Metric::PRAUC: {
+						// average precision; scores in a bucket are tied.
+						u64 tp = 0, fp = 0;
+						double ap = 0.0;
+						histogram.for_each_descending(
+							[&](size_t, const Histogram::Cell& c) {
+									tp += c.positives;
+									fp += c.negatives;
+									if (c.positives)
+											ap += double(c.positives) * tp
+												/ (tp + fp);
+							});
+						return ap / n_positives;
+				}
+				}
+				UNREACHABLE("bad metric type");
+		}
+};
 
-		// for AUC
+} // namespace
+
+struct Metric_impl {
 		static constexpr size_t bucket_size = 1e6;
-		std::array<size_t, bucket_size> positives = {};
-		std::array<size_t, bucket_size> negatives = {};
+		// slices are many; trade resolution for memory, and keep their
+		// histograms sparse
+		static constexpr size_t slice_bucket_size = 1e4;
+
+		bool use_histogram = false;
+		Accumulator total;
+
+		std::optional<size_t> slice_field;
+		std::map<size_t, Accumulator> slices;
+
+		void reset() {
+				total = Accumulator(use_histogram ? bucket_size : 0);
+				slices.clear();
+		}
+		Accumulator& slice(size_t feature_id) {
+				auto it = slices.find(feature_id);
+				if (it == slices.end()) {
+						size_t size = use_histogram ? slice_bucket_size : 0;
+						it = slices.emplace(feature_id, Accumulator(size, true))
+								 .first;
+				}
+				return it->second;
+		}
 };
 
 ENUM_DB_DEFINITION(Metric::Type) = {
-	{Metric::Accuracy, "acc"},  {Metric::Precision, "prec"},
-	{Metric::Recall, "recall"}, {Metric::MAE, "mae"},
-	{Metric::MAPE, "mape"},     {Metric::RMSD, "rmsd"},
-	{Metric::AUC, "auc"},
+	{Metric::Accuracy, "acc"},    {Metric::Precision, "prec"},
+	{Metric::Recall, "recall"},   {Metric::MAE, "mae"},
+	{Metric::MAPE, "mape"},       {Metric::RMSD, "rmsd"},
+	{Metric::AUC, "auc"},         {Metric::LogLoss, "logloss"},
+	{Metric::NE, "ne"},           {Metric::PRAUC, "prauc"},
+	{Metric::Calibration, "calib"},
 };
 
-Metric::Metric(Metric::Type type) : m_type(type), m_impl(new Metric_impl) {}
+Metric::Metric(Metric::Type type) : Metric(std::vector<Type>{type}) {}
+Metric::Metric(std::vector<Type> types)
+: m_types(std::move(types)), m_impl(new Metric_impl) {
+		RELEASE_ASSERT(!m_types.empty());
+		for (auto type : m_types) {
+				m_impl->use_histogram |= is_ranking(type);
+		}
+		m_impl->reset();
+}
 Metric::~Metric() = default;
 Metric::Metric(Metric&&) = default;
 Metric& Metric::operator=(Metric&&) = default;
 
-void Metric::reset() {
-		m_impl->sum = m_impl->count = 0;
-		if (m_type == AUC) {
-				m_impl->positives.fill(0);
-				m_impl->negatives.fill(0);
+void Metric::reset() { m_impl->reset(); }
+
+void Metric::slice_by(size_t field_id) {
+		m_impl->slice_field = field_id;
+		m_impl->slices.clear();
+}
+std::optional<size_t> Metric::slice_field() const {
+		return m_impl->slice_field;
+}
+std::vector<size_t> Metric::slices() const {
+		std::vector<size_t> ret;
+		for (auto& pair : m_impl->slices) {
+				ret.push_back(pair.first);
 		}
+		return ret;
+}
+size_t Metric::slice_size(size_t feature_id) const {
+		auto it = m_impl->slices.find(feature_id);
+		return it == m_impl->slices.end() ? 0 : it->second.count;
+}
+real_t Metric::slice_value(size_t feature_id, Type type) const {
+		auto it = m_impl->slices.find(feature_id);
+		if (it == m_impl->slices.end()) return NAN;
+		return it->second.value(type);
 }
 
 void Metric::evaluate(Model& model, Sampler& sampler) {
 		std::vector<real_t> pred;
 		Entries entries;
 		while (size_t n_sample = sampler.get_samples(-1, entries)) {
-				pred.reserve(pred.size() + n_sample);
+				pred.clear();
+				pred.reserve(n_sample);
 				for (auto& e : entries) {
-						pred.push_back(model.predict(*e));
+						pred.push_back(model.calibrated_predict(*e));
 				}
 				accumulate(pred.data(), entries.data(), pred.size());
 				entries.clear();
@@ -53,108 +263,65 @@ void Metric::evaluate(Model& model, Sampler& sampler) {
 void Metric::accumulate(real_t* predicted,
 						std::shared_ptr<Entry>* truth,
 						size_t n) {
-		size_t n_count = 0;
 		for (size_t i = 0; i < n; ++i) {
 				auto P = predicted[i];
 				auto T = truth[i]->label;
-				switch (m_type) {
-				case Type::Accuracy:
-						ASSERT(P == 0 || P == 1);
-						ASSERT(T == 0 || T == 1);
-						m_impl->sum += P == T;
-						++n_count;
-						break;
-				case Type::Precision:
-						ASSERT(P == 0 || P == 1);
-						ASSERT(T == 0 || T == 1);
-						if (P == 1) {
-								m_impl->sum += T == 1;
-								++n_count;
+				m_impl->total.add(P, T);
+				if (m_impl->slice_field) {
+						for (auto& f : truth[i]->features) {
+								if (f.field_id != *m_impl->slice_field)
+										continue;
+								m_impl->slice(f.id).add(P, T);
 						}
-						break;
-				case Type::Recall:
-						ASSERT(P == 0 || P == 1);
-						ASSERT(T == 0 || T == 1);
-						if (T == 1) {
-								m_impl->sum += P == 1;
-								++n_count;
-						}
-						break;
-				case Type::MAE:
-						m_impl->sum += std::abs(P - T);
-						++n_count;
-						break;
-				case Type::MAPE:
-						m_impl->sum += std::abs(P - T) / T;
-						++n_count;
-						break;
-				case Type::RMSD:
-						m_impl->sum += (P - T) * (P - T);
-						++n_count;
-						break;
-				case Type::AUC: {
-						int idx = sigmoid(P) * m_impl->bucket_size;
-						idx %= m_impl->bucket_size;
-						++(T > 0 ? m_impl->positives : m_impl->negatives)[idx];
-				} break;
-				default: UNREACHABLE("bad metric type");
 				}
 		}
-		m_impl->count += n_count;
 }
 
-real_t Metric::value() const {
-		switch (m_type) {
+real_t Metric::value() const { return value(type()); }
+real_t Metric::value(Type type) const { return m_impl->total.value(type); }
+
+String Metric::name(Type type) { return EnumDB<Type>::to_string(type); }
+
+bool Metric::is_score(Type type) {
+		switch (type) {
 		case Type::Accuracy:
 		case Type::Precision:
 		case Type::Recall:
+		case Type::AUC:
+		case Type::PRAUC: return true;
 		case Type::MAE:
-		case Type::MAPE: return m_impl->sum / m_impl->count;
-		case Type::RMSD: return std::sqrt(m_impl->sum / m_impl->count);
-		case Type::AUC: {
-				auto& positives = m_impl->positives;
-				auto& negatives = m_impl->negatives;
-				u64 positive_sum = 0;
-				u64 negative_sum = 0;
-				double auc = 0.0;
-				for (size_t i = 0; i < m_impl->bucket_size; ++i) {
-						auto t = positive_sum;
-						positive_sum += positives[i];
-						negative_sum += negatives[i];
-						auc += (t + positive_sum) * (negatives[i]);
-				}
-				auc /= 2;
-				return 1.0 - auc / (positive_sum * negative_sum);
-		}
+		case Type::MAPE:
+		case Type::RMSD:
+		case Type::LogLoss:
+		case Type::NE:
+		case Type::Calibration: return false;
 		}
 		UNREACHABLE("bad metric type");
 }
 
-String Metric::name() const { return EnumDB<Type>::to_string(m_type); }
-
-bool Metric::is_score(Type type) {
+bool Metric::is_ranking(Type type) {
 		switch (type) {
 		case Type::Accuracy:
 		case Type::Precision:
 		case Type::Recall:
-		case Type::AUC: return true;
-		case Type::MAE:
-		case Type::MAPE:
-		case Type::RMSD: return false;
+		case Type::AUC:
+		case Type::PRAUC: return true;
+		default: return false;
 		}
-		UNREACHABLE("bad metric type");
 }
 
 bool Metric::better(Metric::Type type, real_t x, real_t y) {
+		// the closer calibration is to 1, the better
+		if (type == Type::Calibration) return std::abs(x - 1) < std::abs(y - 1);
 		if (is_score(type)) return x > y;
 		if (is_loss(type)) return x < y;
 		THROW("can not compare");
 }
 bool Metric::operator<(const Metric& rhs) const {
-		if (m_type != rhs.m_type)
+		if (type() != rhs.type())
 				throw Exception("comparing different metric: %s & %s",
 								name().c_str(), rhs.name().c_str());
-		return better(m_type, rhs.value(), value()); // greater is better!
+		return better(type(), rhs.value(), value()); // greater is better!
 }
 
 NAMESPACE_END
@@ -3,6 +3,9 @@
 #include "base/common.h"
 #include "base/str.h"
 
+#include <optional>
+#include <vector>
+
 NAMESPACE_BEGIN
 
 class Model;
@@ -10,11 +13,26 @@ class Sampler;
 struct Entry;
 
 struct Metric_impl;
+// a set of metrics computed together in a single pass over the data.
+// the first metric is the primary one, used for comparison/early-stopping.
 class Metric {
 	public:
-		enum Type { Accuracy, Precision, Recall, MAE, MAPE, RMSD, AUC };
+		enum Type {
+				Accuracy,
+				Precision,
+				Recall,
+				MAE,
+				MAPE,
+				RMSD,
+				AUC,
+				LogLoss,
+				NE,          // normalized entropy
+				PRAUC,       // area under precision-recall curve
+				Calibration, // predicted CTR / observed CTR
+		};
 
 		Metric(Type type);
+		Metric(std::vector<Type> types);
 		Metric(Metric&&);
 		Metric& operator=(Metric&&);
 		~Metric();
@@ -23,16 +41,31 @@ class Metric {
 		void evaluate(Model&, Sampler&);
 		void accumulate(real_t* P, std::shared_ptr<Entry>* T, size_t n);
 
+		// additionally break metrics down by the feature present in given field.
+		void slice_by(size_t field_id);
+		std::optional<size_t> slice_field() const;
+		// ids of features seen in the slicing field, in ascending order.
+		std::vector<size_t> slices() const;
+		size_t slice_size(size_t feature_id) const;
+		real_t slice_value(size_t feature_id, Type type) const;
+
+		// value of the primary metric; values are NaN where undefined, e.g.
+		// NE without both positives and negatives.
 		real_t value() const;
-		String name() const;
-		Type type() const { return m_type; }
+		real_t value(Type type) const;
+		String name() const { return name(type()); }
+		static String name(Type type);
+		Type type() const { return m_types.front(); }
+		const std::vector<Type>& types() const { return m_types; }
 
 		static bool is_score(Type type);
 		static bool is_loss(Type type) { return !is_score(type); }
 		// a metric is a score if the higher it is, the better.
-		bool is_score() const { return is_score(m_type); }
+		bool is_score() const { return is_score(type()); }
 		// a metric is a loss if the lower it is, the better.
-		bool is_loss() const { return is_loss(m_type); }
+		bool is_loss() const { return is_loss(type()); }
+		// whether the metric needs histogram of predicted scores.
+		static bool is_ranking(Type type);
 
 		static bool better(Type type, real_t x, real_t y);
 		// a good metric value is 'greater' than a bad metric value.
@@ -42,7 +75,7 @@ class Metric {
 		bool operator>=(const Metric& rhs) const { return !(*this < rhs); }
 
 	private:
-		Type m_type;
+		std::vector<Type> m_types;
 		std::unique_ptr<Metric_impl> m_impl;
 };
 
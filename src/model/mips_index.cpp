@@ -0,0 +1,220 @@
+#include "mips_index.h"
+#include "base/io_util.h"
+#include "base/random.h"
+#include "base/serial.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+constexpr size_t n_iterations = 10;     // of k-means
+constexpr size_t samples_per_list = 64; // items k-means is run on
+constexpr size_t block = 1024;          // items assigned at a time
+
+// rows of X are x_i of given items, see MipsIndex.
+void lift(const Matrix<Dynamic, Dynamic>& items,
+		  const Vector<Dynamic>& bias,
+		  real_t max_norm2,
+		  const u32* ids,
+		  size_t n,
+		  Matrix<Dynamic, Dynamic>& X) {
+		size_t k = items.cols();
+		X.resize(n, k + 2);
+		for (size_t r = 0; r < n; ++r) {
+				u32 i = ids[r];
+				X.row(r).head(k) = items.row(i);
+				X(r, k) = bias[i];
+				real_t norm2 = items.row(i).squaredNorm() + bias[i] * bias[i];
+				X(r, k + 1) = std::sqrt(std::max<real_t>(max_norm2 - norm2, 0));
+		}
+}
+
+// label each row of X with its nearest centroid, given |c|^2 of each.
+void assign(const Matrix<Dynamic, Dynamic>& X,
+			const Matrix<Dynamic, Dynamic>& C,
+			const Vector<Dynamic>& norm,
+			u32* label) {
+		thread_local Matrix<Dynamic, Dynamic> D;
+		D.resize(X.rows(), C.rows());
+		D.noalias() = X * C.transpose();
+		for (index_t r = 0; r < X.rows(); ++r) {
+				index_t best;
+				(norm - 2 * D.row(r)).minCoeff(&best);
+				label[r] = best;
+		}
+}
+
+} // namespace
+
+MipsIndex::MipsIndex(const Matrix<Dynamic, Dynamic>& items,
+					 const Vector<Dynamic>& bias,
+					 size_t n_lists,
+					 ThreadPool& pool) {
+		size_t n = items.rows(), k = items.cols();
+		RELEASE_ASSERT(n <= Limits<u32>::max());
+		m_fingerprint = fingerprint(items, bias);
+		m_items.resize(n, k);
+		m_bias.resize(n);
+		m_ids.resize(n);
+		if (n == 0) {
+				m_centroids.resize(0, k + 1);
+				m_centroid_norm.resize(0);
+				m_offsets.assign(1, 0);
+				return;
+		}
+		n_lists = std::clamp<size_t>(n_lists, 1, n);
+		real_t max_norm2 = 0;
+		for (size_t i = 0; i < n; ++i) {
+				real_t norm2 = items.row(i).squaredNorm() + bias[i] * bias[i];
+				max_norm2 = std::max(max_norm2, norm2);
+		}
+
+		// k-means on a sample, seeded with its first items
+		auto& G = random_generator();
+		std::vector<u32> sample(n);
+		std::iota(sample.begin(), sample.end(), 0);
+		std::shuffle(sample.begin(), sample.end(), G);
+		sample.resize(std::min(n, n_lists * samples_per_list));
+		Matrix<Dynamic, Dynamic> X, C;
+		lift(items, bias, max_norm2, sample.data(), sample.size(), X);
+		C = X.topRows(n_lists);
+		Vector<Dynamic> norm;
+		std::vector<u32> label(sample.size());
+		std::vector<u64> count(n_lists);
+		std::uniform_int_distribution<size_t> any(0, sample.size() - 1);
+		for (size_t it = 0; it < n_iterations; ++it) {
+				norm = C.rowwise().squaredNorm().transpose();
+				assign(X, C, norm, label.data());
+				C.setZero();
+				std::fill(count.begin(), count.end(), 0);
+				for (size_t r = 0; r < sample.size(); ++r) {
+						C.row(label[r]) += X.row(r);
+						count[label[r]]++;
+				}
+				for (size_t l = 0; l < n_lists; ++l) {
+						// an empty list is moved onto some item
+						if (count[l] == 0) C.row(l) = X.row(any(G));
+						else C.row(l) /= count[l];
+				}
+		}
+		norm = C.rowwise().squaredNorm().transpose();
+
+		// assign all items, then lay them out by list
+		label.resize(n);
+		std::vector<u32> all(n);
+		std::iota(all.begin(), all.end(), 0);
+		size_t n_blocks = (n + block - 1) / block;
+		pool.parallel_for(n_blocks, 1, [&](size_t b) {
+				thread_local Matrix<Dynamic, Dynamic> Y;
+				size_t first = b * block;
+				size_t m = std::min(block, n - first);
+				lift(items, bias, max_norm2, &all[first], m, Y);
+				assign(Y, C, norm, &label[first]);
+		});
+		m_offsets.assign(n_lists + 1, 0);
+		for (size_t i = 0; i < n; ++i) {
+				m_offsets[label[i] + 1]++;
+		}
+		std::partial_sum(m_offsets.begin(), m_offsets.end(), m_offsets.begin());
+		auto next = m_offsets;
+		for (size_t i = 0; i < n; ++i) {
+				u64 j = next[label[i]]++;
+				m_ids[j] = i;
+				m_items.row(j) = items.row(i);
+				m_bias[j] = bias[i];
+		}
+		// last element of q is 0, so that of centroids is only in |c|^2
+		m_centroids = C.leftCols(k + 1);
+		m_centroid_norm = norm;
+}
+
+u64 MipsIndex::fingerprint(const Matrix<Dynamic, Dynamic>& items,
+						   const Vector<Dynamic>& bias) {
+		// FNV-1a over bytes of items
+		u64 h = 14695981039346656037ull;
+		auto hash = [&](const void* data, size_t size) {
+				auto p = static_cast<const unsigned char*>(data);
+				for (size_t i = 0; i < size; ++i) {
+						h = (h ^ p[i]) * 1099511628211ull;
+				}
+		};
+		index_t rows = items.rows(), cols = items.cols();
+		hash(&rows, sizeof(rows));
+		hash(&cols, sizeof(cols));
+		hash(items.data(), items.size() * sizeof(real_t));
+		hash(bias.data(), bias.size() * sizeof(real_t));
+		return h;
+}
+
+void MipsIndex::search(const real_t* s,
+					   real_t bias,
+					   size_t k,
+					   size_t n_probe,
+					   Recommender::List& heap) const {
+		thread_local Vector<Dynamic> d, y;
+		thread_local std::vector<u32> lists;
+		size_t dim = m_items.cols();
+		Eigen::Map<const Vector<Dynamic>> q(s, dim);
+		size_t n_lists = this->n_lists();
+		n_probe = std::min(n_probe, n_lists);
+		if (n_probe == 0) return;
+
+		// |q - c|^2 - |q|^2 of each centroid
+		d.resize(n_lists);
+		d.noalias() = q * m_centroids.leftCols(dim).transpose();
+		d = m_centroid_norm - 2 * (d + m_centroids.col(dim).transpose());
+		lists.resize(n_lists);
+		std::iota(lists.begin(), lists.end(), 0);
+		std::partial_sort(lists.begin(), lists.begin() + n_probe, lists.end(),
+						  [&](u32 a, u32 b) { return d[a] < d[b]; });
+
+		for (size_t p = 0; p < n_probe; ++p) {
+				u64 first = m_offsets[lists[p]], last = m_offsets[lists[p] + 1];
+				if (first == last) continue;
+				y.resize(last - first);
+				auto I = m_items.middleRows(first, last - first);
+				y.noalias() = q * I.transpose();
+				for (u64 j = first; j < last; ++j) {
+						real_t score = bias + m_bias[j] + y[j - first];
+						Recommender::offer(heap, k, {m_ids[j], score});
+				}
+		}
+}
+
+void MipsIndex::serialize(const String& filename) const {
+		auto file =
+			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
+		*file << "IVF\n";
+		serialize_to(*file, m_fingerprint);
+		serialize_matrix(*file, m_centroids);
+		serialize_matrix(*file, m_centroid_norm);
+		serialize_to(*file, m_offsets);
+		serialize_to(*file, m_ids);
+		serialize_matrix(*file, m_items);
+		serialize_matrix(*file, m_bias);
+}
+
+void MipsIndex::deserialize(const String& filename) {
+		auto file =
+			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
+		std::string line;
+		std::getline(*file, line);
+		if (line != "IVF") THROW("%s is not an index", filename.c_str());
+		deserialize_from(*file, m_fingerprint);
+		deserialize_matrix(*file, m_centroids);
+		deserialize_matrix(*file, m_centroid_norm);
+		deserialize_from(*file, m_offsets);
+		deserialize_from(*file, m_ids);
+		deserialize_matrix(*file, m_items);
+		deserialize_matrix(*file, m_bias);
+		if (!*file) THROW("%s is truncated", filename.c_str());
+		RELEASE_ASSERT(m_offsets.size() == n_lists() + 1);
+		RELEASE_ASSERT(m_offsets.back() == n_items());
+}
+
+NAMESPACE_END
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "base/str.h"
+#include "recommender.h"
+
+NAMESPACE_BEGIN
+
+// inverted file (IVF) index for approximate top-K by inner product, i.e.
+// items of max bias_i + <s, s_i>. an item is mapped to
+// x_i = [s_i, bias_i, sqrt(M^2 - |s_i|^2 - bias_i^2)] and a query to
+// q = [s, 1, 0], where M is max norm of [s_i, bias_i], so that
+// |q - x_i|^2 = |q|^2 + M^2 - 2 (bias_i + <s, s_i>), and top-K by inner
+// product are nearest neighbors of q. items are clustered by k-means on x_i
+// into lists, and a query scans only lists of centroids nearest to it.
+class MipsIndex {
+	public:
+		MipsIndex() = default;
+		// build n_lists lists of items, row i of which is s_i.
+		MipsIndex(const Matrix<Dynamic, Dynamic>& items,
+				  const Vector<Dynamic>& bias,
+				  size_t n_lists,
+				  ThreadPool& pool);
+
+		size_t n_items() const { return m_ids.size(); }
+		size_t n_lists() const { return m_centroids.rows(); }
+		// identifies items indexed, to tell if the index is stale.
+		u64 fingerprint() const { return m_fingerprint; }
+		static u64 fingerprint(const Matrix<Dynamic, Dynamic>& items,
+							   const Vector<Dynamic>& bias);
+
+		// offer items of n_probe lists nearest to s, of length k of FM, to
+		// heap of top k, see Recommender::offer(), scored by
+		// bias + bias_i + <s, s_i>.
+		void search(const real_t* s,
+					real_t bias,
+					size_t k,
+					size_t n_probe,
+					Recommender::List& heap) const;
+
+		void serialize(const String& filename) const;
+		void deserialize(const String& filename);
+
+	private:
+		u64 m_fingerprint = 0;
+		Matrix<Dynamic, Dynamic> m_centroids; // of x_i, without last element
+		Vector<Dynamic> m_centroid_norm;      // |c|^2, with last element
+		// items of list l are at [m_offsets[l], m_offsets[l + 1])
+		std::vector<u64> m_offsets;
+		std::vector<u32> m_ids;
+		Matrix<Dynamic, Dynamic> m_items; // s_i, in order of lists
+		Vector<Dynamic> m_bias;           // bias_i, in order of lists
+};
+
+NAMESPACE_END
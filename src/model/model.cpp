@@ -1,101 +1,199 @@
 #include "model.h"
 #include "base/enum_db.h"
 #include "base/logger.h"
+#include "base/profiler.h"
 #include "base/thread_pool.h"
 #include "data/sampler.h"
 #include "ffm.h"
 #include "fm.h"
+#include "fwfm.h"
 #include "hofm.h"
 #include "lm.h"
 #include "optimizer/optimizer.h"
 
+#include <cstddef>
 #include <valarray>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 NAMESPACE_BEGIN
 
-ENUM_DB_DEFINITION(Loss) = {
-	{Loss::Squared, "MSE"},
-	{Loss::CrossEntropy, "log loss"},
-};
-
 Model::~Model() = default;
 
 std::unique_ptr<Model> Model::create_LM() { return std::make_unique<LM>(); }
 std::unique_ptr<Model> Model::create_FM(size_t k) {
 		return std::make_unique<FM>(k);
 }
-std::unique_ptr<Model> Model::create_FFM(size_t k) {
-		return std::make_unique<FFM>(k);
+std::unique_ptr<Model> Model::create_FFM(size_t k, bool sparse) {
+		return std::make_unique<FFM>(k, sparse);
+}
+std::unique_ptr<Model> Model::create_FwFM(size_t k) {
+		return std::make_unique<FwFM>(k);
 }
 std::unique_ptr<Model> Model::create_HOFM(size_t m, size_t k) {
 		return std::make_unique<HOFM>(m, k);
 }
 
+#ifdef __AVX2__
+// lower half of x permuted by idx
+static __m128 permuted_low(__m256i x, __m256i idx) {
+		auto y = _mm256_permutevar8x32_epi32(x, idx);
+		return _mm256_castps256_ps128(_mm256_castsi256_ps(y));
+}
+#endif
+
+real_t sparse_dot(const real_t* w,
+				  size_t cols,
+				  size_t n,
+				  const FeatureVector& features) {
+		size_t d = features.size(), i = 0;
+		real_t sum = 0;
+#ifdef __AVX2__
+		static_assert(sizeof(Feature) == 16 && offsetof(Feature, id) == 0
+						  && offsetof(Feature, value) == 12
+						  && sizeof(real_t) == 4,
+					  "layout of Feature assumed below");
+		// offsets are products of lower 32 bits of ids and cols; short rows
+		// are left to the scalar loop, which costs less to set up.
+		if (d >= 8 && n <= Limits<u32>::max() && cols <= Limits<u32>::max()) {
+				auto p = reinterpret_cast<const __m256i*>(features.data());
+				__m256i limit = _mm256_set1_epi64x(n);
+				__m256i scale = _mm256_set1_epi64x(cols);
+				__m256i lower = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+				__m256i upper = _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0);
+				__m128 acc = _mm_setzero_ps();
+				// 4 features a time, in order of 0, 2, 1, 3
+				for (; i + 4 <= d; i += 4, p += 2) {
+						__m256i a = _mm256_loadu_si256(p);
+						__m256i b = _mm256_loadu_si256(p + 1);
+						__m256i ids = _mm256_unpacklo_epi64(a, b);
+						__m256i rest = _mm256_unpackhi_epi64(a, b);
+						__m128 values = permuted_low(rest, upper);
+						__m256i known = _mm256_cmpgt_epi64(limit, ids);
+						__m128 mask = permuted_low(known, lower);
+						__m256i offsets = _mm256_mul_epu32(ids, scale);
+						__m128 weights = _mm256_mask_i64gather_ps(
+							_mm_setzero_ps(), w, offsets, mask, sizeof(real_t));
+						acc = _mm_add_ps(acc, _mm_mul_ps(weights, values));
+				}
+				acc = _mm_hadd_ps(acc, acc);
+				acc = _mm_hadd_ps(acc, acc);
+				sum = _mm_cvtss_f32(acc);
+		}
+#endif
+		for (; i < d; ++i) {
+				auto& f = features[i];
+				if (f.id < n) sum += w[f.id * cols] * f.value;
+		}
+		return sum;
+}
+
+void Model::grow(const Entries& entries) {
+		if (entries.empty()) return;
+		check_feature_id(DataSet::max_feature_id(entries));
+		check_field_id(DataSet::max_field_id(entries));
+}
+
+void Model::warm_start(Sampler& sampler, const Optimizer& optimizer) {
+		if (m_optimizer != optimizer.name()) {
+				if (!m_optimizer.empty()) {
+						logger::warn("optimizer states saved with model belong "
+									 "to {}; starting afresh",
+									 m_optimizer.c_str());
+				}
+				reset_extras(optimizer.extras());
+				m_optimizer = optimizer.name();
+		}
+		Entries entries;
+		while (sampler.get_samples(-1, entries)) {
+				grow(entries);
+				entries.clear();
+		}
+}
+
 static std::atomic_bool thrown = false;
 real_t Model::run_model(Loss loss,
 						Sampler& sampler,
 						ThreadPool& thread_pool,
-						Optimizer* optimizer) {
+						Optimizer* optimizer,
+						size_t batch_size,
+						const BatchCallback& after_batch) {
 		size_t n_threads = thread_pool.size();
-		size_t total_samples = 0;
 		std::valarray<real_t> thread_sum(n_threads);
+		std::valarray<real_t> thread_weight(n_threads);
 		Entries entries;
-		while (size_t n_sample = sampler.get_samples(-1, entries)) {
-				total_samples += n_sample;
+		auto get_samples = [&]() {
+				PROFILE_SCOPE(Sample);
+				return sampler.get_samples(batch_size, entries);
+		};
+		while (size_t n_sample = get_samples()) {
 				auto splits = ThreadPool::split_task(n_sample, n_threads);
 				auto p = entries.data();
 				for (size_t i = 0; i < n_threads; ++i) {
 						auto start = p + splits[i];
 						auto end = p + splits[i + 1];
-						auto task =
-							std::bind(&Model::thread_run_model, this, loss,
-									  start, end, &thread_sum[i], optimizer);
-						thread_pool.enqueue(std::move(task));
+						auto task = std::bind(&Model::thread_run_model, this,
+											  loss, start, end, &thread_sum[i],
+											  &thread_weight[i], optimizer);
+						thread_pool.enqueue_to(i, std::move(task));
 				}
 				thread_pool.sync(n_threads);
 				if (thrown) throw Exception("exception thrown");
+				if (after_batch) after_batch(entries);
 				entries.clear();
 		}
-		return thread_sum.sum() / total_samples;
+		return thread_sum.sum() / thread_weight.sum();
 }
 
 void Model::thread_run_model(Loss loss,
 							 std::shared_ptr<Entry>* start,
 							 std::shared_ptr<Entry>* end,
 							 real_t* result,
+							 real_t* total_weight,
 							 Optimizer* optimizer) {
 		try {
-				real_t loss_sum = 0;
-				switch (loss) {
-				case Loss::Squared: {
-						for (auto p = start; p < end; ++p) {
-								auto& entry = **p;
-								real_t predicted = predict(entry);
-								real_t error = entry.label - predicted;
-								loss_sum += error * error;
-								if (optimizer) {
-										real_t pg = -error;
-										optimize(*optimizer, entry, pg);
-								}
+				size_t n = end - start;
+				// reused by batches run on the same thread
+				thread_local std::vector<real_t> pred, label, weight;
+				pred.resize(n);
+				label.resize(n);
+				weight.resize(n);
+				for (size_t i = 0; i < n; ++i) {
+						label[i] = start[i]->label;
+						weight[i] = start[i]->weight;
+				}
+				if (optimizer) {
+						// each sample is learned from right after it is
+						// predicted, so only its gradient is needed here
+						PROFILE_SCOPE(Optimize);
+						optimizer->train(*this, loss, start, end, pred.data());
+				} else {
+						// timed once for the whole batch, as the timer
+						// would cost as much as predicting a sample
+						PROFILE_SCOPE(Predict);
+						for (size_t i = 0; i < n; ++i) {
+								pred[i] = predict(*start[i]) + m_logit_offset;
 						}
-						loss_sum /= 2;
-				} break;
-				case Loss::CrossEntropy: {
+				}
+				*result += loss_and_grad(loss, n, pred.data(), label.data(),
+										 weight.data());
+				for (auto w : weight) {
+						*total_weight += w;
+				}
+				if (optimizer) {
+						size_t nnz = 0, n_touched = 0;
 						for (auto p = start; p < end; ++p) {
-								auto& entry = **p;
-								real_t predicted = predict(entry);
-								real_t y = entry.label > 0 ? 1.0 : -1.0;
-								auto t = std::exp(-y * predicted);
-								loss_sum += std::log1p(t);
-								if (optimizer) {
-										real_t pg = -y * t / (1.0 + t);
-										optimize(*optimizer, entry, pg);
-								}
+								size_t d = (*p)->features.size();
+								nnz += d;
+								n_touched += n_touched_parameters(d);
 						}
-				} break;
-				default: UNREACHABLE("bad loss");
+						profiler::count(profiler::Counter::Samples,
+										end - start);
+						profiler::count(profiler::Counter::NNZ, nnz);
+						profiler::count(profiler::Counter::BytesTouched,
+										n_touched * sizeof(real_t));
 				}
-				*result += loss_sum;
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				thrown = true;
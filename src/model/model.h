@@ -1,7 +1,12 @@
 #pragma once
 
+#include "base/numa.h"
 #include "data/entry.h"
 #include "data/sampler.h"
+#include "loss.h"
+
+#include <functional>
+#include <map>
 
 NAMESPACE_BEGIN
 
@@ -9,15 +14,60 @@ class Sampler;
 class ThreadPool;
 class Optimizer;
 
-enum class Loss {
-		Squared,
-		CrossEntropy,
+// a row-major matrix of parameters interleaved with optimizer extras.
+// each row consists of groups of `stride` columns, of which the first `width`
+// ones are parameters and the rest are extras.
+struct ParameterTable {
+		real_t* data;
+		size_t rows;
+		size_t cols;
+		size_t width;
+		size_t stride;
+		bool by_feature; // whether rows are indexed by feature id
+
+		real_t* row(size_t r) const { return data + r * cols; }
+		// # parameters (excluding extras) of a row
+		size_t row_size() const { return cols / stride * width; }
 };
+
+// ∑ w_i x_i over features of given sample whose ids are less than n, where
+// w_i is the first of row i of a row-major matrix of given # columns.
+// NOTE: features are gathered several at a time where the cpu supports it.
+real_t sparse_dot(const real_t* w,
+				  size_t cols,
+				  size_t n,
+				  const FeatureVector& features);
+
+// re-layout a matrix whose rows are groups of `width` parameters each followed
+// by `n_extras` extras of the same width, to be followed by given extras
+// instead, which are all set to their initial values.
+template <typename M>
+void relayout_extras(M& m,
+					 size_t width,
+					 size_t n_extras,
+					 const std::vector<real_t>& extras) {
+		size_t old_stride = width * (1 + n_extras);
+		size_t stride = width * (1 + extras.size());
+		size_t n_groups = m.cols() / old_stride;
+		M ret(m.rows(), n_groups * stride);
+		for (size_t g = 0; g < n_groups; ++g) {
+				ret.middleCols(g * stride, width) =
+					m.middleCols(g * old_stride, width);
+				for (size_t i = 0; i < extras.size(); ++i) {
+						ret.middleCols(g * stride + (i + 1) * width, width)
+							.fill(extras[i]);
+				}
+		}
+		m = std::move(ret);
+		numa::place(m.data(), m.size() * sizeof(real_t));
+}
+
 class Model {
 	public:
 		static std::unique_ptr<Model> create_LM();
 		static std::unique_ptr<Model> create_FM(size_t k);
-		static std::unique_ptr<Model> create_FFM(size_t k);
+		static std::unique_ptr<Model> create_FFM(size_t k, bool sparse = false);
+		static std::unique_ptr<Model> create_FwFM(size_t k);
 		static std::unique_ptr<Model> create_HOFM(size_t m, size_t k);
 		static std::unique_ptr<Model> from_file(const String& filename);
 
@@ -30,14 +80,40 @@ class Model {
 								std::vector<real_t> extras) = 0;
 		virtual void check_feature_id(size_t id) = 0;
 		virtual void check_field_id(size_t id) = 0;
+		// make room for features/fields of given samples, e.g. those arriving
+		// after initialization. NOTE: not thread-safe.
+		virtual void grow(const Entries& entries);
+		// prepare a deserialized model to continue training on data of
+		// sampler. saved extras are kept if they were saved by the same
+		// optimizer, or started afresh otherwise.
+		void warm_start(Sampler& sampler, const Optimizer& optimizer);
+		// initial values of extras interleaved with parameters
+		const std::vector<real_t>& extras() const { return m_extras; }
+		// name of optimizer whose states the extras are; saved with them.
+		const std::string& optimizer() const { return m_optimizer; }
+		void optimizer(std::string name) { m_optimizer = std::move(name); }
 
 		virtual real_t predict(Entry&) = 0;
+		// prediction as served, corrected by logit offset.
+		real_t calibrated_predict(Entry& entry) {
+				return predict(entry) + m_logit_offset;
+		}
+		// added to raw predictions, i.e. log-odds with log loss, out of
+		// training; log(r) corrects for negatives of training data having
+		// been downsampled at rate r. saved with model.
+		real_t logit_offset() const { return m_logit_offset; }
+		void logit_offset(real_t offset) { m_logit_offset = offset; }
 
 		virtual size_t n_parameters() const = 0;
+		// estimated # parameters (including extras) read or written
+		// when training on a sample with given # non-zero features.
+		virtual size_t n_touched_parameters(size_t nnz) const = 0;
 		// serialize model to a text file
 		virtual void serialize_txt(const String& filename) const = 0;
-		// serialize model to a binary file
-		virtual void serialize(const String& filename) const = 0;
+		// serialize model to a binary file; with extras, states of optimizer
+		// are saved as well so that training can be resumed from the file.
+		virtual void serialize(const String& filename,
+							   bool with_extras = false) const = 0;
 		// deserialize model from a binary file
 		virtual void deserialize(const String& filename) = 0;
 
@@ -48,6 +124,9 @@ class Model {
 		virtual size_t max_feature_id() = 0;
 		virtual size_t max_field_id() { return -1; }
 
+		// all parameters of model, e.g. to be exchanged between processes.
+		virtual std::vector<ParameterTable> parameter_tables() = 0;
+
 		real_t evaluate(Loss loss, Sampler& sampler, ThreadPool& pool) {
 				return run_model(loss, sampler, pool, nullptr);
 		}
@@ -57,18 +136,58 @@ class Model {
 					  ThreadPool& pool) {
 				return run_model(loss, sampler, pool, &optimizer);
 		}
+		// train on at most batch_size samples at a time, calling after_batch
+		// with the samples when all workers are done with them.
+		using BatchCallback = std::function<void(Entries&)>;
+		real_t update(Loss loss,
+					  Optimizer& optimizer,
+					  Sampler& sampler,
+					  ThreadPool& pool,
+					  size_t batch_size,
+					  const BatchCallback& after_batch = nullptr) {
+				return run_model(loss, sampler, pool, &optimizer, batch_size,
+								 after_batch);
+		}
 
 	protected:
 		std::vector<real_t> m_extras;
+		std::string m_optimizer;
+		real_t m_logit_offset = 0;
+
+		// first line of a binary model file: type of model, followed by
+		// space separated key=value pairs of model-wide settings if any.
+		// settings of subclasses are passed in and out as such pairs.
+		using Settings = std::map<std::string, std::string>;
+		void write_header(std::fstream& file,
+						  const char* type,
+						  const Settings& settings = {}) const;
+		void read_header(std::fstream& file,
+						 const char* type,
+						 Settings* settings = nullptr);
+
+		// re-layout parameters for another set of extras.
+		virtual void reset_extras(std::vector<real_t> extras) = 0;
+
+		// apply NUMA placement to parameters right after (re)allocation,
+		// before new rows are first touched.
+		template <typename M>
+		static void place(const M& m) {
+				numa::place(m.data(), m.size() * sizeof(*m.data()));
+		}
 
 	private:
-		real_t run_model(Loss, Sampler&, ThreadPool&, Optimizer* optimizer);
+		real_t run_model(Loss,
+						 Sampler&,
+						 ThreadPool&,
+						 Optimizer* optimizer,
+						 size_t batch_size = -1,
+						 const BatchCallback& after_batch = nullptr);
 		void thread_run_model(Loss loss,
 							  std::shared_ptr<Entry>* start,
 							  std::shared_ptr<Entry>* end,
 							  real_t* result,
+							  real_t* total_weight,
 							  Optimizer* optimizer);
-		virtual void optimize(Optimizer&, Entry&, real_t pg) = 0;
 };
 
 NAMESPACE_END
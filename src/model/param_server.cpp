@@ -0,0 +1,271 @@
+#include "param_server.h"
+#include "base/logger.h"
+#include "base/profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+
+NAMESPACE_BEGIN
+
+using param_server::Message;
+
+namespace {
+
+// call f with pointer to each group of parameters in given row
+template <typename F>
+void for_each_group(const ParameterTable& t, size_t r, F&& f) {
+		auto row = t.row(r);
+		for (size_t c = 0; c + t.stride <= t.cols; c += t.stride) {
+				f(row + c);
+		}
+}
+
+void gather(const ParameterTable& t, size_t r, real_t* out) {
+		for_each_group(t, r, [&](real_t* p) {
+				out = std::copy_n(p, t.width, out);
+		});
+}
+
+void scatter(const ParameterTable& t, size_t r, const real_t* in) {
+		for_each_group(t, r, [&](real_t* p) {
+				std::copy_n(in, t.width, p);
+				in += t.width;
+		});
+}
+
+void send_message(Socket& socket, Message message) {
+		socket.send_value<u32>(u32(message));
+}
+
+} // namespace
+
+struct ParameterServer::Worker {
+		Socket socket;
+		size_t clock = 0; // # pushes in current epoch
+		bool done = false;
+		bool pending = false; // pull not answered yet
+		std::vector<std::vector<u64>> rows; // rows of last push, per table
+		double loss_sum = 0;
+		size_t n_samples = 0;
+};
+
+ParameterServer::ParameterServer(Model& master,
+								 std::vector<Socket> workers,
+								 size_t staleness)
+: m_master(master), m_staleness(staleness) {
+		for (auto& socket : workers) {
+				m_workers.emplace_back().socket = std::move(socket);
+		}
+}
+ParameterServer::~ParameterServer() = default;
+
+size_t ParameterServer::n_workers() const { return m_workers.size(); }
+
+size_t ParameterServer::min_clock() const {
+		size_t ret = -1;
+		for (auto& w : m_workers) {
+				if (!w.done) ret = std::min(ret, w.clock);
+		}
+		return ret;
+}
+
+void ParameterServer::receive_push(Worker& worker) {
+		auto tables = m_master.parameter_tables();
+		std::vector<real_t> deltas;
+		worker.rows.resize(tables.size());
+		for (size_t i = 0; i < tables.size(); ++i) {
+				auto& t = tables[i];
+				auto& rows = worker.rows[i];
+				worker.socket.recv_vector(rows);
+				worker.socket.recv_vector(deltas);
+				size_t row_size = t.row_size();
+				if (deltas.size() != rows.size() * row_size)
+						THROW("malformed push of table %zu", i);
+				auto delta = deltas.data();
+				for (auto r : rows) {
+						if (r >= t.rows) THROW("row %zu out of range", size_t(r));
+						for_each_group(t, r, [&](real_t* p) {
+								for (size_t c = 0; c < t.width; ++c) {
+										p[c] += delta[c];
+								}
+								delta += t.width;
+						});
+				}
+		}
+		++worker.clock;
+		worker.pending = true;
+}
+
+void ParameterServer::reply_pull(Worker& worker) {
+		auto tables = m_master.parameter_tables();
+		std::vector<real_t> values;
+		for (size_t i = 0; i < tables.size(); ++i) {
+				auto& t = tables[i];
+				auto& rows = worker.rows[i];
+				values.resize(rows.size() * t.row_size());
+				auto p = values.data();
+				for (auto r : rows) {
+						gather(t, r, p);
+						p += t.row_size();
+				}
+				worker.socket.send_vector(values);
+		}
+		worker.pending = false;
+}
+
+real_t ParameterServer::run_epoch(int epoch) {
+		for (auto& w : m_workers) {
+				send_message(w.socket, Message::Epoch);
+				w.socket.send_value<i32>(epoch);
+				w.clock = 0;
+				w.done = false;
+				w.pending = false;
+				w.loss_sum = 0;
+				w.n_samples = 0;
+		}
+
+		std::vector<pollfd> fds;
+		std::vector<Worker*> polled;
+		auto all_done = [&] {
+				return std::all_of(m_workers.begin(), m_workers.end(),
+								   [](auto& w) { return w.done; });
+		};
+		while (!all_done()) {
+				fds.clear();
+				polled.clear();
+				for (auto& w : m_workers) {
+						if (w.done || w.pending) continue;
+						fds.push_back({w.socket.fd(), POLLIN, 0});
+						polled.push_back(&w);
+				}
+				ASSERT(!fds.empty()); // the slowest worker is never pending
+				{
+						PROFILE_SCOPE(Sync);
+						if (::poll(fds.data(), fds.size(), -1) < 0) {
+								if (errno == EINTR) continue;
+								THROW("poll failed: %s", std::strerror(errno));
+						}
+				}
+				for (size_t i = 0; i < fds.size(); ++i) {
+						if (!fds[i].revents) continue;
+						auto& w = *polled[i];
+						Message message;
+						if (!w.socket.recv(&message, sizeof(message)))
+								THROW("worker disconnected unexpectedly");
+						switch (message) {
+						case Message::Push: receive_push(w); break;
+						case Message::EpochDone:
+								w.loss_sum = w.socket.recv_value<double>();
+								w.n_samples = w.socket.recv_value<u64>();
+								w.done = true;
+								break;
+						default: THROW("unexpected message from worker");
+						}
+				}
+				size_t bound = min_clock() + m_staleness;
+				for (auto& w : m_workers) {
+						if (w.pending && w.clock <= bound) reply_pull(w);
+				}
+		}
+
+		double loss_sum = 0;
+		size_t n_samples = 0;
+		for (auto& w : m_workers) {
+				loss_sum += w.loss_sum;
+				n_samples += w.n_samples;
+		}
+		return loss_sum / n_samples;
+}
+
+void ParameterServer::stop() {
+		for (auto& w : m_workers) {
+				send_message(w.socket, Message::Stop);
+				w.socket.close();
+		}
+}
+
+ParameterClient::ParameterClient(Model& model, Socket server)
+: m_model(model), m_server(std::move(server)) {
+		for (auto& t : m_model.parameter_tables()) {
+				auto& base = m_base.emplace_back(t.rows * t.row_size());
+				for (size_t r = 0; r < t.rows; ++r) {
+						gather(t, r, base.data() + r * t.row_size());
+				}
+		}
+}
+
+int ParameterClient::wait_epoch() {
+		switch (Message(m_server.recv_value<u32>())) {
+		case Message::Epoch: return m_server.recv_value<i32>();
+		case Message::Stop: return 0;
+		default: THROW("unexpected message from server");
+		}
+}
+
+void ParameterClient::sync(const Entries& batch) {
+		m_feature_ids.clear();
+		for (auto& e : batch) {
+				for (auto& f : e->features) {
+						m_feature_ids.push_back(f.id);
+				}
+		}
+		std::sort(m_feature_ids.begin(), m_feature_ids.end());
+		m_feature_ids.erase(
+			std::unique(m_feature_ids.begin(), m_feature_ids.end()),
+			m_feature_ids.end());
+
+		auto tables = m_model.parameter_tables();
+		std::vector<std::vector<u64>> rows(tables.size());
+		std::vector<real_t> buffer;
+		send_message(m_server, Message::Push);
+		for (size_t i = 0; i < tables.size(); ++i) {
+				auto& t = tables[i];
+				auto& base = m_base[i];
+				size_t row_size = t.row_size();
+				if (base.size() != t.rows * row_size)
+						THROW("parameters grew after training started");
+				if (t.by_feature) {
+						for (auto id : m_feature_ids) {
+								if (id < t.rows) rows[i].push_back(id);
+						}
+				} else {
+						for (size_t r = 0; r < t.rows; ++r) {
+								rows[i].push_back(r);
+						}
+				}
+				buffer.resize(rows[i].size() * row_size);
+				auto p = buffer.data();
+				for (auto r : rows[i]) {
+						gather(t, r, p);
+						for (size_t c = 0; c < row_size; ++c) {
+								p[c] -= base[r * row_size + c];
+						}
+						p += row_size;
+				}
+				m_server.send_vector(rows[i]);
+				m_server.send_vector(buffer);
+		}
+		PROFILE_SCOPE(Sync);
+		for (size_t i = 0; i < tables.size(); ++i) {
+				auto& t = tables[i];
+				size_t row_size = t.row_size();
+				m_server.recv_vector(buffer);
+				ASSERT(buffer.size() == rows[i].size() * row_size);
+				auto p = buffer.data();
+				for (auto r : rows[i]) {
+						scatter(t, r, p);
+						std::copy_n(p, row_size, m_base[i].data() + r * row_size);
+						p += row_size;
+				}
+		}
+}
+
+void ParameterClient::end_epoch(real_t loss_sum, size_t n_samples) {
+		send_message(m_server, Message::EpochDone);
+		m_server.send_value<double>(loss_sum);
+		m_server.send_value<u64>(n_samples);
+}
+
+NAMESPACE_END
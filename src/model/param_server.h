@@ -0,0 +1,74 @@
+#pragma once
+
+#include "base/socket.h"
+#include "model.h"
+
+NAMESPACE_BEGIN
+
+// data-parallel training across processes.
+//
+// each worker trains a replica of the model on a shard of data with its own
+// optimizer state. after every batch it pushes the change of parameters
+// (excluding extras) of rows it touched since last exchange to the parameter
+// server, which accumulates them into the master model, then pulls fresh
+// values of the same rows back.
+//
+// staleness is bounded as in stale synchronous parallel: a worker that has
+// pushed `staleness` more batches than the slowest worker in current epoch
+// waits for its pull until the slowest catches up. 0 makes it synchronous.
+namespace param_server {
+
+enum class Message : u32 {
+		Epoch,     // server -> worker: train an epoch (followed by epoch #)
+		Stop,      // server -> worker: quit
+		Push,      // worker -> server: deltas of rows; answered by values
+		EpochDone, // worker -> server: done with epoch (followed by loss)
+};
+
+} // namespace param_server
+
+class ParameterServer {
+	public:
+		ParameterServer(Model& master,
+						std::vector<Socket> workers,
+						size_t staleness);
+		~ParameterServer();
+
+		size_t n_workers() const;
+		// instruct workers to train an epoch and serve them until all are
+		// done; return mean training loss over all shards.
+		real_t run_epoch(int epoch);
+		// instruct workers to quit.
+		void stop();
+
+	private:
+		struct Worker;
+		Model& m_master;
+		std::vector<Worker> m_workers;
+		size_t m_staleness;
+
+		void receive_push(Worker& worker);
+		void reply_pull(Worker& worker);
+		size_t min_clock() const;
+};
+
+class ParameterClient {
+	public:
+		// model must start with the same parameters as the master
+		ParameterClient(Model& model, Socket server);
+
+		// block until instructed; return epoch to train, or 0 if to stop.
+		int wait_epoch();
+		// push deltas of rows touched by given samples, then pull.
+		void sync(const Entries& batch);
+		void end_epoch(real_t loss_sum, size_t n_samples);
+
+	private:
+		Model& m_model;
+		Socket m_server;
+		// parameters as of last pull, packed by ParameterTable::row_size()
+		std::vector<std::vector<real_t>> m_base;
+		std::vector<u64> m_feature_ids; // scratch
+};
+
+NAMESPACE_END
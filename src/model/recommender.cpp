@@ -0,0 +1,124 @@
+#include "recommender.h"
+#include "base/thread_pool.h"
+#include "fm.h"
+#include "mips_index.h"
+
+#include <algorithm>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+constexpr size_t user_block = 64;   // users scored at a time by a worker
+constexpr size_t item_block = 4096; // items scored at a time, for cache
+
+bool better(const Recommender::Scored& a, const Recommender::Scored& b) {
+		return a.score > b.score || (a.score == b.score && a.item < b.item);
+}
+
+} // namespace
+
+void Recommender::offer(List& heap, size_t k, Scored s) {
+		if (heap.size() < k) {
+				heap.push_back(s);
+				std::push_heap(heap.begin(), heap.end(), better);
+		} else if (better(s, heap.front())) {
+				std::pop_heap(heap.begin(), heap.end(), better);
+				heap.back() = s;
+				std::push_heap(heap.begin(), heap.end(), better);
+		}
+}
+void Recommender::sort(List& heap) {
+		std::sort_heap(heap.begin(), heap.end(), better);
+}
+
+Recommender::Recommender(const FM& fm, const Entries& items) : m_fm(fm) {
+		if (!fm.field_pairs.empty())
+				THROW("scores of FM with masked field pairs do not decompose");
+		RELEASE_ASSERT(items.size() <= Limits<u32>::max());
+		m_items.resize(items.size(), fm.k);
+		m_bias.resize(items.size());
+		for (size_t i = 0; i < items.size(); ++i) {
+				m_bias[i] = side(*items[i], m_items.row(i));
+		}
+}
+
+real_t Recommender::side(const Entry& entry,
+						 Matrix<Dynamic, Dynamic>::RowXpr s) const {
+		auto& fm = m_fm;
+		s.setZero();
+		real_t self = 0; // ∑ |v_j x_j|^2
+		for (auto& f : entry.features) {
+				if (f.id >= fm.n) continue;
+				auto vx = fm.get_v(f.id) * f.value;
+				s += vx;
+				self += vx.squaredNorm();
+		}
+		real_t linear = sparse_dot(fm.w.data(), fm.w.cols(), fm.n,
+								   entry.features);
+		return linear + (s.squaredNorm() - self) / 2;
+}
+
+std::vector<Recommender::List> Recommender::recommend(const Entries& users,
+													  size_t k,
+													  ThreadPool& pool) const {
+		std::vector<List> ret(users.size());
+		k = std::min(k, n_items());
+		if (k == 0) return ret;
+		// global bias and calibration are the same for all, so are added
+		// to that of users
+		real_t offset = m_fm.b.coeff(0) + m_fm.logit_offset();
+		size_t n_blocks = (users.size() + user_block - 1) / user_block;
+		pool.parallel_for(n_blocks, 1, [&](size_t block) {
+				thread_local Matrix<Dynamic, Dynamic> U, Y;
+				size_t begin = block * user_block;
+				size_t end = std::min(begin + user_block, users.size());
+				size_t n = end - begin;
+				U.resize(n, m_fm.k);
+				std::vector<real_t> bias(n);
+				for (size_t u = 0; u < n; ++u) {
+						bias[u] = side(*users[begin + u], U.row(u)) + offset;
+						ret[begin + u].reserve(k);
+				}
+				for (size_t first = 0; first < n_items(); first += item_block) {
+						size_t m = std::min(item_block, n_items() - first);
+						auto I = m_items.middleRows(first, m);
+						Y.noalias() = U * I.transpose();
+						for (size_t u = 0; u < n; ++u) {
+								auto& heap = ret[begin + u];
+								for (size_t i = 0; i < m; ++i) {
+										real_t y = bias[u] + m_bias[first + i]
+											+ Y(u, i);
+										offer(heap, k, {u32(first + i), y});
+								}
+						}
+				}
+				for (size_t u = begin; u < end; ++u) {
+						sort(ret[u]);
+				}
+		});
+		return ret;
+}
+
+std::vector<Recommender::List> Recommender::recommend(const Entries& users,
+													  size_t k,
+													  ThreadPool& pool,
+													  const MipsIndex& index,
+													  size_t n_probe) const {
+		RELEASE_ASSERT(index.n_items() == n_items());
+		std::vector<List> ret(users.size());
+		k = std::min(k, n_items());
+		if (k == 0) return ret;
+		real_t offset = m_fm.b.coeff(0) + m_fm.logit_offset();
+		pool.parallel_for(users.size(), user_block, [&](size_t u) {
+				thread_local Matrix<Dynamic, Dynamic> s;
+				s.resize(1, m_fm.k);
+				real_t bias = side(*users[u], s.row(0)) + offset;
+				ret[u].reserve(k);
+				index.search(s.data(), bias, k, n_probe, ret[u]);
+				sort(ret[u]);
+		});
+		return ret;
+}
+
+NAMESPACE_END
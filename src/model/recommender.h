@@ -0,0 +1,60 @@
+#pragma once
+
+#include "base/algebra.h"
+#include "data/entry.h"
+
+#include <vector>
+
+NAMESPACE_BEGIN
+
+class FM;
+class MipsIndex;
+class ThreadPool;
+
+// top-K items of users by an FM, of which a sample is features of a user
+// together with those of an item. scores of FM then decompose into
+// y(u, i) = bias_u + bias_i + <s_u, s_i>, where s_? = ∑ v_j x_j and bias_?
+// is the linear part and interactions within features of either side, so
+// that scores of a block of users with all items are a matrix product.
+// NOTE: samples must not have been normalized as a whole, nor fields masked.
+class Recommender {
+	public:
+		Recommender(const FM& fm, const Entries& items);
+
+		struct Scored {
+				u32 item; // index of item as given
+				real_t score;
+		};
+		using List = std::vector<Scored>;
+
+		size_t n_items() const { return m_items.rows(); }
+		const Matrix<Dynamic, Dynamic>& items() const { return m_items; }
+		const Vector<Dynamic>& bias() const { return m_bias; }
+		// top k items of each user, in descending order of score.
+		std::vector<List>
+		recommend(const Entries& users, size_t k, ThreadPool& pool) const;
+		// approximately, among items of n_probe lists of index nearest to
+		// each user; index must be of items().
+		std::vector<List> recommend(const Entries& users,
+									size_t k,
+									ThreadPool& pool,
+									const MipsIndex& index,
+									size_t n_probe) const;
+
+		// keep s if it is among top k of heap, a min-heap on score so that
+		// the worst of top k is at front.
+		static void offer(List& heap, size_t k, Scored s);
+		// turn heap into a list in descending order of score.
+		static void sort(List& heap);
+
+	private:
+		const FM& m_fm;
+		Matrix<Dynamic, Dynamic> m_items; // row i is s_i
+		Vector<Dynamic> m_bias;           // bias_i
+
+		// bias and s of features of either side
+		real_t side(const Entry& entry, Matrix<Dynamic, Dynamic>::RowXpr s)
+			const;
+};
+
+NAMESPACE_END
@@ -1,23 +1,123 @@
 #include "base/serial.h"
 #include "base/io_util.h"
+#include "base/logger.h"
 #include "ffm.h"
 #include "fm.h"
+#include "fwfm.h"
 #include "hofm.h"
 #include "lm.h"
 
+#include <sstream>
+
 NAMESPACE_BEGIN
 
+namespace {
+
+// extras are saved after all parameters, so that a file with them can still
+// be read as a plain model by older versions. they are preceded by name of
+// the optimizer, whose states they are.
+void serialize_extras(std::fstream& file,
+					  const std::string& optimizer,
+					  const std::vector<real_t>& extras) {
+		std::vector<char> name(optimizer.begin(), optimizer.end());
+		serialize_to(file, name);
+		serialize_to(file, extras);
+}
+// return whether extras are saved.
+bool deserialize_extras(std::fstream& file,
+						std::string& optimizer,
+						std::vector<real_t>& extras) {
+		optimizer.clear();
+		extras.clear();
+		if (file.peek() == EOF) return false;
+		std::vector<char> name;
+		deserialize_from(file, name);
+		optimizer.assign(name.begin(), name.end());
+		deserialize_from(file, extras);
+		return true;
+}
+
+// write extras of each group of `width` parameters in m, see relayout_extras().
+template <typename M>
+void write_extras(std::fstream& file, const M& m, size_t width, size_t n) {
+		size_t stride = width * (1 + n);
+		for (index_t r = 0; r < m.rows(); ++r) {
+				for (index_t c = 0; c < m.cols(); ++c) {
+						if (size_t(c) % stride >= width)
+								serialize_to(file, m.coeff(r, c));
+				}
+		}
+}
+// m holds only parameters when called; extras are interleaved back.
+template <typename M>
+void read_extras(std::fstream& file,
+				 M& m,
+				 size_t width,
+				 const std::vector<real_t>& extras) {
+		relayout_extras(m, width, 0, extras);
+		size_t stride = width * (1 + extras.size());
+		for (index_t r = 0; r < m.rows(); ++r) {
+				for (index_t c = 0; c < m.cols(); ++c) {
+						if (size_t(c) % stride >= width)
+								deserialize_from(file, m.coeffRef(r, c));
+				}
+		}
+}
+
+} // namespace
+
+void Model::write_header(std::fstream& file,
+						 const char* type,
+						 const Settings& settings) const {
+		file << type;
+		if (m_logit_offset != 0) {
+				file << String::printf(" logit_offset=%.9g", m_logit_offset);
+		}
+		for (auto& [key, value] : settings) {
+				file << ' ' << key << '=' << value;
+		}
+		file << '\n';
+}
+void Model::read_header(std::fstream& file,
+						const char* type,
+						Settings* settings) {
+		std::string line;
+		std::getline(file, line);
+		std::istringstream words(line);
+		std::string word;
+		words >> word;
+		if (word != type)
+				THROW("expected %s model, got %s", type, word.c_str());
+		m_logit_offset = 0;
+		while (words >> word) {
+				auto eq = word.find('=');
+				auto key = word.substr(0, eq);
+				if (key == "logit_offset" && eq != std::string::npos) {
+						m_logit_offset = std::stof(word.substr(eq + 1));
+				} else if (settings && eq != std::string::npos) {
+						(*settings)[key] = word.substr(eq + 1);
+				} else {
+						logger::warn("unknown setting of model: {}", word);
+				}
+		}
+}
+
 std::unique_ptr<Model> Model::from_file(const String& filename) {
 		std::unique_ptr<Model> ret;
 		auto file =
 			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
-		auto model = peek_first_line(*file);
+		auto header = peek_first_line(*file);
+		auto model = header.substr(0, header.find(' '));
 		if (model == "LM") {
 				ret.reset(new LM());
 		} else if (model == "FM") {
 				ret.reset(new FM(0));
 		} else if (model == "FFM") {
 				ret.reset(new FFM(0));
+		} else if (model == "SFFM") {
+				ret.reset(new FFM(0, true));
+		} else if (model == "FwFM") {
+				ret.reset(new FwFM(0));
 		} else if (model == "HOFM") {
 				ret.reset(new HOFM(0, 0));
 		} else {
@@ -36,23 +136,29 @@ void LM::serialize_txt(const String& filename) const {
 		}
 }
 
-void LM::serialize(const String& filename) const {
+void LM::serialize(const String& filename, bool with_extras) const {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
-		*file << "LM\n";
+		write_header(*file, "LM");
 		serialize_matrix(*file, b.col(0));
 		serialize_matrix(*file, w.col(0));
+		if (!with_extras) return;
+		serialize_extras(*file, m_optimizer, m_extras);
+		write_extras(*file, b, 1, m_extras.size());
+		write_extras(*file, w, 1, m_extras.size());
 }
 
 void LM::deserialize(const String& filename) {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
-		String model;
-		*file >> model;
-		ASSERT(model == "LM");
+		read_header(*file, "LM");
 		deserialize_matrix(*file, b);
 		deserialize_matrix(*file, w);
 		n = w.rows();
+		if (deserialize_extras(*file, m_optimizer, m_extras)) {
+				read_extras(*file, b, 1, m_extras);
+				read_extras(*file, w, 1, m_extras);
+		}
 }
 
 void FM::serialize_txt(const String& filename) const {
@@ -66,26 +172,42 @@ void FM::serialize_txt(const String& filename) const {
 		}
 }
 
-void FM::serialize(const String& filename) const {
+void FM::serialize(const String& filename, bool with_extras) const {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
-		*file << "FM\n";
+		Settings settings;
+		if (!field_pairs.empty())
+				settings["field_pairs"] = field_pairs.to_string();
+		write_header(*file, "FM", settings);
 		serialize_matrix(*file, b.col(0));
 		serialize_matrix(*file, w.col(0));
 		serialize_matrix(*file, v.leftCols(k));
+		if (!with_extras) return;
+		serialize_extras(*file, m_optimizer, m_extras);
+		write_extras(*file, b, 1, m_extras.size());
+		write_extras(*file, w, 1, m_extras.size());
+		write_extras(*file, v, k, m_extras.size());
 }
 
 void FM::deserialize(const String& filename) {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
-		String model;
-		*file >> model;
-		ASSERT(model == "FM");
+		Settings settings;
+		read_header(*file, "FM", &settings);
+		auto pairs = settings.find("field_pairs");
+		field_pairs = FieldPairs();
+		if (pairs != settings.end())
+				field_pairs = FieldPairs::parse(pairs->second);
 		deserialize_matrix(*file, b);
 		deserialize_matrix(*file, w);
 		deserialize_matrix(*file, v);
 		n = w.rows();
 		k = v.cols();
+		if (deserialize_extras(*file, m_optimizer, m_extras)) {
+				read_extras(*file, b, 1, m_extras);
+				read_extras(*file, w, 1, m_extras);
+				read_extras(*file, v, k, m_extras);
+		}
 }
 void FFM::serialize_txt(const String& filename) const {
 		auto file = must_open_file(filename.c_str(), std::ios::out);
@@ -93,47 +215,187 @@ void FFM::serialize_txt(const String& filename) const {
 		for (index_t i = 0; i < w.rows(); ++i) {
 				*file << "w_" << i << ": " << w.row(i)[0] << std::endl;
 		}
+		if (sparse) {
+				for (auto key : sorted_block_keys()) {
+						*file << "v_" << (key >> 32) << "_f" << u32(key) << ": "
+							  << get_v(key >> 32, u32(key)) << std::endl;
+				}
+				return;
+		}
 		for (index_t i = 0; i < v.rows(); ++i) {
 				for (size_t j = 0; j < n_f; ++j) {
+						if (field_slot[j] == no_slot) continue;
 						*file << "v_" << i << "_f" << j << ": " << get_v(i, j)
 							  << std::endl;
 				}
 		}
 }
 
-void FFM::serialize(const String& filename) const {
+void FFM::serialize(const String& filename, bool with_extras) const {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
-		*file << "FFM\n";
+		Settings settings;
+		if (!field_pairs.empty())
+				settings["field_pairs"] = field_pairs.to_string();
+		write_header(*file, sparse ? "SFFM" : "FFM", settings);
 		serialize_matrix(*file, b.col(0));
 		serialize_matrix(*file, w.col(0));
 		serialize_to(*file, n_f);
+		if (sparse) {
+				// (key, v_i_fj) of observed pairs
+				auto keys = sorted_block_keys();
+				serialize_to(*file, k);
+				serialize_to(*file, keys.size());
+				for (auto key : keys) {
+						serialize_to(*file, key);
+						auto v = get_v(key >> 32, u32(key));
+						for (index_t c = 0; c < index_t(k); ++c) {
+								serialize_to(*file, v.coeff(c));
+						}
+				}
+				if (!with_extras) return;
+				serialize_extras(*file, m_optimizer, m_extras);
+				write_extras(*file, b, 1, m_extras.size());
+				write_extras(*file, w, 1, m_extras.size());
+				size_t n_extras = k * m_extras.size();
+				for (auto key : keys) {
+						auto extras = block(key >> 32, u32(key)) + k;
+						for (size_t c = 0; c < n_extras; ++c) {
+								serialize_to(*file, extras[c]);
+						}
+				}
+				return;
+		}
 
 		// TODO: hacky
 		serialize_to(*file, n);
-		serialize_to(*file, n_f * k);
+		serialize_to(*file, n_slots * k);
 		for (index_t r = 0; r < n; ++r) {
-				for (size_t f = 0; f < n_f; ++f) {
+				for (size_t f = 0; f < n_slots; ++f) {
 						index_t base = f * k * (1 + m_extras.size());
 						for (index_t c = base; c < base + k; ++c) {
 								serialize_to(*file, v.coeff(r, c));
 						}
 				}
 		}
+		if (!with_extras) return;
+		serialize_extras(*file, m_optimizer, m_extras);
+		write_extras(*file, b, 1, m_extras.size());
+		write_extras(*file, w, 1, m_extras.size());
+		write_extras(*file, v, k, m_extras.size());
 }
 void FFM::deserialize(const String& filename) {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
-		String model;
-		*file >> model;
-		ASSERT(model == "FFM");
+		Settings settings;
+		read_header(*file, sparse ? "SFFM" : "FFM", &settings);
+		auto pairs = settings.find("field_pairs");
+		field_pairs = FieldPairs();
+		if (pairs != settings.end())
+				field_pairs = FieldPairs::parse(pairs->second);
+		m_extras.clear();
 		deserialize_matrix(*file, b);
 		deserialize_matrix(*file, w);
 		deserialize_from(*file, n_f);
-		for (size_t f = 0; f < n_f; ++f) {}
+		n = w.rows();
+		field_slot.clear();
+		n_slots = 0;
+		assign_slots(n_f);
+		if (sparse) {
+				size_t n_keys;
+				deserialize_from(*file, k);
+				deserialize_from(*file, n_keys);
+				// blocks are allocated once width with extras is known
+				std::vector<u64> keys(n_keys);
+				Matrix<Dynamic, Dynamic> values(n_keys, k);
+				for (size_t i = 0; i < n_keys; ++i) {
+						deserialize_from(*file, keys[i]);
+						for (index_t c = 0; c < index_t(k); ++c) {
+								deserialize_from(*file, values(i, c));
+						}
+				}
+				bool has_extras =
+					deserialize_extras(*file, m_optimizer, m_extras);
+				if (has_extras) {
+						read_extras(*file, b, 1, m_extras);
+						read_extras(*file, w, 1, m_extras);
+						read_extras(*file, values, k, m_extras);
+				}
+				chunks.clear();
+				block_index.clear();
+				n_blocks = 0;
+				zero_block.setZero(k * (1 + m_extras.size()));
+				for (size_t i = 0; i < n_keys; ++i) {
+						auto p = block(keys[i] >> 32, u32(keys[i]));
+						std::copy_n(values.row(i).data(), values.cols(), p);
+				}
+				return;
+		}
 		deserialize_matrix(*file, v);
+		if (n_slots) k = v.cols() / n_slots;
+		if (deserialize_extras(*file, m_optimizer, m_extras)) {
+				read_extras(*file, b, 1, m_extras);
+				read_extras(*file, w, 1, m_extras);
+				read_extras(*file, v, k, m_extras);
+		}
+}
+
+void FwFM::serialize_txt(const String& filename) const {
+		auto file = must_open_file(filename.c_str(), std::ios::out);
+		*file << "bias: " << b[0] << std::endl;
+		for (index_t i = 0; i < w.rows(); ++i) {
+				*file << "w_" << i << ": " << w.row(i)[0] << std::endl;
+		}
+		for (index_t i = 0; i < v.rows(); ++i) {
+				*file << "v_" << i << ": " << v.row(i).head(k) << std::endl;
+		}
+		for (size_t f = 0; f < n_f; ++f) {
+				for (size_t g = f; g < n_f; ++g) {
+						*file << "r_f" << f << "_f" << g << ": " << get_r(f, g)
+							  << std::endl;
+				}
+		}
+}
+
+void FwFM::serialize(const String& filename, bool with_extras) const {
+		auto file =
+			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
+		write_header(*file, "FwFM");
+		serialize_matrix(*file, b.col(0));
+		serialize_matrix(*file, w.col(0));
+		serialize_matrix(*file, v.leftCols(k));
+		Matrix<Dynamic, Dynamic> weights(n_f, n_f);
+		for (size_t f = 0; f < n_f; ++f) {
+				for (size_t g = 0; g < n_f; ++g) {
+						weights(f, g) = get_r(f, g);
+				}
+		}
+		serialize_matrix(*file, weights);
+		if (!with_extras) return;
+		serialize_extras(*file, m_optimizer, m_extras);
+		write_extras(*file, b, 1, m_extras.size());
+		write_extras(*file, w, 1, m_extras.size());
+		write_extras(*file, v, k, m_extras.size());
+		write_extras(*file, r, 1, m_extras.size());
+}
+
+void FwFM::deserialize(const String& filename) {
+		auto file =
+			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
+		read_header(*file, "FwFM");
+		deserialize_matrix(*file, b);
+		deserialize_matrix(*file, w);
+		deserialize_matrix(*file, v);
+		deserialize_matrix(*file, r);
 		n = w.rows();
-		k = v.cols() / n_f;
+		n_f = r.rows();
+		k = v.cols();
+		if (deserialize_extras(*file, m_optimizer, m_extras)) {
+				read_extras(*file, b, 1, m_extras);
+				read_extras(*file, w, 1, m_extras);
+				read_extras(*file, v, k, m_extras);
+				read_extras(*file, r, 1, m_extras);
+		}
 }
 
 void HOFM::serialize_txt(const String& filename) const {
@@ -151,24 +413,29 @@ void HOFM::serialize_txt(const String& filename) const {
 		}
 }
 
-void HOFM::serialize(const String& filename) const {
+void HOFM::serialize(const String& filename, bool with_extras) const {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::out | std::ios::binary);
-		*file << "HOFM\n";
+		write_header(*file, "HOFM");
 		serialize_matrix(*file, b.col(0));
 		serialize_matrix(*file, w.col(0));
 		serialize_to(*file, v.size());
 		for (auto& p : v) {
 				serialize_matrix(*file, p.leftCols(k));
 		}
+		if (!with_extras) return;
+		serialize_extras(*file, m_optimizer, m_extras);
+		write_extras(*file, b, 1, m_extras.size());
+		write_extras(*file, w, 1, m_extras.size());
+		for (auto& p : v) {
+				write_extras(*file, p, k, m_extras.size());
+		}
 }
 
 void HOFM::deserialize(const String& filename) {
 		auto file =
 			must_open_file(filename.c_str(), std::ios::in | std::ios::binary);
-		String model;
-		*file >> model;
-		ASSERT(model == "HOFM");
+		read_header(*file, "HOFM");
 		deserialize_matrix(*file, b);
 		deserialize_matrix(*file, w);
 		size_t sz;
@@ -180,6 +447,13 @@ void HOFM::deserialize(const String& filename) {
 		}
 		n = w.rows();
 		k = v[0].cols();
+		if (deserialize_extras(*file, m_optimizer, m_extras)) {
+				read_extras(*file, b, 1, m_extras);
+				read_extras(*file, w, 1, m_extras);
+				for (auto& p : v) {
+						read_extras(*file, p, k, m_extras);
+				}
+		}
 }
 
 NAMESPACE_END
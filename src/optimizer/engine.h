@@ -0,0 +1,93 @@
+#pragma once
+
+#include "model/ffm.h"
+#include "model/fm.h"
+#include "model/fwfm.h"
+#include "model/hofm.h"
+#include "model/lm.h"
+#include "optimizer.h"
+
+#include <type_traits>
+#include <typeinfo>
+
+NAMESPACE_BEGIN
+
+// training loop of an optimizer of type O on a model of type M under loss L.
+// calls are qualified by exact types, so that neither predict nor optimize
+// is dispatched virtually, and optimize, defined in the same translation
+// unit, is inlined along with the loss gradient into the loop.
+template <Loss L, typename O, typename M>
+void fused_train(const O& optimizer,
+				 M& model,
+				 std::shared_ptr<Entry>* start,
+				 std::shared_ptr<Entry>* end,
+				 real_t* pred) {
+		for (auto p = start; p < end; ++p, ++pred) {
+				auto& entry = **p;
+				*pred = model.M::predict(entry);
+				real_t pg = loss_grad(L, *pred, entry.label, entry.weight);
+				optimizer.O::optimize(model, entry, pg);
+		}
+}
+
+// select the instance of fused_train for given model and loss.
+template <typename O, typename M>
+void fused_train(const O& optimizer,
+				 M& model,
+				 Loss loss,
+				 std::shared_ptr<Entry>* start,
+				 std::shared_ptr<Entry>* end,
+				 real_t* pred) {
+		switch (loss) {
+		case Loss::Squared:
+				return fused_train<Loss::Squared>(optimizer, model, start, end,
+												  pred);
+		case Loss::CrossEntropy:
+				return fused_train<Loss::CrossEntropy>(optimizer, model, start,
+													   end, pred);
+		case Loss::Hinge:
+				return fused_train<Loss::Hinge>(optimizer, model, start, end,
+												pred);
+		case Loss::Poisson:
+				return fused_train<Loss::Poisson>(optimizer, model, start, end,
+												  pred);
+		case Loss::Huber:
+				return fused_train<Loss::Huber>(optimizer, model, start, end,
+												pred);
+		}
+		UNREACHABLE("bad loss");
+}
+template <typename O>
+void fused_train(const O& optimizer,
+				 Model& model,
+				 Loss loss,
+				 std::shared_ptr<Entry>* start,
+				 std::shared_ptr<Entry>* end,
+				 real_t* pred) {
+		// exact types only; a subclass may have overridden predict
+		auto dispatch = [&](auto* m) {
+				using M = std::remove_pointer_t<decltype(m)>;
+				if (typeid(model) != typeid(M)) return false;
+				fused_train(optimizer, static_cast<M&>(model), loss, start, end,
+							pred);
+				return true;
+		};
+		if (dispatch((LM*)nullptr) || dispatch((FM*)nullptr)
+			|| dispatch((FFM*)nullptr) || dispatch((FwFM*)nullptr)
+			|| dispatch((HOFM*)nullptr))
+				return;
+		UNREACHABLE("bad model: %s", typeid(model).name());
+}
+
+// define O::train with the fused loops above, in the translation unit where
+// optimize of O is defined.
+#define DEFINE_FUSED_TRAIN(O)                                                  \
+		void O::train(Model& model,                                            \
+					  Loss loss,                                               \
+					  std::shared_ptr<Entry>* start,                           \
+					  std::shared_ptr<Entry>* end,                             \
+					  real_t* pred) const {                                    \
+				fused_train(*this, model, loss, start, end, pred);             \
+		}
+
+NAMESPACE_END
@@ -1,7 +1,9 @@
 #include "optimizer.h"
+#include "engine.h"
 
 #include "model/ffm.h"
 #include "model/fm.h"
+#include "model/fwfm.h"
 #include "model/hofm.h"
 #include "model/lm.h"
 
@@ -21,61 +23,66 @@ void AdaGrad::optimize(LM& lm, Entry& entry, real_t pg) const {
 				lm.check_feature_id(f.id);
 				real_t& w = lm.w.row(f.id).coeffRef(0);
 				real_t& G = lm.w.row(f.id).coeffRef(1);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				G += g * g;
 				w -= m_learning_rate * g / std::sqrt(G);
 		}
 }
 
 void AdaGrad::optimize(FM& fm, Entry& entry, real_t pg) const {
-		auto s = fm.allocate_s();
-
 		optimize_bias(fm.b, pg, m_learning_rate);
 
 		for (const auto& f : entry.features) {
 				fm.check_feature_id(f.id);
 				real_t& w = fm.w.row(f.id).coeffRef(0);
 				real_t& G = fm.w.row(f.id).coeffRef(1);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				G += g * g;
 				w -= m_learning_rate * g / std::sqrt(G);
-				s += fm.v.row(f.id).head(fm.k) * f.normalized_value;
-		}
-		for (const auto& f : entry.features) {
-				fm.check_feature_id(f.id);
-				auto v = fm.v.row(f.id).head(fm.k);
-				auto G = fm.v.row(f.id).tail(fm.k);
-				auto g = m_lambda_r * v + pg * (s - v * f.normalized_value);
-				G += g.cwiseProduct(g);
-				v -= m_learning_rate
-					* g.cwiseProduct(G.cwiseSqrt().cwiseInverse());
 		}
+		auto& P = fm.partner_sums(entry);
+		with_fixed_size(fm.k, [&](auto size) {
+				constexpr int K = decltype(size)::value;
+				for (size_t i = 0; i < entry.features.size(); ++i) {
+						auto& f = entry.features[i];
+						fm.check_feature_id(f.id);
+						auto v = fm.get_v<K>(f.id);
+						auto G = fm.get_v<K>(f.id, 1);
+						auto g = m_lambda_r * v + pg * P.row(i).head<K>(fm.k);
+						G += g.cwiseProduct(g);
+						v -= m_learning_rate
+							* g.cwiseProduct(G.cwiseSqrt().cwiseInverse());
+				}
+		});
 }
 
 void AdaGrad::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		real_t inv_norm2 = entry.get_inv_norm2();
 
 		optimize_bias(ffm.b, pg, m_learning_rate);
 
+		bool aggregated = ffm.aggregated(entry);
 		for (auto it1 = features.begin(); it1 != features.end(); ++it1) {
 				auto& f1 = *it1;
 				ffm.check_feature_id(f1.id);
 				ffm.check_field_id(f1.field_id);
 				real_t& w = ffm.w.row(f1.id).coeffRef(0);
 				real_t& G = ffm.w.row(f1.id).coeffRef(1);
-				real_t g = m_lambda_r * w + pg * f1.normalized_value;
+				real_t g = m_lambda_r * w + pg * f1.value;
 				G += g * g;
 				w -= m_learning_rate * g / std::sqrt(G);
+				if (aggregated) continue;
 				for (auto it2 = it1 + 1; it2 != features.end(); ++it2) {
 						auto& f2 = *it2;
 						ffm.check_feature_id(f2.id);
 						ffm.check_field_id(f2.field_id);
+						if (!ffm.field_pairs(f1.field_id, f2.field_id))
+								continue;
 						auto v_i_fj = ffm.get_v(f1.id, f2.field_id);
 						auto v_j_fi = ffm.get_v(f2.id, f1.field_id);
 						auto G_i = ffm.get_v(f1.id, f2.field_id, 1);
 						auto G_j = ffm.get_v(f2.id, f1.field_id, 1);
-						auto pgx = pg * f1.value * f2.value * inv_norm2;
+						auto pgx = pg * f1.value * f2.value;
 						auto g_i = m_lambda_r * v_i_fj + pgx * v_j_fi;
 						auto g_j = m_lambda_r * v_j_fi + pgx * v_i_fj;
 						G_i += g_i.cwiseProduct(g_i);
@@ -86,11 +93,54 @@ void AdaGrad::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 							* g_j.cwiseProduct(G_j.cwiseSqrt().cwiseInverse());
 				}
 		}
+		if (!aggregated) return;
+		ffm.aggregated_gradient(
+			entry, pg, [&](index_t id, index_t field, Vector<Dynamic>& g) {
+				auto v = ffm.get_v(id, field);
+				auto G = ffm.get_v(id, field, 1);
+				g += m_lambda_r * v;
+				G += g.cwiseProduct(g);
+				v -= m_learning_rate
+					* g.cwiseProduct(G.cwiseSqrt().cwiseInverse());
+			});
+}
+
+void AdaGrad::optimize(FwFM& fwfm, Entry& entry, real_t pg) const {
+		optimize_bias(fwfm.b, pg, m_learning_rate);
+
+		for (const auto& f : entry.features) {
+				fwfm.check_feature_id(f.id);
+				fwfm.check_field_id(f.field_id);
+				real_t& w = fwfm.w.row(f.id).coeffRef(0);
+				real_t& G = fwfm.w.row(f.id).coeffRef(1);
+				real_t g = m_lambda_r * w + pg * f.value;
+				G += g * g;
+				w -= m_learning_rate * g / std::sqrt(G);
+		}
+
+		auto& sums = fwfm.sums(entry, true);
+		fwfm.field_weight_gradient(
+			sums, pg, [&](index_t a, index_t b, real_t g_r) {
+				real_t& r = fwfm.get_r(a, b);
+				real_t& G = fwfm.get_r(a, b, 1);
+				real_t g = m_lambda_r * r + g_r;
+				G += g * g;
+				r -= m_learning_rate * g / std::sqrt(G);
+			});
+		for (size_t i = 0; i < entry.features.size(); ++i) {
+				auto& f = entry.features[i];
+				fwfm.check_feature_id(f.id);
+				auto v = fwfm.v.row(f.id).head(fwfm.k);
+				auto G = fwfm.v.row(f.id).tail(fwfm.k);
+				auto g = m_lambda_r * v + pg * f.value * sums.P.row(i);
+				G += g.cwiseProduct(g);
+				v -= m_learning_rate
+					* g.cwiseProduct(G.cwiseSqrt().cwiseInverse());
+		}
 }
 
 void AdaGrad::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		size_t d = features.size();
 		size_t k = hofm.k;
 
 		optimize_bias(hofm.b, pg, m_learning_rate);
@@ -99,16 +149,17 @@ void AdaGrad::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 				hofm.check_feature_id(f.id);
 				real_t& w = hofm.w.row(f.id).coeffRef(0);
 				real_t& G = hofm.w.row(f.id).coeffRef(1);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				G += g * g;
 				w -= m_learning_rate * g / std::sqrt(G);
 		}
 
+		auto& dp = hofm.get_dp(entry, true);
 		for (size_t m = 2; m <= hofm.order; ++m) {
-				auto a = hofm.get_dp_eval(entry, m);
-				auto a_adj = hofm.get_dp_grad(entry, m);
-				for (size_t j = 1; j <= d; ++j) {
-						auto& f = features[j - 1];
+				auto& a = dp.a[m - 2];
+				auto& a_adj = dp.a_adj[m - 2];
+				for (size_t j = 1; j <= dp.d; ++j) {
+						auto& f = features[dp.index[j - 1]];
 						auto p = hofm.get_p(m, f.id);
 						auto G = hofm.get_p(m, f.id, 1);
 						auto a_adj_j = a_adj.block(1, j * k, m, k);
@@ -121,8 +172,11 @@ void AdaGrad::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 							* g.cwiseProduct(G.cwiseSqrt().cwiseInverse());
 				}
 		}
+		dp.invalidate();
 }
 
 std::vector<real_t> AdaGrad::extras() const { return {1}; }
 
+DEFINE_FUSED_TRAIN(AdaGrad)
+
 NAMESPACE_END
@@ -1,7 +1,9 @@
 #include "optimizer.h"
+#include "engine.h"
 
 #include "model/ffm.h"
 #include "model/fm.h"
+#include "model/fwfm.h"
 #include "model/hofm.h"
 #include "model/lm.h"
 
@@ -43,7 +45,7 @@ void AdamUnbiased::optimize(LM& lm, Entry& entry, real_t pg) const {
 				real_t& w = lm.w.row(f.id).coeffRef(0);
 				real_t& M = lm.w.row(f.id).coeffRef(1);
 				real_t& V = lm.w.row(f.id).coeffRef(2);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				M = MIX(M, g, m_beta_1);
 				V = MIX(V, g * g, m_beta_2);
 				real_t Mt = M / (1 - m_beta_1_pow);
@@ -53,8 +55,6 @@ void AdamUnbiased::optimize(LM& lm, Entry& entry, real_t pg) const {
 }
 
 void AdamUnbiased::optimize(FM& fm, Entry& entry, real_t pg) const {
-		auto s = fm.allocate_s();
-
 		optimize_bias(fm.b, pg, m_learning_rate, m_beta_1, m_beta_2,
 					  m_beta_1_pow, m_beta_2_pow, Epsilon);
 
@@ -63,37 +63,40 @@ void AdamUnbiased::optimize(FM& fm, Entry& entry, real_t pg) const {
 				real_t& w = fm.w.row(f.id).coeffRef(0);
 				real_t& M = fm.w.row(f.id).coeffRef(1);
 				real_t& V = fm.w.row(f.id).coeffRef(2);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				M = MIX(M, g, m_beta_1);
 				V = MIX(V, g * g, m_beta_2);
 				real_t Mt = M / (1 - m_beta_1_pow);
 				real_t Vt = V / (1 - m_beta_2_pow);
 				w -= m_learning_rate * Mt / std::sqrt(Vt + Epsilon);
-				s += fm.v.row(f.id).head(fm.k) * f.normalized_value;
-		}
-		for (const auto& f : entry.features) {
-				fm.check_feature_id(f.id);
-				auto v = fm.v.row(f.id).head(fm.k);
-				auto M = fm.v.row(f.id).segment(fm.k, fm.k);
-				auto V = fm.v.row(f.id).tail(fm.k);
-				auto g = m_lambda_r * v + pg * (s - v * f.normalized_value);
-				M = MIX(M, g, m_beta_1);
-				V = MIX(V, g.cwiseProduct(g), m_beta_2);
-				auto Mt = M / (1 - m_beta_1_pow);
-				auto Vt = V / (1 - m_beta_2_pow);
-				v.array() -= m_learning_rate
-					* Mt.array().cwiseProduct(
-						(Vt.array() + Epsilon).cwiseSqrt().cwiseInverse());
 		}
+		auto& P = fm.partner_sums(entry);
+		with_fixed_size(fm.k, [&](auto size) {
+				constexpr int K = decltype(size)::value;
+				for (size_t i = 0; i < entry.features.size(); ++i) {
+						auto& f = entry.features[i];
+						fm.check_feature_id(f.id);
+						auto v = fm.get_v<K>(f.id);
+						auto M = fm.get_v<K>(f.id, 1);
+						auto V = fm.get_v<K>(f.id, 2);
+						auto g = m_lambda_r * v + pg * P.row(i).head<K>(fm.k);
+						M = MIX(M, g, m_beta_1);
+						V = MIX(V, g.cwiseProduct(g), m_beta_2);
+						auto Mt = M / (1 - m_beta_1_pow);
+						auto Vt = V / (1 - m_beta_2_pow);
+						auto r = (Vt.array() + Epsilon).cwiseSqrt();
+						v.array() -= m_learning_rate * Mt.array() / r;
+				}
+		});
 }
 
 void AdamUnbiased::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		real_t inv_norm2 = entry.get_inv_norm2();
 
 		optimize_bias(ffm.b, pg, m_learning_rate, m_beta_1, m_beta_2,
 					  m_beta_1_pow, m_beta_2_pow, Epsilon);
 
+		bool aggregated = ffm.aggregated(entry);
 		for (auto it1 = features.begin(); it1 != features.end(); ++it1) {
 				auto& f1 = *it1;
 				ffm.check_feature_id(f1.id);
@@ -101,23 +104,26 @@ void AdamUnbiased::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 				real_t& w = ffm.w.row(f1.id).coeffRef(0);
 				real_t& M = ffm.w.row(f1.id).coeffRef(1);
 				real_t& V = ffm.w.row(f1.id).coeffRef(2);
-				real_t g = m_lambda_r * w + pg * f1.normalized_value;
+				real_t g = m_lambda_r * w + pg * f1.value;
 				M = MIX(M, g, m_beta_1);
 				V = MIX(V, g * g, m_beta_2);
 				real_t Mt = M / (1 - m_beta_1_pow);
 				real_t Vt = V / (1 - m_beta_2_pow);
 				w -= m_learning_rate * Mt / std::sqrt(Vt + Epsilon);
+				if (aggregated) continue;
 				for (auto it2 = it1 + 1; it2 != features.end(); ++it2) {
 						auto& f2 = *it2;
 						ffm.check_feature_id(f2.id);
 						ffm.check_field_id(f2.field_id);
+						if (!ffm.field_pairs(f1.field_id, f2.field_id))
+								continue;
 						auto v_i_fj = ffm.get_v(f1.id, f2.field_id);
 						auto v_j_fi = ffm.get_v(f2.id, f1.field_id);
 						auto M_i = ffm.get_v(f1.id, f2.field_id, 1);
 						auto M_j = ffm.get_v(f2.id, f1.field_id, 1);
 						auto V_i = ffm.get_v(f1.id, f2.field_id, 2);
 						auto V_j = ffm.get_v(f2.id, f1.field_id, 2);
-						auto pgx = pg * f1.value * f2.value * inv_norm2;
+						auto pgx = pg * f1.value * f2.value;
 						auto g_i = m_lambda_r * v_i_fj + pgx * v_j_fi;
 						auto g_j = m_lambda_r * v_j_fi + pgx * v_i_fj;
 						M_i = MIX(M_i, g_i, m_beta_1);
@@ -138,11 +144,73 @@ void AdamUnbiased::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 															.cwiseInverse());
 				}
 		}
+		if (!aggregated) return;
+		ffm.aggregated_gradient(
+			entry, pg, [&](index_t id, index_t field, Vector<Dynamic>& g) {
+				auto v = ffm.get_v(id, field);
+				auto M = ffm.get_v(id, field, 1);
+				auto V = ffm.get_v(id, field, 2);
+				g += m_lambda_r * v;
+				M = MIX(M, g, m_beta_1);
+				V = MIX(V, g.cwiseProduct(g), m_beta_2);
+				auto Mt = M / (1 - m_beta_1_pow);
+				auto Vt = V / (1 - m_beta_2_pow);
+				v.array() -= m_learning_rate
+					* Mt.array().cwiseProduct(
+						(Vt.array() + Epsilon).cwiseSqrt().cwiseInverse());
+			});
+}
+
+void AdamUnbiased::optimize(FwFM& fwfm, Entry& entry, real_t pg) const {
+		optimize_bias(fwfm.b, pg, m_learning_rate, m_beta_1, m_beta_2,
+					  m_beta_1_pow, m_beta_2_pow, Epsilon);
+
+		for (const auto& f : entry.features) {
+				fwfm.check_feature_id(f.id);
+				fwfm.check_field_id(f.field_id);
+				real_t& w = fwfm.w.row(f.id).coeffRef(0);
+				real_t& M = fwfm.w.row(f.id).coeffRef(1);
+				real_t& V = fwfm.w.row(f.id).coeffRef(2);
+				real_t g = m_lambda_r * w + pg * f.value;
+				M = MIX(M, g, m_beta_1);
+				V = MIX(V, g * g, m_beta_2);
+				real_t Mt = M / (1 - m_beta_1_pow);
+				real_t Vt = V / (1 - m_beta_2_pow);
+				w -= m_learning_rate * Mt / std::sqrt(Vt + Epsilon);
+		}
+
+		auto& sums = fwfm.sums(entry, true);
+		fwfm.field_weight_gradient(
+			sums, pg, [&](index_t a, index_t b, real_t g_r) {
+				real_t& r = fwfm.get_r(a, b);
+				real_t& M = fwfm.get_r(a, b, 1);
+				real_t& V = fwfm.get_r(a, b, 2);
+				real_t g = m_lambda_r * r + g_r;
+				M = MIX(M, g, m_beta_1);
+				V = MIX(V, g * g, m_beta_2);
+				real_t Mt = M / (1 - m_beta_1_pow);
+				real_t Vt = V / (1 - m_beta_2_pow);
+				r -= m_learning_rate * Mt / std::sqrt(Vt + Epsilon);
+			});
+		for (size_t i = 0; i < entry.features.size(); ++i) {
+				auto& f = entry.features[i];
+				fwfm.check_feature_id(f.id);
+				auto v = fwfm.v.row(f.id).head(fwfm.k);
+				auto M = fwfm.v.row(f.id).segment(fwfm.k, fwfm.k);
+				auto V = fwfm.v.row(f.id).tail(fwfm.k);
+				auto g = m_lambda_r * v + pg * f.value * sums.P.row(i);
+				M = MIX(M, g, m_beta_1);
+				V = MIX(V, g.cwiseProduct(g), m_beta_2);
+				auto Mt = M / (1 - m_beta_1_pow);
+				auto Vt = V / (1 - m_beta_2_pow);
+				v.array() -= m_learning_rate
+					* Mt.array().cwiseProduct(
+						(Vt.array() + Epsilon).cwiseSqrt().cwiseInverse());
+		}
 }
 
 void AdamUnbiased::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		size_t d = features.size();
 		size_t k = hofm.k;
 
 		optimize_bias(hofm.b, pg, m_learning_rate, m_beta_1, m_beta_2,
@@ -153,7 +221,7 @@ void AdamUnbiased::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 				real_t& w = hofm.w.row(f.id).coeffRef(0);
 				real_t& M = hofm.w.row(f.id).coeffRef(1);
 				real_t& V = hofm.w.row(f.id).coeffRef(2);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				M = MIX(M, g, m_beta_1);
 				V = MIX(V, g * g, m_beta_2);
 				real_t Mt = M / (1 - m_beta_1_pow);
@@ -161,11 +229,12 @@ void AdamUnbiased::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 				w -= m_learning_rate * Mt / std::sqrt(Vt + Epsilon);
 		}
 
+		auto& dp = hofm.get_dp(entry, true);
 		for (size_t m = 2; m <= hofm.order; ++m) {
-				auto a = hofm.get_dp_eval(entry, m);
-				auto a_adj = hofm.get_dp_grad(entry, m);
-				for (size_t j = 1; j <= d; ++j) {
-						auto& f = features[j - 1];
+				auto& a = dp.a[m - 2];
+				auto& a_adj = dp.a_adj[m - 2];
+				for (size_t j = 1; j <= dp.d; ++j) {
+						auto& f = features[dp.index[j - 1]];
 						auto p = hofm.get_p(m, f.id);
 						auto M = hofm.get_p(m, f.id, 1);
 						auto V = hofm.get_p(m, f.id, 2);
@@ -184,6 +253,9 @@ void AdamUnbiased::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 														  .cwiseInverse());
 				}
 		}
+		dp.invalidate();
 }
 
+DEFINE_FUSED_TRAIN(AdamUnbiased)
+
 NAMESPACE_END
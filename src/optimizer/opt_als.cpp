@@ -0,0 +1,234 @@
+#include "optimizer.h"
+
+#include "base/thread_pool.h"
+#include "data/feature_columns.h"
+#include "data/sampler.h"
+#include "model/fm.h"
+#include "model/lm.h"
+
+#include <type_traits>
+
+NAMESPACE_BEGIN
+
+// samples in columns, along with what is kept up to date across updates
+struct ALS::Cache {
+		Entries entries;
+		FeatureColumns columns;
+		std::vector<real_t> label;
+		std::vector<real_t> weight;
+		real_t total_weight = 0;
+		// error, prediction minus label, of each sample; and for FM, of
+		// the factor f being solved, q_f = ∑ v_i_f x_i of each sample.
+		std::vector<real_t> e;
+		std::vector<real_t> q;
+
+		// features by field they first occur in, solved a field at a time.
+		// those of a field are solved in parallel only if no sample has two
+		// of them, i.e. the field is one-hot, as then their updates touch
+		// disjoint samples and equal those made one after another.
+		struct Group {
+				std::vector<u32> features;
+				bool one_hot = true;
+		};
+		std::vector<Group> groups;
+
+		void group_features(size_t n_features);
+};
+
+void ALS::Cache::group_features(size_t n_features) {
+		constexpr u32 none = -1;
+		std::vector<u32> group_of(n_features, none);
+		for (auto& entry : entries) {
+				for (auto& x : entry->features) {
+						if (x.id >= n_features || group_of[x.id] != none)
+								continue;
+						if (x.field_id >= groups.size())
+								groups.resize(x.field_id + 1);
+						group_of[x.id] = x.field_id;
+						groups[x.field_id].features.push_back(x.id);
+				}
+		}
+		// last sample and feature seen of each group
+		std::vector<std::pair<size_t, u32>> last(groups.size(), {-1, none});
+		for (size_t r = 0; r < entries.size(); ++r) {
+				for (auto& x : entries[r]->features) {
+						if (x.id >= n_features) continue;
+						u32 g = group_of[x.id];
+						auto& [row, id] = last[g];
+						if (row == r && id != x.id) groups[g].one_hot = false;
+						last[g] = {r, u32(x.id)};
+				}
+		}
+}
+
+namespace {
+
+// set θ to its optimum given sums of weighted e*h and h^2 over samples,
+// where h is derivative of prediction w.r.t. θ; return the change.
+real_t solve(real_t& theta, real_t sum_eh, real_t sum_hh, real_t lambda) {
+		real_t delta = -(sum_eh + lambda * theta) / (sum_hh + lambda);
+		theta += delta;
+		return delta;
+}
+
+} // namespace
+
+template <typename M>
+void ALS::solve_all(M& model, ThreadPool& pool) {
+		constexpr size_t chunk = 256; // features or samples per task
+		auto& c = *m_cache;
+		// λ of SGD applies per sample, so here it is per unit of weight
+		real_t lambda = m_lambda_r * c.total_weight;
+		auto& cols = c.columns;
+		auto& e = c.e;
+		size_t n_rows = cols.n_rows();
+		auto for_each_feature = [&](auto&& solve_feature) {
+				for (auto& group : c.groups) {
+						auto& ids = group.features;
+						if (!group.one_hot) {
+								for (auto j : ids) solve_feature(j);
+								continue;
+						}
+						pool.parallel_for(ids.size(), chunk, [&](size_t t) {
+								solve_feature(ids[t]);
+						});
+				}
+		};
+		// recomputed from scratch lest rounding errors pile up
+		pool.parallel_for(n_rows, chunk, [&](size_t r) {
+				e[r] = model.predict(*c.entries[r]) - c.label[r];
+		});
+
+		// bias is not regularized
+		real_t sum_e = 0;
+		for (size_t r = 0; r < n_rows; ++r) {
+				sum_e += c.weight[r] * e[r];
+		}
+		real_t delta = -sum_e / c.total_weight;
+		model.b.coeffRef(0) += delta;
+		pool.parallel_for(n_rows, chunk, [&](size_t r) { e[r] += delta; });
+
+		for_each_feature([&](size_t j) {
+				real_t sum_eh = 0, sum_hh = 0;
+				for (size_t i = cols.begin(j); i < cols.end(j); ++i) {
+						real_t x = cols.value(i), w = c.weight[cols.row(i)];
+						sum_eh += w * e[cols.row(i)] * x;
+						sum_hh += w * x * x;
+				}
+				real_t& theta = model.w.row(j).coeffRef(0);
+				real_t delta = solve(theta, sum_eh, sum_hh, lambda);
+				for (size_t i = cols.begin(j); i < cols.end(j); ++i) {
+						e[cols.row(i)] += delta * cols.value(i);
+				}
+		});
+
+		if constexpr (std::is_same_v<M, FM>) {
+				auto& q = c.q;
+				for (size_t f = 0; f < model.k; ++f) {
+						pool.parallel_for(n_rows, chunk, [&](size_t r) {
+								real_t sum = 0;
+								for (auto& x : c.entries[r]->features) {
+										if (x.id >= model.n) continue;
+										sum += model.v.coeff(x.id, f) * x.value;
+								}
+								q[r] = sum;
+						});
+						for_each_feature([&](size_t j) {
+								// h of each cell, i.e. x (q_f - v_j_f x)
+								thread_local std::vector<real_t> h;
+								real_t& theta = model.v.coeffRef(j, f);
+								h.clear();
+								real_t sum_eh = 0, sum_hh = 0;
+								for (size_t i = cols.begin(j); i < cols.end(j);
+									 ++i) {
+										u32 r = cols.row(i);
+										real_t x = cols.value(i);
+										real_t w = c.weight[r];
+										real_t h_r = x * (q[r] - theta * x);
+										h.push_back(h_r);
+										sum_eh += w * e[r] * h_r;
+										sum_hh += w * h_r * h_r;
+								}
+								real_t delta =
+									solve(theta, sum_eh, sum_hh, lambda);
+								for (size_t i = cols.begin(j); i < cols.end(j);
+									 ++i) {
+										u32 r = cols.row(i);
+										real_t h_r = h[i - cols.begin(j)];
+										e[r] += delta * h_r;
+										q[r] += delta * cols.value(i);
+								}
+						});
+				}
+		}
+}
+
+ALS::ALS(real_t lambda_r) : Optimizer(0, lambda_r) {}
+ALS::~ALS() = default;
+
+void ALS::optimize(LM&, Entry&, real_t) const {
+		THROW("ALS trains an epoch at a time");
+}
+void ALS::optimize(FM&, Entry&, real_t) const {
+		THROW("ALS trains an epoch at a time");
+}
+void ALS::optimize(FFM&, Entry&, real_t) const {
+		THROW("ALS trains an epoch at a time");
+}
+void ALS::optimize(FwFM&, Entry&, real_t) const {
+		THROW("ALS trains an epoch at a time");
+}
+void ALS::optimize(HOFM&, Entry&, real_t) const {
+		THROW("ALS trains an epoch at a time");
+}
+void ALS::train(Model&,
+			   Loss,
+			   std::shared_ptr<Entry>*,
+			   std::shared_ptr<Entry>*,
+			   real_t*) const {
+		THROW("ALS trains an epoch at a time");
+}
+
+bool ALS::supports(const Model& model) {
+		if (dynamic_cast<const LM*>(&model)) return true;
+		auto fm = dynamic_cast<const FM*>(&model);
+		return fm && fm->field_pairs.empty();
+}
+
+real_t ALS::train_epoch(Model& model, Sampler& sampler, ThreadPool& pool) {
+		if (!supports(model))
+				THROW("ALS only trains LM and FM without masked field pairs");
+		if (!m_cache) {
+				m_cache = std::make_unique<Cache>();
+				auto& c = *m_cache;
+				sampler.restart();
+				while (sampler.get_samples(-1, c.entries)) {}
+				for (auto& entry : c.entries) {
+						c.label.push_back(entry->label);
+						c.weight.push_back(entry->weight);
+						c.total_weight += entry->weight;
+				}
+				if (c.entries.empty() || c.total_weight <= 0)
+						THROW("no samples to train on");
+				model.grow(c.entries);
+				size_t n_features = model.max_feature_id() + 1;
+				c.columns = FeatureColumns(c.entries, n_features);
+				c.group_features(n_features);
+				c.e.resize(c.entries.size());
+				c.q.resize(c.entries.size());
+		}
+		if (auto lm = dynamic_cast<LM*>(&model)) {
+				solve_all(*lm, pool);
+		} else {
+				solve_all(dynamic_cast<FM&>(model), pool);
+		}
+
+		auto& c = *m_cache;
+		real_t sum = 0;
+		for (size_t r = 0; r < c.entries.size(); ++r) {
+				sum += c.weight[r] * c.e[r] * c.e[r] / 2;
+		}
+		return sum / c.total_weight;
+}
+
+NAMESPACE_END
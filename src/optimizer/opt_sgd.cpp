@@ -1,7 +1,9 @@
 #include "optimizer.h"
+#include "engine.h"
 
 #include "model/ffm.h"
 #include "model/fm.h"
+#include "model/fwfm.h"
 #include "model/hofm.h"
 #include "model/lm.h"
 
@@ -18,60 +20,98 @@ void SGD::optimize(LM& lm, Entry& entry, real_t pg) const {
 		for (const auto& f : entry.features) {
 				lm.check_feature_id(f.id);
 				real_t& w = lm.w.row(f.id).coeffRef(0);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				w -= m_learning_rate * g;
 		}
 }
 void SGD::optimize(FM& fm, Entry& entry, real_t pg) const {
-		auto s = fm.allocate_s();
-
 		optimize_bias(fm.b, pg, m_learning_rate);
 
 		for (const auto& f : entry.features) {
 				fm.check_feature_id(f.id);
 				real_t& w = fm.w.row(f.id).coeffRef(0);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				w -= m_learning_rate * g;
-				s += fm.v.row(f.id).head(fm.k) * f.normalized_value;
-		}
-		for (const auto& f : entry.features) {
-				fm.check_feature_id(f.id);
-				auto v = fm.v.row(f.id).head(fm.k);
-				auto g = m_lambda_r * v + pg * (s - v * f.normalized_value);
-				v -= m_learning_rate * g;
 		}
+		auto& P = fm.partner_sums(entry);
+		with_fixed_size(fm.k, [&](auto size) {
+				constexpr int K = decltype(size)::value;
+				for (size_t i = 0; i < entry.features.size(); ++i) {
+						auto& f = entry.features[i];
+						fm.check_feature_id(f.id);
+						auto v = fm.get_v<K>(f.id);
+						auto g = m_lambda_r * v + pg * P.row(i).head<K>(fm.k);
+						v -= m_learning_rate * g;
+				}
+		});
 }
 void SGD::optimize(FFM& ffm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		real_t inv_norm2 = entry.get_inv_norm2();
 
 		optimize_bias(ffm.b, pg, m_learning_rate);
 
+		bool aggregated = ffm.aggregated(entry);
 		for (auto it1 = features.begin(); it1 != features.end(); ++it1) {
 				auto& f1 = *it1;
 				ffm.check_feature_id(f1.id);
 				ffm.check_field_id(f1.field_id);
 				real_t& w = ffm.w.row(f1.id).coeffRef(0);
-				real_t g = m_lambda_r * w + pg * f1.normalized_value;
+				real_t g = m_lambda_r * w + pg * f1.value;
 				w -= m_learning_rate * g;
+				if (aggregated) continue;
 				for (auto it2 = it1 + 1; it2 != features.end(); ++it2) {
 						auto& f2 = *it2;
 						ffm.check_feature_id(f2.id);
 						ffm.check_field_id(f2.field_id);
+						if (!ffm.field_pairs(f1.field_id, f2.field_id))
+								continue;
 						auto v_i_fj = ffm.get_v(f1.id, f2.field_id);
 						auto v_j_fi = ffm.get_v(f2.id, f1.field_id);
-						auto pgx = pg * f1.value * f2.value * inv_norm2;
+						auto pgx = pg * f1.value * f2.value;
 						auto g_i = m_lambda_r * v_i_fj + pgx * v_j_fi;
 						auto g_j = m_lambda_r * v_j_fi + pgx * v_i_fj;
 						v_i_fj -= m_learning_rate * g_i;
 						v_j_fi -= m_learning_rate * g_j;
 				}
 		}
+		if (!aggregated) return;
+		ffm.aggregated_gradient(
+			entry, pg, [&](index_t id, index_t field, Vector<Dynamic>& g) {
+				auto v = ffm.get_v(id, field);
+				g += m_lambda_r * v;
+				v -= m_learning_rate * g;
+			});
+}
+
+void SGD::optimize(FwFM& fwfm, Entry& entry, real_t pg) const {
+		optimize_bias(fwfm.b, pg, m_learning_rate);
+
+		for (const auto& f : entry.features) {
+				fwfm.check_feature_id(f.id);
+				fwfm.check_field_id(f.field_id);
+				real_t& w = fwfm.w.row(f.id).coeffRef(0);
+				real_t g = m_lambda_r * w + pg * f.value;
+				w -= m_learning_rate * g;
+		}
+
+		auto& sums = fwfm.sums(entry, true);
+		fwfm.field_weight_gradient(
+			sums, pg, [&](index_t a, index_t b, real_t g_r) {
+				real_t& r = fwfm.get_r(a, b);
+				real_t g = m_lambda_r * r + g_r;
+				r -= m_learning_rate * g;
+			});
+		for (size_t i = 0; i < entry.features.size(); ++i) {
+				auto& f = entry.features[i];
+				fwfm.check_feature_id(f.id);
+				auto v = fwfm.v.row(f.id).head(fwfm.k);
+				auto g = m_lambda_r * v + pg * f.value * sums.P.row(i);
+				v -= m_learning_rate * g;
+		}
 }
 
 void SGD::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 		const auto& features = entry.features;
-		size_t d = features.size();
 		size_t k = hofm.k;
 
 		optimize_bias(hofm.b, pg, m_learning_rate);
@@ -79,15 +119,16 @@ void SGD::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 		for (const auto& f : entry.features) {
 				hofm.check_feature_id(f.id);
 				real_t& w = hofm.w.row(f.id).coeffRef(0);
-				real_t g = m_lambda_r * w + pg * f.normalized_value;
+				real_t g = m_lambda_r * w + pg * f.value;
 				w -= m_learning_rate * g;
 		}
 
+		auto& dp = hofm.get_dp(entry, true);
 		for (size_t m = 2; m <= hofm.order; ++m) {
-				auto a = hofm.get_dp_eval(entry, m);
-				auto a_adj = hofm.get_dp_grad(entry, m);
-				for (size_t j = 1; j <= d; ++j) {
-						auto& f = features[j - 1];
+				auto& a = dp.a[m - 2];
+				auto& a_adj = dp.a_adj[m - 2];
+				for (size_t j = 1; j <= dp.d; ++j) {
+						auto& f = features[dp.index[j - 1]];
 						auto p = hofm.get_p(m, f.id);
 						auto a_adj_j = a_adj.block(1, j * k, m, k);
 						auto a_jm1 = a.block(0, (j - 1) * k, m, k);
@@ -97,8 +138,11 @@ void SGD::optimize(HOFM& hofm, Entry& entry, real_t pg) const {
 						p -= m_learning_rate * g;
 				}
 		}
+		dp.invalidate();
 }
 
 std::vector<real_t> SGD::extras() const { return {}; }
 
+DEFINE_FUSED_TRAIN(SGD)
+
 NAMESPACE_END
@@ -2,14 +2,20 @@
 
 #include "base/config.h"
 
+#include <memory>
 #include <vector>
 
 NAMESPACE_BEGIN
 
 struct Entry;
+enum class Loss;
+class Model;
+class Sampler;
+class ThreadPool;
 class LM;
 class FM;
 class FFM;
+class FwFM;
 class HOFM;
 
 class Optimizer {
@@ -23,10 +29,21 @@ class Optimizer {
 		virtual void optimize(LM&, Entry&, real_t pg) const = 0;
 		virtual void optimize(FM&, Entry&, real_t pg) const = 0;
 		virtual void optimize(FFM&, Entry&, real_t pg) const = 0;
+		virtual void optimize(FwFM&, Entry&, real_t pg) const = 0;
 		virtual void optimize(HOFM&, Entry&, real_t pg) const = 0;
 
+		// predict each sample of [start, end) into pred and learn from it
+		// right away. dispatched once for all samples; see engine.h.
+		virtual void train(Model& model,
+						   Loss loss,
+						   std::shared_ptr<Entry>* start,
+						   std::shared_ptr<Entry>* end,
+						   real_t* pred) const = 0;
+
 		// # extra number used as cache for each parameter to optimize
 		virtual std::vector<real_t> extras() const = 0;
+		// as given to --opt; saved with extras to tell whose states they are
+		virtual const char* name() const = 0;
 
 	protected:
 		real_t m_learning_rate;
@@ -44,9 +61,16 @@ class SGD : public Optimizer {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "sgd"; }
 };
 
 class AdaGrad : public Optimizer {
@@ -57,9 +81,16 @@ class AdaGrad : public Optimizer {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "adagrad"; }
 };
 
 class RMSProp : public Optimizer {
@@ -70,9 +101,16 @@ class RMSProp : public Optimizer {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "rmsprop"; }
 
 	protected:
 		real_t m_alpha;
@@ -86,9 +124,16 @@ class Momentum : public Optimizer {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "momentum"; }
 
 	protected:
 		real_t m_gamma;
@@ -107,9 +152,16 @@ class Adam : public Optimizer {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "adam"; }
 
 	protected:
 		real_t m_beta_1;
@@ -125,11 +177,18 @@ class AdamUnbiased : public Adam {
 		: Adam(learning_rate, lambda_r, beta_1, beta_2) {}
 
 		void set_epoch(int epoch) override;
+		const char* name() const override { return "adam-unbias"; }
 
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 	protected:
 		real_t m_beta_1_pow;
@@ -147,9 +206,55 @@ class AMSGrad : public Adam {
 		void optimize(LM&, Entry&, real_t pg) const override;
 		void optimize(FM&, Entry&, real_t pg) const override;
 		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
 		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
 
 		std::vector<real_t> extras() const override;
+		const char* name() const override { return "amsgrad"; }
+};
+
+// alternating least squares, as of libFM: under squared loss, each parameter
+// in turn is set to its optimum given all the others, in closed form and
+// without a learning rate. it goes over all samples a feature at a time, so
+// it trains an epoch at a time rather than a sample at a time; only LM and
+// FM are supported.
+class ALS : public Optimizer {
+	public:
+		ALS(real_t lambda_r);
+		~ALS();
+
+		// NOTE: all throw; see train_epoch()
+		void optimize(LM&, Entry&, real_t pg) const override;
+		void optimize(FM&, Entry&, real_t pg) const override;
+		void optimize(FFM&, Entry&, real_t pg) const override;
+		void optimize(FwFM&, Entry&, real_t pg) const override;
+		void optimize(HOFM&, Entry&, real_t pg) const override;
+		void train(Model& model,
+				   Loss loss,
+				   std::shared_ptr<Entry>* start,
+				   std::shared_ptr<Entry>* end,
+				   real_t* pred) const override;
+
+		std::vector<real_t> extras() const override { return {}; }
+		const char* name() const override { return "als"; }
+
+		static bool supports(const Model& model);
+		// update every parameter once given all samples of sampler, which
+		// are taken at the first call and assumed the same after.
+		// return weighted mean loss of samples after the update.
+		real_t train_epoch(Model& model, Sampler& sampler, ThreadPool& pool);
+
+	private:
+		struct Cache;
+		std::unique_ptr<Cache> m_cache;
+
+		template <typename M>
+		void solve_all(M& model, ThreadPool& pool);
 };
 
 NAMESPACE_END
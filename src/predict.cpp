@@ -14,7 +14,7 @@ void Application_impl::predict(Sampler& sampler) {
 		predicted.clear();
 		while (sampler.get_samples(-1, entries)) {
 				for (auto& e : entries) {
-						predicted.push_back(model->predict(*e));
+						predicted.push_back(model->calibrated_predict(*e));
 				}
 		}
 
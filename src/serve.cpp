@@ -0,0 +1,348 @@
+#include "application_impl.h"
+#include "base/io_util.h"
+#include "base/logger.h"
+#include "base/socket.h"
+#include "base/timer.h"
+#include "data/data_set.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <thread>
+
+NAMESPACE_BEGIN
+
+namespace {
+
+constexpr int tick_ms = 200;              // of checking model file and stop
+constexpr size_t parallel_threshold = 64; // # samples worth the pool
+constexpr size_t recv_size = 64 << 10;
+
+volatile std::sig_atomic_t stop_requested = 0;
+void request_stop(int) { stop_requested = 1; }
+
+// lines that arrived together on a connection, scored as a unit.
+struct Request {
+		Entries entries;
+		std::vector<real_t> scores;
+		TimePoint arrival;
+		bool done = false;
+};
+
+struct Connection {
+		Socket socket;
+		std::thread thread;
+		std::atomic<bool> finished = false;
+};
+
+// requests of all connections are queued to one thread, which scores them
+// in batches on the pool; those arriving while a batch is being scored make
+// up the next one.
+class Server {
+	public:
+		Server(Application_impl& app,
+			   std::string model_path,
+			   std::function<std::unique_ptr<Model>()> load_model)
+		: m_app(app), m_model_path(std::move(model_path)),
+		  m_load_model(std::move(load_model)) {
+				m_model = m_load_model();
+				m_model_time = filesystem::last_write_time(m_model_path);
+		}
+
+		void run(const std::string& socket_path);
+
+	private:
+		Application_impl& m_app;
+		std::string m_model_path;
+		std::function<std::unique_ptr<Model>()> m_load_model;
+		// swapped atomically; a batch keeps the one it started with
+		std::shared_ptr<Model> m_model;
+		filesystem::file_time_type m_model_time;
+		std::optional<filesystem::file_time_type> m_pending_time;
+
+		std::mutex m_mutex;
+		std::condition_variable m_queued;
+		std::condition_variable m_scored;
+		std::deque<Request*> m_queue;
+		size_t m_n_queued = 0; // # samples in queue
+		bool m_stopping = false;
+
+		// of the current stats window
+		std::mutex m_stats_mutex;
+		std::vector<float> m_latency_ms; // of each sample
+		size_t m_n_batches = 0;
+		Timer m_stats_timer;
+
+		void serve_connection(Connection& connection);
+		void score(Request& request);
+		void batch_loop();
+		void reload_if_replaced();
+		void report_stats();
+};
+
+void Server::run(const std::string& socket_path) {
+		auto listener = Socket::listen(socket_path.c_str(), 64);
+		logger::info("serving {} at {}", m_model_path.c_str(),
+					 socket_path.c_str());
+		stop_requested = 0;
+		auto old_int = std::signal(SIGINT, request_stop);
+		auto old_term = std::signal(SIGTERM, request_stop);
+
+		std::thread batcher([this]() { batch_loop(); });
+		std::list<Connection> connections;
+		m_stats_timer.tic();
+		while (!stop_requested) {
+				pollfd listening{listener.fd(), POLLIN, 0};
+				if (::poll(&listening, 1, tick_ms) > 0) {
+						auto& c = connections.emplace_back();
+						c.socket = listener.accept();
+						c.thread = std::thread([this, &c]() {
+								try {
+										serve_connection(c);
+								} catch (const std::exception& e) {
+										logger::warn("connection dropped: {}",
+													 e.what());
+								}
+								c.finished = true;
+						});
+				}
+				for (auto it = connections.begin(); it != connections.end();) {
+						if (!it->finished) {
+								++it;
+								continue;
+						}
+						it->thread.join();
+						it = connections.erase(it);
+				}
+				reload_if_replaced();
+				m_stats_timer.toc();
+				if (m_stats_timer.seconds() >= m_app.stats_seconds)
+						report_stats();
+		}
+
+		logger::info("stopping; {} connections open", connections.size());
+		listener.close();
+		std::error_code error;
+		filesystem::remove(socket_path, error);
+		for (auto& c : connections) {
+				c.socket.shutdown();
+		}
+		for (auto& c : connections) {
+				c.thread.join();
+		}
+		{
+				std::lock_guard lock(m_mutex);
+				m_stopping = true;
+		}
+		m_queued.notify_one();
+		batcher.join();
+		m_stats_timer.toc();
+		report_stats();
+		std::signal(SIGINT, old_int);
+		std::signal(SIGTERM, old_term);
+}
+
+// each line is answered by a line of prediction, in order, or of "error: "
+// followed by why. format of lines is detected from the first one.
+void Server::serve_connection(Connection& connection) {
+		auto& socket = connection.socket;
+		std::optional<LineParser> parser;
+		std::vector<char> chunk(recv_size);
+		std::string buffer, line, reply;
+		Request request;
+		std::vector<std::string> errors; // of each line, empty if scored
+		bool remove_zeros = m_app.remove_zeros;
+		while (size_t n = socket.recv_some(chunk.data(), chunk.size())) {
+				buffer.append(chunk.data(), n);
+				request.entries.clear();
+				errors.clear();
+				size_t begin = 0, end;
+				while ((end = buffer.find('\n', begin)) != std::string::npos) {
+						line.assign(buffer, begin, end - begin);
+						begin = end + 1;
+						auto first = line.find_first_not_of(" \t\r");
+						if (first == std::string::npos) continue;
+						try {
+								if (!parser) parser.emplace(line, remove_zeros);
+								auto entry = std::make_shared<Entry>();
+								parser->parse(line, *entry);
+								entry->sort_features();
+								if (m_app.normalize) entry->normalize();
+								request.entries.push_back(std::move(entry));
+								errors.emplace_back();
+						} catch (const std::exception& e) {
+								errors.emplace_back(e.what());
+						}
+				}
+				buffer.erase(0, begin);
+				if (errors.empty()) continue;
+
+				if (!request.entries.empty()) score(request);
+				reply.clear();
+				auto out = std::back_inserter(reply);
+				size_t scored = 0;
+				for (auto& error : errors) {
+						if (error.empty()) {
+								auto y = request.scores[scored++];
+								fmt::format_to(out, "{:.6g}\n", y);
+						} else {
+								fmt::format_to(out, "error: {}\n", error);
+						}
+				}
+				socket.send(reply.data(), reply.size());
+		}
+}
+
+void Server::score(Request& request) {
+		request.scores.resize(request.entries.size());
+		request.arrival = Clock::now();
+		request.done = false;
+		std::unique_lock lock(m_mutex);
+		m_queue.push_back(&request);
+		m_n_queued += request.entries.size();
+		m_queued.notify_one();
+		m_scored.wait(lock, [&]() { return request.done; });
+}
+
+void Server::batch_loop() {
+		using Ms = std::chrono::duration<float, std::milli>;
+		profiler::set_thread_name("batcher");
+		auto wait = std::chrono::duration_cast<Clock::duration>(
+			Ms(m_app.serve_wait_ms));
+		std::vector<Request*> batch;
+		std::vector<std::pair<Entry*, real_t*>> samples;
+		for (;;) {
+				batch.clear();
+				{
+						std::unique_lock lock(m_mutex);
+						m_queued.wait(lock, [&]() {
+								return m_stopping || !m_queue.empty();
+						});
+						if (m_queue.empty()) return;
+						if (wait.count() > 0) {
+								auto deadline = m_queue.front()->arrival + wait;
+								m_queued.wait_until(lock, deadline, [&]() {
+										return m_stopping
+											|| m_n_queued >= m_app.serve_batch;
+								});
+						}
+						// at least one request, however large
+						size_t n = 0;
+						while (!m_queue.empty()
+							   && (n == 0
+								   || n + m_queue.front()->entries.size()
+										  <= m_app.serve_batch)) {
+								n += m_queue.front()->entries.size();
+								batch.push_back(m_queue.front());
+								m_queue.pop_front();
+						}
+						m_n_queued -= n;
+				}
+
+				auto model = std::atomic_load(&m_model);
+				samples.clear();
+				for (auto r : batch) {
+						for (size_t i = 0; i < r->entries.size(); ++i) {
+								samples.emplace_back(r->entries[i].get(),
+													 &r->scores[i]);
+						}
+				}
+				auto predict = [&](size_t i) {
+						auto [entry, out] = samples[i];
+						*out = model->calibrated_predict(*entry);
+				};
+				auto& pool = *m_app.thread_pool;
+				if (samples.size() < parallel_threshold || pool.size() < 2) {
+						for (size_t i = 0; i < samples.size(); ++i) {
+								predict(i);
+						}
+				} else {
+						pool.parallel_for(samples.size(), 16, predict);
+				}
+
+				auto now = Clock::now();
+				{
+						std::lock_guard lock(m_stats_mutex);
+						for (auto r : batch) {
+								Ms latency = now - r->arrival;
+								m_latency_ms.insert(m_latency_ms.end(),
+													r->entries.size(),
+													latency.count());
+						}
+						m_n_batches++;
+				}
+				{
+						std::lock_guard lock(m_mutex);
+						for (auto r : batch) {
+								r->done = true;
+						}
+				}
+				m_scored.notify_all();
+		}
+}
+
+// a replaced file is loaded once it has stayed the same for a tick, lest it
+// is still being written; replacing it by rename() avoids the wait.
+void Server::reload_if_replaced() {
+		std::error_code error;
+		auto time = filesystem::last_write_time(m_model_path, error);
+		if (error || time == m_model_time) {
+				m_pending_time.reset();
+				return;
+		}
+		if (m_pending_time != time) {
+				m_pending_time = time;
+				return;
+		}
+		m_pending_time.reset();
+		m_model_time = time;
+		try {
+				std::shared_ptr<Model> model = m_load_model();
+				std::atomic_store(&m_model, model);
+				logger::info("reloaded model from {}", m_model_path.c_str());
+		} catch (const std::exception& e) {
+				logger::error("failed to reload model from {}: {}",
+							  m_model_path.c_str(), e.what());
+		}
+}
+
+void Server::report_stats() {
+		std::vector<float> latency;
+		size_t n_batches;
+		{
+				std::lock_guard lock(m_stats_mutex);
+				latency.swap(m_latency_ms);
+				n_batches = m_n_batches;
+				m_n_batches = 0;
+		}
+		float seconds = m_stats_timer.seconds();
+		m_stats_timer.tic();
+		if (latency.empty()) return;
+		auto percentile = [&](double p) {
+				auto nth = latency.begin() + size_t(p * (latency.size() - 1));
+				std::nth_element(latency.begin(), nth, latency.end());
+				return *nth;
+		};
+		logger::info("{} samples in {:.3} seconds, {:.0f} per second, {:.1f} "
+					 "per batch; latency p50 {:.3g} ms, p99 {:.3g} ms",
+					 latency.size(), seconds, latency.size() / seconds,
+					 double(latency.size()) / n_batches, percentile(0.5),
+					 percentile(0.99));
+}
+
+} // namespace
+
+void Application_impl::serve(
+	const std::string& socket_path,
+	const std::string& model_path,
+	std::function<std::unique_ptr<Model>()> load_model) {
+		profiler::set_thread_name("main");
+		Server(*this, model_path, std::move(load_model)).run(socket_path);
+}
+
+NAMESPACE_END
@@ -0,0 +1,142 @@
+#include "application_impl.h"
+#include "base/enum_db.h"
+#include "base/io_util.h"
+#include "base/logger.h"
+#include "base/timer.h"
+#include "data/data_stream.h"
+#include "data/sampler.h"
+
+NAMESPACE_BEGIN
+
+void Application_impl::train_stream(Optimizer& optimizer,
+									DataStream& stream) {
+		profiler::set_thread_name("main");
+		if (n_workers > 1)
+				THROW("training on a stream does not support workers");
+		if (metric && metric->slice_field())
+				logger::warn("metric slices are not reported for stream");
+
+		auto in = [](real_t seconds) {
+				// at most an hour ahead, lest the duration overflows
+				seconds = std::min<real_t>(seconds, 3600);
+				std::chrono::duration<float> left(seconds);
+				return Clock::now()
+					+ std::chrono::duration_cast<Clock::duration>(left);
+		};
+
+		// the first batch decides initial # features/fields; the model grows
+		// as new ones arrive. beyond its first sample, it is not waited for
+		// longer than a window.
+		Entries batch;
+		if (!stream.read(1, batch)) {
+				logger::warn("stream ended before any sample arrived");
+				return;
+		}
+		stream.read(stream_batch - 1, batch, in(checkpoint_seconds));
+		{
+				auto data =
+					std::make_shared<DataSet>(batch, stream.has_label());
+				auto sampler = Sampler::create(data);
+				if (warm_start) {
+						model->warm_start(*sampler, optimizer);
+				} else {
+						model->initialize(*sampler, optimizer.extras());
+						model->optimizer(optimizer.name());
+				}
+		}
+		optimizer.set_epoch(1);
+
+		// loss and metric are progressive: each sample is evaluated before
+		// the model learns from it, and reset at every checkpoint.
+		constexpr auto header_fmt = "{:>12}|{:^20}|{:^20}|{:>8}";
+		constexpr auto progress_fmt = "{:12}|{:>20.4}|{:>20.4}|{:8.2}";
+		String loss_str = EnumDB<Loss>::to_string(loss);
+		String metric_str = metric ? metric->name() : "(no metric)";
+		logger::info("start training on stream...");
+		logger::info(header_fmt, "samples", loss_str.c_str(),
+					 metric_str.c_str(), "seconds");
+
+		size_t n_total = 0, n_window = 0;
+		// of samples learned from, i.e. those kept of downsampled negatives
+		size_t n_learned = 0;
+		double loss_window = 0;
+		if (metric) metric->reset();
+		Timer window_timer;
+		window_timer.tic();
+		auto end_window = [&]() {
+				window_timer.toc();
+				real_t metric_value = metric ? metric->value() : NAN;
+				logger::info(progress_fmt, n_total, loss_window / n_learned,
+							 metric_value, window_timer.seconds());
+				if (!checkpoint.empty()) save_checkpoint();
+				n_window = 0;
+				n_learned = 0;
+				loss_window = 0;
+				if (metric) metric->reset();
+				window_timer.tic();
+		};
+		do {
+				if (!batch.empty()) {
+						model->grow(batch);
+						auto data = std::make_shared<DataSet>(
+							std::move(batch), stream.has_label());
+						auto sampler = Sampler::create(data);
+						if (metric) {
+								PROFILE_SCOPE(Metric);
+								sampler->restart();
+								metric->evaluate(*model, *sampler);
+						}
+						// metric is of all samples, and loss of those
+						// learned from
+						sampler->restart();
+						if (negative_rate < 1) {
+								sampler =
+									Sampler::downsample(sampler, negative_rate);
+						}
+						size_t n = 0;
+						auto count = [&](Entries& learned) {
+								n += learned.size();
+						};
+						auto loss_mean = model->update(
+							loss, optimizer, *sampler, *thread_pool, -1, count);
+						if (n) loss_window += loss_mean * n;
+						n_learned += n;
+						n_window += data->size();
+						n_total += data->size();
+						batch.clear();
+				}
+
+				window_timer.toc();
+				if (n_window
+					&& ((checkpoint_samples && n_window >= checkpoint_samples)
+						|| window_timer.seconds() >= checkpoint_seconds)) {
+						end_window();
+				}
+				// a slow stream yields a partial batch when the window is
+				// due, so that it does not hold back report and checkpoint.
+				// an empty window has nothing to wait for.
+				std::optional<TimePoint> due;
+				if (n_window) {
+						window_timer.toc();
+						due = in(checkpoint_seconds - window_timer.seconds());
+				}
+				stream.read(stream_batch, batch, due);
+		} while (!batch.empty() || !stream.eof());
+		if (n_window) end_window();
+		logger::info("stream ended after {} samples", n_total);
+}
+
+void Application_impl::save_checkpoint() {
+		// readers of checkpoint never see a partially written model, since
+		// rename() replaces the file atomically.
+		auto tmp = checkpoint + ".tmp";
+		model->serialize(tmp.c_str(), save_extras);
+		std::error_code error;
+		filesystem::rename(tmp, checkpoint, error);
+		if (error) {
+				logger::error("failed to save checkpoint to {}: {}",
+							  checkpoint.c_str(), error.message().c_str());
+		}
+}
+
+NAMESPACE_END
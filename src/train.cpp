@@ -28,6 +28,7 @@ String readable_size(size_t n_bytes) {
 void Application_impl::train(Optimizer& optimizer,
 							 Sampler& train,
 							 std::shared_ptr<Sampler> test) {
+		profiler::set_thread_name("main");
 		Timer train_timer;
 		train_timer.tic();
 		defer([&] {
@@ -47,10 +48,17 @@ void Application_impl::train(Optimizer& optimizer,
 				});
 
 				train.restart();
-				model->initialize(train, optimizer.extras());
+				if (warm_start) {
+						model->warm_start(train, optimizer);
+				} else {
+						model->initialize(train, optimizer.extras());
+						model->optimizer(optimizer.name());
+				}
 				auto n_bytes = model->n_parameters() * sizeof(real_t);
 				logger::info("model size: {}", readable_size(n_bytes).c_str());
 		}
+		if (n_workers > 1) start_workers(optimizer, train);
+		defer([&] { stop_workers(); });
 
 		if (metric && !test) {
 				logger::warn("metric specified but no test data provided");
@@ -70,53 +78,174 @@ void Application_impl::train(Optimizer& optimizer,
 				auto& info = train_info.emplace_back();
 				info.epoch = n;
 
+				profiler::collect(); // discard whatever happened before
 				Timer epoch_timer;
 				epoch_timer.tic();
-				train.restart();
-				train.shuffle();
-				optimizer.set_epoch(n);
-				info.train_loss =
-					model->update(loss, optimizer, train, *thread_pool);
+				info.train_loss = train_epoch(n, optimizer, train);
 				if (test) {
 						test->restart();
 						info.test_loss =
 							model->evaluate(loss, *test, *thread_pool);
 						if (metric) {
+								PROFILE_SCOPE(Metric);
 								metric->reset();
 								test->restart();
 								metric->evaluate(*model, *test);
 								info.test_metric = metric->value();
+								auto& types = metric->types();
+								for (size_t i = 1; i < types.size(); ++i) {
+										info.other_metrics.push_back(
+											metric->value(types[i]));
+								}
 						}
 						update_train_stats();
 				}
 				epoch_timer.toc();
 				info.seconds = epoch_timer.seconds();
+				info.profile = profiler::collect();
 
 				logger::info(progress_fmt, n, info.train_loss, info.test_loss,
 							 info.test_metric, epoch_timer.seconds());
+				if (!info.other_metrics.empty()) {
+						auto& types = metric->types();
+						String others;
+						for (size_t i = 1; i < types.size(); ++i) {
+								auto name = Metric::name(types[i]);
+								auto x = info.other_metrics[i - 1];
+								if (std::isnan(x))
+										others.appendf(" %s=n/a", name.c_str());
+								else
+										others.appendf(" %s=%.4f", name.c_str(),
+													   x);
+						}
+						logger::info("{:6}|{}", "", others.c_str());
+				}
 
 				if (should_early_stop()) {
 						logger::info("early stopped at epoch {}", n);
 						break;
 				}
 		}
-		logger::info("restoring to best model at epoch {}...", best_epoch);
-		logger::info("best test loss={}; best metric={}",
-					 train_info[best_epoch - 1].test_loss,
-					 train_info[best_epoch - 1].test_metric);
-		model->restore_snapshot();
-
-		if (summary) {
-				*summary << "tr_loss,tt_loss,tt_metric,seconds,is_best"
-						 << std::endl;
-				for (auto& info : train_info) {
-						*summary
-							<< fmt::format("{},{},{},{},{}", info.train_loss,
-										   info.test_loss, info.test_metric,
-										   info.seconds,
-										   info.epoch == best_epoch ? "1" : "")
-							<< std::endl;
+		// without test data, the model of last epoch is kept
+		if (test) {
+				logger::info("restoring to best model at epoch {}...",
+							 best_epoch);
+				logger::info("best test loss={}; best metric={}",
+							 train_info[best_epoch - 1].test_loss,
+							 train_info[best_epoch - 1].test_metric);
+				model->restore_snapshot();
+		}
+
+		if (metric && test && metric->slice_field()) {
+				log_metric_slices(*test);
+		}
+
+		if (summary) write_summary();
+		if (trace) write_trace();
+}
+
+void Application_impl::write_summary() {
+		*summary << "tr_loss,tt_loss,tt_metric";
+		if (metric) {
+				auto& types = metric->types();
+				for (size_t i = 1; i < types.size(); ++i) {
+						*summary << ",tt_" << Metric::name(types[i]);
+				}
+		}
+		*summary << ",seconds,is_best,samples_per_sec,nnz_per_sec,mb_touched";
+		for (size_t s = 0; s < size_t(profiler::Section::N); ++s) {
+				*summary << ',' << profiler::name(profiler::Section(s)) << "_s";
+		}
+		*summary << std::endl;
+		for (auto& info : train_info) {
+				auto& total = info.profile.total;
+				*summary << fmt::format("{},{},{}", info.train_loss,
+										info.test_loss, info.test_metric);
+				for (auto x : info.other_metrics) {
+						*summary << ',' << x;
+				}
+				*summary << fmt::format(
+					",{},{},{},{},{}", info.seconds,
+					info.epoch == best_epoch ? "1" : "",
+					total.count(profiler::Counter::Samples) / info.seconds,
+					total.count(profiler::Counter::NNZ) / info.seconds,
+					total.count(profiler::Counter::BytesTouched) / 1e6);
+				for (size_t s = 0; s < size_t(profiler::Section::N); ++s) {
+						*summary << ',' << total.seconds(profiler::Section(s));
+				}
+				*summary << std::endl;
+		}
+}
+
+void Application_impl::write_trace() {
+		auto json_stats = [](const profiler::Stats& stats) {
+				String ret = String::printf("\"name\": \"%s\"",
+											stats.thread_name.c_str());
+				for (size_t s = 0; s < size_t(profiler::Section::N); ++s) {
+						auto section = profiler::Section(s);
+						ret.appendf(", \"%s_s\": %g", profiler::name(section),
+									stats.seconds(section));
+				}
+				for (size_t c = 0; c < size_t(profiler::Counter::N); ++c) {
+						auto counter = profiler::Counter(c);
+						ret.appendf(", \"%s\": %llu", profiler::name(counter),
+									(unsigned long long) stats.count(counter));
+				}
+				return ret;
+		};
+
+		*trace << "[\n";
+		for (auto& info : train_info) {
+				auto& total = info.profile.total;
+				*trace << fmt::format(
+					"  {{\"epoch\": {}, \"seconds\": {}, "
+					"\"samples_per_sec\": {}, \"nnz_per_sec\": {},\n",
+					info.epoch, info.seconds,
+					total.count(profiler::Counter::Samples) / info.seconds,
+					total.count(profiler::Counter::NNZ) / info.seconds);
+				*trace << "   \"total\": {" << json_stats(total) << "},\n";
+				*trace << "   \"threads\": [";
+				auto& threads = info.profile.threads;
+				for (size_t i = 0; i < threads.size(); ++i) {
+						auto& stats = threads[i];
+						// idle time only makes sense for pool workers
+						auto busy = stats.seconds(profiler::Section::Busy);
+						auto idle = busy > 0 ? info.seconds - busy : 0;
+						*trace << "\n    {" << json_stats(stats)
+							   << fmt::format(", \"idle_s\": {}}}", idle);
+						if (i + 1 != threads.size()) *trace << ',';
+				}
+				*trace << "]}";
+				if (&info != &train_info.back()) *trace << ',';
+				*trace << '\n';
+		}
+		*trace << "]" << std::endl;
+}
+
+void Application_impl::log_metric_slices(Sampler& test) {
+		metric->reset();
+		test.restart();
+		metric->evaluate(*model, test);
+
+		auto& types = metric->types();
+		String header = String::printf("%12s|%10s", "feature", "count");
+		for (auto type : types) {
+				header.appendf("|%10s", Metric::name(type).c_str());
+		}
+		logger::info("metrics of best model sliced by field {}:",
+					 *metric->slice_field());
+		logger::info("{}", header.c_str());
+		for (auto id : metric->slices()) {
+				String line = String::printf("%12zu|%10zu", id,
+											 metric->slice_size(id));
+				for (auto type : types) {
+						auto x = metric->slice_value(id, type);
+						if (std::isnan(x))
+								line.appendf("|%10s", "n/a");
+						else
+								line.appendf("|%10.4f", x);
 				}
+				logger::info("{}", line.c_str());
 		}
 }
 
@@ -0,0 +1,119 @@
+#include <catch2/catch.hpp>
+
+#include "base/logger.h"
+#include "data/sampler.h"
+#include "model/ffm.h"
+#include "model/fm.h"
+#include "zlearn.h"
+
+#include <thread>
+
+using namespace NAMESPACE_NAME;
+
+namespace {
+
+// samples in CSR, as given to zl_predict()
+struct Rows {
+		std::vector<uint64_t> offsets{0};
+		std::vector<uint32_t> fields;
+		std::vector<uint64_t> ids;
+		std::vector<float> values;
+
+		explicit Rows(const Entries& entries) {
+				for (auto& e : entries) {
+						for (auto& f : e->features) {
+								fields.push_back(f.field_id);
+								ids.push_back(f.id);
+								values.push_back(f.value);
+						}
+						offsets.push_back(ids.size());
+				}
+		}
+		size_t size() const { return offsets.size() - 1; }
+		int predict(const zl_model* model, unsigned flags, float* out) const {
+				return zl_predict(model, size(), offsets.data(), fields.data(),
+								  ids.data(), values.data(), flags, out);
+		}
+};
+
+template <typename M>
+void check_model(M& model, const char* path) {
+		// ids beyond those of model are of new features, which are skipped
+		auto data = DataSet::dummy(200, 60, 4, 5, 21);
+		for (auto& e : data->entries()) {
+				for (auto& f : e->features) {
+						f.value = 0.5 + f.id % 3;
+				}
+		}
+		model.serialize(path);
+		auto loaded = zl_model_load(path);
+		REQUIRE(loaded);
+		Rows rows(data->entries());
+		for (unsigned flags : {0u, unsigned(ZL_NORMALIZE)}) {
+				std::vector<float> out(rows.size());
+				REQUIRE(rows.predict(loaded, flags, out.data()) == 0);
+				for (size_t r = 0; r < rows.size(); ++r) {
+						Entry entry = *(*data)[r];
+						if (flags & ZL_NORMALIZE) entry.normalize();
+						auto y = model.calibrated_predict(entry);
+						REQUIRE(out[r] == Approx(y));
+				}
+		}
+
+		// shared by threads
+		std::vector<float> expected(rows.size());
+		rows.predict(loaded, 0, expected.data());
+		std::vector<std::vector<float>> outs(4);
+		std::vector<std::thread> threads;
+		for (auto& out : outs) {
+				threads.emplace_back([&]() {
+						out.resize(rows.size());
+						for (int i = 0; i < 20; ++i) {
+								rows.predict(loaded, 0, out.data());
+						}
+				});
+		}
+		for (auto& t : threads) {
+				t.join();
+		}
+		for (auto& out : outs) {
+				REQUIRE(out == expected);
+		}
+		zl_model_free(loaded);
+}
+
+} // namespace
+
+TEST_CASE("C API") {
+		logger::initialize();
+		try {
+				REQUIRE(zl_api_version() == ZL_API_VERSION);
+				auto data = DataSet::dummy(100, 40, 4, 5, 20);
+				auto sampler = Sampler::create(data);
+				SECTION("FM") {
+						FM fm(8);
+						fm.initialize(*sampler, {});
+						fm.w.setRandom();
+						fm.logit_offset(-1);
+						check_model(fm, "capi_fm.bin");
+				}
+				SECTION("FFM") {
+						FFM ffm(4);
+						ffm.initialize(*sampler, {});
+						ffm.w.setRandom();
+						check_model(ffm, "capi_ffm.bin");
+				}
+				SECTION("errors") {
+						REQUIRE(zl_model_load("no-such-model.bin") == nullptr);
+						REQUIRE(std::string(zl_last_error()) != "");
+						float out;
+						uint64_t offsets[] = {0, 0};
+						int status = zl_predict(nullptr, 1, offsets, nullptr,
+												nullptr, nullptr, 0, &out);
+						REQUIRE(status == -1);
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
@@ -1,7 +1,14 @@
 #include <catch2/catch.hpp>
 
 #include "base/logger.h"
+#include "base/thread_pool.h"
+#include "data/block_file.h"
 #include "data/data_set.h"
+#include "data/data_stream.h"
+#include "data/feature_columns.h"
+#include "data/sampler.h"
+
+#include <unistd.h>
 
 using namespace NAMESPACE_NAME;
 
@@ -16,34 +23,38 @@ TEST_CASE("serialization & deserialization") {
 				row->label = 0;
 				row->features.emplace_back(1, 1, 1);
 				row->features.emplace_back(2, 4, 0.5);
-				row->set_normalize(true);
+				row->normalize();
 
 				row = m.add_entry();
 				row->label = 1;
 				row->features.emplace_back(1, 2, 1);
 				row->features.emplace_back(2, 5, 0.3);
-				row->set_normalize(true);
+				row->normalize();
 
 				row = m.add_entry();
 				row->label = 0;
 				row->features.emplace_back(1, 3, 1);
 				row->features.emplace_back(2, 6, 0.1);
-				row->set_normalize(true);
+				row->normalize();
 
 				m.serialize("data.out");
 
 				m = DataSet();
 				m.deserialize("data.out");
 				REQUIRE(m[0]->label == 0);
-				REQUIRE(m[0]->get_inv_norm2() == real_t(0.89442719));
-				REQUIRE(m(0, 0) == Feature(1, 1, 1));
-				REQUIRE(m(0, 1) == Feature(2, 4, 0.5));
+				REQUIRE(m[0]->scale == Approx(0.89442719));
+				REQUIRE(m(0, 0).value == Approx(0.89442719));
+				REQUIRE(m(0, 1).value / m[0]->scale == Approx(0.5));
 				REQUIRE(m[1]->label == 1);
-				REQUIRE(m(1, 0) == Feature(1, 2, 1));
-				REQUIRE(m(1, 1) == Feature(2, 5, 0.3));
+				REQUIRE(m(1, 0).id == 2);
+				REQUIRE(m(1, 1).value / m[1]->scale == Approx(0.3));
 				REQUIRE(m[2]->label == 0);
-				REQUIRE(m(2, 0) == Feature(1, 3, 1));
-				REQUIRE(m(2, 1) == Feature(2, 6, 0.1));
+				REQUIRE(m(2, 0).field_id == 1);
+				REQUIRE(m(2, 1).value / m[2]->scale == Approx(0.1));
+				// normalizing again is a no-op
+				auto copy = *m[0];
+				m[0]->normalize();
+				REQUIRE(*m[0] == copy);
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				throw;
@@ -73,3 +84,137 @@ TEST_CASE("parse from text") {
 				throw;
 		}
 }
+
+TEST_CASE("parse weights") {
+		logger::initialize();
+		try {
+				LineParser parser("1:0.5 0:3:1 1:7:0.5", false);
+				REQUIRE(parser.has_label());
+				Entry entry;
+				std::string line = "0:2.5 0:3:1 1:7:0.5";
+				REQUIRE(parser.parse(line, entry));
+				REQUIRE(entry.label == 0);
+				REQUIRE(entry.weight == 2.5);
+				REQUIRE(entry.features.size() == 2);
+				Entry unweighted;
+				line = "1 0:4:1";
+				REQUIRE(parser.parse(line, unweighted));
+				REQUIRE(unweighted.weight == 1);
+				// malformed features are rejected rather than misread
+				for (std::string bad : {"1 0:4", "1 0:4:1:2", "1 4"}) {
+						Entry ignored;
+						REQUIRE_THROWS(parser.parse(bad, ignored));
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("parse from stream") {
+		logger::initialize();
+		try {
+				auto data = DataSet::from_file("ffm_with_label.txt", false);
+				data->sort_entries();
+				DataStream stream("ffm_with_label.txt", false, false);
+				Entries entries;
+				while (stream.read(2, entries)) {
+						REQUIRE(stream.has_label());
+				}
+				REQUIRE(stream.eof());
+				REQUIRE(*data == DataSet(entries, true));
+
+				// a slow writer yields partial batches by deadline
+				int fds[2];
+				REQUIRE(::pipe(fds) == 0);
+				DataStream pipe("/dev/fd/" + std::to_string(fds[0]), false,
+								false);
+				::close(fds[0]);
+				std::string lines = "1 1:1 2:1\n0 3:1\n1 4:1";
+				REQUIRE(::write(fds[1], lines.data(), lines.size())
+						== ssize_t(lines.size()));
+				entries.clear();
+				auto deadline = Clock::now() + std::chrono::milliseconds(20);
+				REQUIRE(pipe.read(10, entries, deadline) == 2);
+				REQUIRE(!pipe.eof());
+				REQUIRE(pipe.read(10, entries, Clock::now()) == 0);
+				::close(fds[1]);
+				REQUIRE(pipe.read(10, entries) == 1);
+				REQUIRE(pipe.eof());
+				REQUIRE(entries.back()->features.size() == 1);
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("block file") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(1000, 100000, 5, 10, 1);
+				// values other than 1, unsorted ids and empty entries
+				for (size_t i = 0; i < data->size(); i += 7) {
+						auto& features = (*data)[i]->features;
+						features[i % features.size()].value = 0.25 * i;
+						std::reverse(features.begin(), features.end());
+				}
+				(*data)[3]->features.clear();
+				(*data)[5]->weight = 2.5;
+				ThreadPool pool(4);
+				BlockFile::write("data.zlb", *data, pool, 64);
+				REQUIRE(BlockFile::is_block_file("data.zlb"));
+				REQUIRE_FALSE(BlockFile::is_block_file("ffm_with_label.txt"));
+
+				BlockFile file("data.zlb");
+				REQUIRE(file.size() == data->size());
+				REQUIRE(file.n_blocks() == 16);
+				auto loaded = file.load(pool);
+				REQUIRE(*loaded == *data);
+
+				data->sort_entries();
+				auto sampler = Sampler::create(
+					std::make_shared<BlockFile>("data.zlb"), false);
+				Entries all;
+				while (sampler->get_samples(100, all)) {}
+				REQUIRE(DataSet(all, true) == *data);
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("feature columns") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(200, 50, 4, 6, 3);
+				auto& entries = data->entries();
+				FeatureColumns columns(entries, 40);
+				REQUIRE(columns.n_rows() == entries.size());
+				REQUIRE(columns.n_features() == 40);
+				size_t nnz = 0;
+				for (size_t r = 0; r < entries.size(); ++r) {
+						for (auto& x : entries[r]->features) {
+								if (x.id < 40) ++nnz;
+						}
+				}
+				REQUIRE(columns.nnz() == nnz);
+				// every cell is where the feature is in its row, rows ascending
+				for (size_t j = 0; j < columns.n_features(); ++j) {
+						size_t begin = columns.begin(j);
+						for (size_t i = begin; i < columns.end(j); ++i) {
+								u32 r = columns.row(i);
+								if (i > begin) REQUIRE(columns.row(i - 1) <= r);
+								auto& features = entries[r]->features;
+								REQUIRE(std::any_of(
+									features.begin(), features.end(),
+									[&](auto& x) {
+											return x.id == j
+												&& x.value == columns.value(i);
+									}));
+						}
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+
+#include "base/logger.h"
+#include "model/loss.h"
+
+#include <vector>
+
+using namespace NAMESPACE_NAME;
+
+TEST_CASE("batch loss and gradient") {
+		logger::initialize();
+		std::vector<real_t> pred = {-30, -2.5, -0.5, 0, 0.3, 0.9, 1.5, 40};
+		std::vector<real_t> label = {0, 1, 0, 1, 1, 0, 3, 1};
+		std::vector<real_t> weight = {1, 2, 0.5, 1, 1, 3, 1, 0.25};
+		size_t n = pred.size();
+		for (auto loss : {Loss::Squared, Loss::CrossEntropy, Loss::Hinge,
+						  Loss::Poisson, Loss::Huber}) {
+				std::vector<real_t> pg(n);
+				real_t sum = loss_and_grad(loss, n, pred.data(), label.data(),
+										   weight.data(), pg.data());
+				REQUIRE(sum == Approx(loss_and_grad(loss, n, pred.data(),
+													label.data(),
+													weight.data())));
+				real_t expected = 0;
+				for (size_t i = 0; i < n; ++i) {
+						real_t p = pred[i], y = label[i], w = weight[i];
+						real_t s = y > 0 ? 1 : -1, e = p - y;
+						switch (loss) {
+						case Loss::Squared: expected += w * e * e / 2; break;
+						case Loss::CrossEntropy:
+								expected += w * std::log1p(std::exp(-s * p));
+								break;
+						case Loss::Hinge:
+								expected += w * std::max<real_t>(0, 1 - s * p);
+								break;
+						case Loss::Poisson:
+								expected += w * (std::exp(p) - y * p);
+								break;
+						case Loss::Huber:
+								expected += w
+									* (std::abs(e) <= 1 ? e * e / 2
+														: std::abs(e) - 0.5);
+								break;
+						}
+						auto grad = loss_grad(loss, p, y, w);
+						REQUIRE(pg[i] == Approx(grad).margin(1e-6));
+				}
+				REQUIRE(sum == Approx(expected).epsilon(1e-4));
+		}
+}
@@ -0,0 +1,70 @@
+#include <catch2/catch.hpp>
+
+#include "base/logger.h"
+#include "model/metric.h"
+#include "data/data_set.h"
+
+using namespace NAMESPACE_NAME;
+
+TEST_CASE("metrics in one pass") {
+		logger::initialize();
+		try {
+				auto data = std::make_shared<DataSet>();
+				data->has_label(true);
+				// predicted logits; positives are ranked above negatives
+				// except for one pair
+				std::vector<real_t> pred = {3, 2, -1, 1, -2, -3};
+				std::vector<real_t> label = {1, 1, 1, 0, 0, 0};
+				for (size_t i = 0; i < pred.size(); ++i) {
+						auto& e = data->add_entry();
+						e->label = label[i];
+						e->features.emplace_back(i % 2, i % 2, 1);
+				}
+				auto& entries = const_cast<Entries&>(data->entries());
+
+				Metric metric({Metric::AUC, Metric::Accuracy, Metric::Precision,
+							   Metric::Recall, Metric::LogLoss, Metric::NE,
+							   Metric::PRAUC, Metric::Calibration});
+				metric.slice_by(0);
+				metric.accumulate(pred.data(), entries.data(), pred.size());
+
+				REQUIRE(metric.type() == Metric::AUC);
+				REQUIRE(metric.value() == Approx(8.0 / 9));
+				REQUIRE(metric.value(Metric::Accuracy) == Approx(4.0 / 6));
+				REQUIRE(metric.value(Metric::Precision) == Approx(2.0 / 3));
+				REQUIRE(metric.value(Metric::Recall) == Approx(2.0 / 3));
+				REQUIRE(metric.value(Metric::PRAUC)
+						== Approx((1 + 1 + 3.0 / 4) / 3));
+
+				double log_loss = 0, ctr = 0;
+				for (size_t i = 0; i < pred.size(); ++i) {
+						double y = label[i] > 0 ? 1 : -1;
+						log_loss += std::log1p(std::exp(-y * pred[i]));
+						ctr += 1 / (1 + std::exp(-pred[i]));
+				}
+				log_loss /= pred.size();
+				REQUIRE(metric.value(Metric::LogLoss) == Approx(log_loss));
+				REQUIRE(metric.value(Metric::NE)
+						== Approx(log_loss / std::log(2.0)));
+				REQUIRE(metric.value(Metric::Calibration) == Approx(ctr / 3));
+
+				// entries 0, 2, 4 have feature 0 in field 0
+				REQUIRE(metric.slices() == std::vector<size_t>{0});
+				REQUIRE(metric.slice_size(0) == 3);
+				REQUIRE(metric.slice_value(0, Metric::AUC) == Approx(1.0));
+
+				metric.reset();
+				metric.accumulate(pred.data(), entries.data(), 2);
+				REQUIRE(metric.value(Metric::Recall) == Approx(1.0));
+				// undefined without negatives, or positives
+				REQUIRE(std::isnan(metric.value(Metric::NE)));
+				metric.reset();
+				metric.accumulate(pred.data() + 3, entries.data() + 3, 3);
+				REQUIRE(std::isnan(metric.value(Metric::NE)));
+				REQUIRE(std::isnan(metric.value(Metric::Calibration)));
+				REQUIRE(std::isnan(metric.slice_value(0, Metric::Calibration)));
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
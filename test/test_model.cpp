@@ -1,14 +1,18 @@
 #include <catch2/catch.hpp>
 
-#define LOGGER_OSTREAM
-
 #include "base/logger.h"
+#include "base/thread_pool.h"
 #include "model/ffm.h"
 #include "model/fm.h"
+#include "model/fwfm.h"
 #include "model/hofm.h"
 #include "model/lm.h"
+#include "model/mips_index.h"
+#include "model/recommender.h"
 #include "optimizer/optimizer.h"
 
+#include <utility>
+
 using namespace NAMESPACE_NAME;
 
 TEST_CASE("LM") {
@@ -19,13 +23,15 @@ TEST_CASE("LM") {
 				LM model;
 				auto adagrad = std::make_shared<AdaGrad>(0, 0);
 				model.initialize(*sampler, adagrad->extras());
-				logger::debug("b=\n{}", model.b);
-				logger::debug("w=\n{}", model.w);
+				model.logit_offset(std::log(0.1));
+				logger::debug("b=\n{}", to_string(model.b));
+				logger::debug("w=\n{}", to_string(model.w));
 				model.serialize("lm.bin");
 				LM new_model;
 				new_model.deserialize("lm.bin");
-				logger::debug("b=\n{}", new_model.b);
-				logger::debug("w=\n{}", new_model.w);
+				REQUIRE(new_model.logit_offset() == Approx(std::log(0.1)));
+				logger::debug("b=\n{}", to_string(new_model.b));
+				logger::debug("w=\n{}", to_string(new_model.w));
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				throw;
@@ -39,15 +45,15 @@ TEST_CASE("FM") {
 				FM model(4);
 				auto adagrad = std::make_shared<AdaGrad>(0, 0);
 				model.initialize(*sampler, adagrad->extras());
-				logger::debug("b=\n{}", model.b);
-				logger::debug("w=\n{}", model.w);
-				logger::debug("v=\n{}", model.v);
+				logger::debug("b=\n{}", to_string(model.b));
+				logger::debug("w=\n{}", to_string(model.w));
+				logger::debug("v=\n{}", to_string(model.v));
 				model.serialize("fm.bin");
 				FM new_model(0);
 				new_model.deserialize("fm.bin");
-				logger::debug("b=\n{}", new_model.b);
-				logger::debug("w=\n{}", new_model.w);
-				logger::debug("v=\n{}", new_model.v);
+				logger::debug("b=\n{}", to_string(new_model.b));
+				logger::debug("w=\n{}", to_string(new_model.w));
+				logger::debug("v=\n{}", to_string(new_model.v));
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				throw;
@@ -61,15 +67,156 @@ TEST_CASE("FFM") {
 				FFM model(4);
 				auto adagrad = std::make_shared<AdaGrad>(0, 0);
 				model.initialize(*sampler, adagrad->extras());
-				logger::debug("b=\n{}", model.b);
-				logger::debug("w=\n{}", model.w);
-				logger::debug("v=\n{}", model.v);
+				logger::debug("b=\n{}", to_string(model.b));
+				logger::debug("w=\n{}", to_string(model.w));
+				logger::debug("v=\n{}", to_string(model.v));
 				model.serialize("ffm.bin");
 				FFM new_model(0);
 				new_model.deserialize("ffm.bin");
-				logger::debug("b=\n{}", new_model.b);
-				logger::debug("w=\n{}", new_model.w);
-				logger::debug("v=\n{}", new_model.v);
+				logger::debug("b=\n{}", to_string(new_model.b));
+				logger::debug("w=\n{}", to_string(new_model.w));
+				logger::debug("v=\n{}", to_string(new_model.v));
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+TEST_CASE("FwFM") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(20, 30, 4, 8, 6);
+				data->normalize();
+				auto sampler = Sampler::create(data);
+				auto adam = std::make_shared<Adam>(1e-2, 1e-4, 0.9, 0.999);
+				FwFM model(4);
+				model.initialize(*sampler, adam->extras());
+				REQUIRE(model.r.rows() == 4);
+				// cells of f > g are unused, and zero
+				REQUIRE(model.r.bottomLeftCorner(3, 3).isZero());
+				for (size_t i = 0; i < data->size(); ++i) {
+						auto& e = *(*data)[i];
+						real_t before = model.predict(e);
+						adam->optimize(model, e, 0.5);
+						REQUIRE(model.predict(e) < before);
+				}
+				REQUIRE(model.get_r(0, 1) != 1);
+				REQUIRE(model.get_r(2, 1) == model.get_r(1, 2));
+
+				// against interactions over all pairs
+				for (size_t i = 0; i < data->size(); ++i) {
+						auto& e = *(*data)[i];
+						auto& x = e.features;
+						real_t y = model.b[0];
+						for (size_t a = 0; a < x.size(); ++a) {
+								y += model.w(x[a].id, 0) * x[a].value;
+								auto v_a = model.v.row(x[a].id).head(4);
+								for (size_t b = a + 1; b < x.size(); ++b) {
+										auto v_b = model.v.row(x[b].id).head(4);
+										y += model.get_r(x[a].field_id,
+														 x[b].field_id)
+											* v_a.dot(v_b) * x[a].value
+											* x[b].value;
+								}
+						}
+						REQUIRE(model.predict(e) == Approx(y));
+				}
+
+				// gradient of latent vectors, taken by a step of SGD, against
+				// finite differences
+				Entry e;
+				e.features = {
+					{0, 1, 0.5}, {1, 2, 2}, {1, 3, -1.5}, {3, 5, 1.2}};
+				real_t h = 1e-2, eta = 1e-3;
+				Matrix<Dynamic, Dynamic> numeric(e.features.size(), 4);
+				for (size_t i = 0; i < e.features.size(); ++i) {
+						for (size_t c = 0; c < 4; ++c) {
+								auto& v_ic = model.v(e.features[i].id, c);
+								real_t v_0 = v_ic;
+								v_ic = v_0 + h;
+								real_t y_1 = model.predict(e);
+								v_ic = v_0 - h;
+								real_t y_0 = model.predict(e);
+								v_ic = v_0;
+								numeric(i, c) = (y_1 - y_0) / (2 * h);
+						}
+				}
+				auto saved = model.v;
+				SGD(eta, 0).optimize(model, e, 1);
+				for (size_t i = 0; i < e.features.size(); ++i) {
+						auto id = e.features[i].id;
+						for (size_t c = 0; c < 4; ++c) {
+								real_t step = saved(id, c) - model.v(id, c);
+								real_t g = step / eta;
+								auto expected = Approx(numeric(i, c));
+								REQUIRE(g == expected.margin(1e-3));
+						}
+				}
+				model.v = saved;
+
+				model.serialize("fwfm.bin", true);
+				auto loaded = Model::from_file("fwfm.bin");
+				REQUIRE(loaded->extras() == adam->extras());
+				auto& fwfm = dynamic_cast<FwFM&>(*loaded);
+				for (size_t f = 0; f < model.n_f; ++f) {
+						for (size_t g = 0; g < model.n_f; ++g) {
+								for (size_t x = 0; x <= 2; ++x) {
+										REQUIRE(fwfm.get_r(f, g, x)
+												== model.get_r(f, g, x));
+								}
+						}
+				}
+				REQUIRE(fwfm.v == model.v);
+				for (size_t i = 0; i < data->size(); ++i) {
+						auto& e = *(*data)[i];
+						REQUIRE(loaded->predict(e) == Approx(model.predict(e)));
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+TEST_CASE("fixed-size kernels") {
+		logger::initialize();
+		try {
+				// rows long and short, with features unknown to the model
+				auto data = DataSet::dummy(50, 40, 4, 13, 5);
+				data->normalize();
+				auto adam = std::make_shared<Adam>(1e-2, 1e-4, 0.9, 0.999);
+				// k of fixed-size kernels, and one that is not
+				for (size_t k : {8, 5}) {
+						auto sampler = Sampler::create(data);
+						FM model(k);
+						model.initialize(*sampler, adam->extras());
+						for (size_t i = 0; i < data->size(); ++i) {
+								adam->optimize(model, *(*data)[i], 0.5);
+						}
+						model.n = 30;
+						for (size_t i = 0; i < data->size(); ++i) {
+								auto& x = (*data)[i]->features;
+								auto known = [&](size_t a) {
+										return x[a].id < model.n;
+								};
+								auto v = [&](size_t a) {
+										return model.v.row(x[a].id).head(k);
+								};
+								real_t y_l = 0, y = model.b[0];
+								for (size_t a = 0; a < x.size(); ++a) {
+										if (!known(a)) continue;
+										y_l += model.w(x[a].id, 0) * x[a].value;
+										for (size_t b = 0; b < a; ++b) {
+												if (!known(b)) continue;
+												y += v(a).dot(v(b)) * x[a].value
+													* x[b].value;
+										}
+								}
+								auto& w = model.w;
+								size_t n = model.n;
+								REQUIRE(sparse_dot(w.data(), w.cols(), n, x)
+										== Approx(y_l));
+								REQUIRE(model.predict(*(*data)[i])
+										== Approx(y + y_l).margin(1e-5));
+						}
+				}
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				throw;
@@ -83,17 +230,467 @@ TEST_CASE("HOFM") {
 				HOFM model(3, 4);
 				auto adagrad = std::make_shared<AdaGrad>(0, 0);
 				model.initialize(*sampler, adagrad->extras());
-				logger::debug("b=\n{}", model.b);
-				logger::debug("w=\n{}", model.w);
-				logger::debug("v0=\n{}", model.v[0]);
-				logger::debug("v1=\n{}", model.v[1]);
+				logger::debug("b=\n{}", to_string(model.b));
+				logger::debug("w=\n{}", to_string(model.w));
+				logger::debug("v0=\n{}", to_string(model.v[0]));
+				logger::debug("v1=\n{}", to_string(model.v[1]));
 				model.serialize("hofm.bin");
 				HOFM new_model(0, 0);
 				new_model.deserialize("hofm.bin");
-				logger::debug("b=\n{}", new_model.b);
-				logger::debug("w=\n{}", new_model.w);
-				logger::debug("v0=\n{}", new_model.v[0]);
-				logger::debug("v1=\n{}", new_model.v[1]);
+				logger::debug("b=\n{}", to_string(new_model.b));
+				logger::debug("w=\n{}", to_string(new_model.w));
+				logger::debug("v0=\n{}", to_string(new_model.v[0]));
+				logger::debug("v1=\n{}", to_string(new_model.v[1]));
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+TEST_CASE("HOFM ANOVA kernel") {
+		logger::initialize();
+		try {
+				auto data = std::make_shared<DataSet>();
+				auto& e = *data->add_entry();
+				e.features = {{0, 0, 0.5}, {1, 1, -1}, {2, 2, 2}, {3, 3, 1.5}};
+				auto sampler = Sampler::create(data);
+				HOFM model(3, 2);
+				auto sgd = std::make_shared<SGD>(1e-3, 0);
+				model.initialize(*sampler, sgd->extras());
+				auto& features = e.features;
+				size_t d = features.size();
+				// deterministic parameters of moderate magnitude, so that
+				// results are not dominated by rounding errors
+				for (size_t m = 2; m <= model.order; ++m) {
+						for (size_t i = 0; i < model.n; ++i) {
+								for (size_t c = 0; c < model.k; ++c) {
+										model.get_p(m, i)[c] =
+											0.1 * m + 0.1 * i - 0.2 * c;
+								}
+						}
+				}
+
+				// brute force sum over all pairs and triples
+				auto brute_force = [&]() {
+						double y = 0;
+						for (size_t c = 0; c < model.k; ++c) {
+								for (size_t i = 0; i < d; ++i) {
+										auto& fi = features[i];
+										auto xi = fi.value;
+										for (size_t j = i + 1; j < d; ++j) {
+												auto& fj = features[j];
+												auto xj = fj.value;
+												y += model.get_p(2, fi.id)[c]
+													* model.get_p(2, fj.id)[c]
+													* xi * xj;
+												for (size_t l = j + 1; l < d;
+													 ++l) {
+														auto& fl = features[l];
+														y += model.get_p(
+																 3, fi.id)[c]
+															* model.get_p(
+																3, fj.id)[c]
+															* model.get_p(
+																3, fl.id)[c]
+															* xi * xj
+															* fl.value;
+												}
+										}
+								}
+						}
+						return y;
+				};
+				REQUIRE(model.predict(e) == Approx(brute_force()));
+
+				// one SGD step moves p along the negative gradient
+				auto p = model.v[1];
+				model.predict(e);
+				sgd->optimize(model, e, 1);
+				for (size_t i = 0; i < d; ++i) {
+						for (size_t c = 0; c < model.k; ++c) {
+								auto& x = model.v[1](features[i].id, c);
+								auto updated = x;
+								x = p(features[i].id, c);
+								real_t eps = 1e-2;
+								x += eps;
+								auto y1 = brute_force();
+								x -= 2 * eps;
+								auto y0 = brute_force();
+								x = updated;
+								auto grad = (y1 - y0) / (2 * eps);
+								REQUIRE((p(features[i].id, c) - updated) / 1e-3
+										== Approx(grad).epsilon(1e-2).margin(
+											1e-3));
+						}
+				}
+
+				// unseen features are skipped without reordering the sample
+				auto expected = model.predict(e);
+				features.insert(features.begin() + 1, {1, 9, 3});
+				auto unseen = features;
+				REQUIRE(model.predict(e) == Approx(expected));
+				REQUIRE(features == unseen);
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+TEST_CASE("sparse FFM") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(20, 50, 5, 4, 1);
+				auto sampler = Sampler::create(data);
+				auto adam = std::make_shared<Adam>(1e-2, 0, 0.9, 0.999);
+				FFM model(4, true);
+				model.initialize(*sampler, adam->extras());
+				// far less than 50 features * 5 fields
+				REQUIRE(model.n_blocks <= 20 * 4 * 3);
+				REQUIRE(model.v.size() == 0);
+				// blocks allocated afresh are drawn anew
+				Vector<Dynamic> v1 = model.get_v(1000, 0);
+				Vector<Dynamic> v2 = model.get_v(1001, 0);
+				REQUIRE(v1 != v2);
+
+				std::vector<real_t> predicted;
+				for (size_t i = 0; i < data->size(); ++i) {
+						auto& e = *(*data)[i];
+						model.predict(e);
+						adam->optimize(model, e, 0.5);
+						predicted.push_back(model.predict(e));
+				}
+				model.serialize("sffm.bin");
+				auto loaded = Model::from_file("sffm.bin");
+				for (size_t i = 0; i < data->size(); ++i) {
+						REQUIRE(loaded->predict(*(*data)[i])
+								== Approx(model.predict(*(*data)[i])));
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("aggregated FFM") {
+		logger::initialize();
+		try {
+				// 30 features in 3 fields per row, many per field
+				auto data = DataSet::dummy(20, 200, 3, 30, 3);
+				data->normalize();
+				auto adam = std::make_shared<Adam>(1e-2, 1e-4, 0.9, 0.999);
+				for (bool sparse : {false, true}) {
+						auto sampler = Sampler::create(data);
+						FFM model(4, sparse);
+						model.initialize(*sampler, adam->extras());
+						model.engine = FFM::Engine::Aggregated;
+						for (size_t i = 0; i < data->size(); ++i) {
+								auto& e = *(*data)[i];
+								REQUIRE(model.aggregated(e));
+								real_t before = model.predict(e);
+								adam->optimize(model, e, 0.5);
+								REQUIRE(model.predict(e) < before);
+						}
+						for (size_t i = 0; i < data->size(); ++i) {
+								auto& e = *(*data)[i];
+								model.engine = FFM::Engine::Aggregated;
+								real_t aggregated = model.predict(e);
+								model.engine = FFM::Engine::Pairwise;
+								REQUIRE(!model.aggregated(e));
+								REQUIRE(model.predict(e) == Approx(aggregated));
+								model.engine = FFM::Engine::Auto;
+								REQUIRE(model.aggregated(e));
+						}
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("FFM unknown features") {
+		logger::initialize();
+		try {
+				// features of fields or ids never trained on add nothing
+				auto data = DataSet::dummy(20, 200, 3, 30, 3);
+				data->normalize();
+				for (bool sparse : {false, true}) {
+						auto sampler = Sampler::create(data);
+						FFM model(4, sparse);
+						model.initialize(*sampler, {});
+						for (auto engine :
+							 {FFM::Engine::Pairwise, FFM::Engine::Aggregated}) {
+								model.engine = engine;
+								for (size_t i = 0; i < data->size(); ++i) {
+										Entry e = *(*data)[i];
+										real_t y = model.predict(e);
+										auto& fs = e.features;
+										fs.emplace_back(1000, 5, 0.5);
+										fs.emplace_back(1, 100000, 0.5);
+										fs.emplace_back(1001, 100001, 1);
+										REQUIRE(model.predict(e) == Approx(y));
+								}
+						}
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("field pairs") {
+		logger::initialize();
+		try {
+				auto pairs = FieldPairs::parse("2:1, 0:*\n3:3");
+				REQUIRE(pairs(1, 2));
+				REQUIRE(pairs(5, 0));
+				REQUIRE(pairs(3, 3));
+				REQUIRE(!pairs(1, 3));
+				REQUIRE(!pairs(4, 5));
+				REQUIRE(pairs.referenced(7));
+				REQUIRE(FieldPairs::parse(pairs.to_string()) == pairs);
+				REQUIRE(FieldPairs::parse("*:*").empty());
+				REQUIRE_THROWS(FieldPairs::parse("0-1"));
+
+				auto data = DataSet::dummy(20, 60, 4, 12, 5);
+				auto adam = std::make_shared<Adam>(1e-2, 1e-4, 0.9, 0.999);
+				for (bool sparse : {false, true}) {
+						auto sampler = Sampler::create(data);
+						FFM model(4, sparse);
+						// field 3 interacts with none
+						model.field_pairs = FieldPairs::parse("0:1,0:2,2:2");
+						model.initialize(*sampler, adam->extras());
+						if (!sparse) REQUIRE(model.v.cols() == 3 * 4 * 3);
+						for (size_t i = 0; i < data->size(); ++i) {
+								adam->optimize(model, *(*data)[i], 0.5);
+						}
+						model.serialize("mffm.bin");
+						auto loaded = Model::from_file("mffm.bin");
+						auto& ffm = dynamic_cast<FFM&>(*loaded);
+						REQUIRE(ffm.field_pairs == model.field_pairs);
+						for (size_t i = 0; i < data->size(); ++i) {
+								auto& e = *(*data)[i];
+								model.engine = FFM::Engine::Pairwise;
+								real_t pairwise = model.predict(e);
+								model.engine = FFM::Engine::Aggregated;
+								REQUIRE(model.predict(e) == Approx(pairwise));
+								REQUIRE(ffm.predict(e) == Approx(pairwise));
+						}
+				}
+
+				auto sampler = Sampler::create(data);
+				FM fm(4);
+				fm.initialize(*sampler, adam->extras());
+				for (size_t i = 0; i < data->size(); ++i) {
+						adam->optimize(fm, *(*data)[i], 0.5);
+				}
+				std::vector<real_t> full;
+				for (size_t i = 0; i < data->size(); ++i) {
+						full.push_back(fm.predict(*(*data)[i]));
+				}
+				// all pairs spelled out
+				fm.field_pairs =
+					FieldPairs::parse("0:0,0:1,0:2,0:3,1:*,2:2,2:3,3:3");
+				for (size_t i = 0; i < data->size(); ++i) {
+						REQUIRE(fm.predict(*(*data)[i]) == Approx(full[i]));
+				}
+				fm.field_pairs = FieldPairs::parse("0:1");
+				for (size_t i = 0; i < data->size(); ++i) {
+						auto& e = *(*data)[i];
+						real_t before = fm.predict(e);
+						adam->optimize(fm, e, 0.5);
+						REQUIRE(fm.predict(e) < before);
+				}
+				fm.serialize("mfm.bin");
+				auto loaded = Model::from_file("mfm.bin");
+				auto& loaded_fm = dynamic_cast<FM&>(*loaded);
+				REQUIRE(loaded_fm.field_pairs == fm.field_pairs);
+				REQUIRE(loaded->predict(*(*data)[0])
+						== Approx(fm.predict(*(*data)[0])));
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("warm start") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(20, 30, 5, 4, 1);
+				auto sampler = Sampler::create(data);
+				auto adam = std::make_shared<Adam>(1e-2, 0, 0.9, 0.999);
+				for (bool sparse : {false, true}) {
+						FFM model(4, sparse);
+						model.initialize(*sampler, adam->extras());
+						model.optimizer(adam->name());
+						for (size_t i = 0; i < data->size(); ++i) {
+								adam->optimize(model, *(*data)[i], 0.5);
+						}
+						model.serialize("ffm.bin", true);
+						auto loaded = Model::from_file("ffm.bin");
+						REQUIRE(loaded->extras() == adam->extras());
+						REQUIRE(loaded->optimizer() == "adam");
+						auto& ffm = dynamic_cast<FFM&>(*loaded);
+						REQUIRE(ffm.w == model.w);
+						// by const lookups, which leave blocks of unseen pairs
+						// unallocated
+						auto& saved = std::as_const(model);
+						auto& restored = std::as_const(ffm);
+						for (size_t i = 0; i < model.n; ++i) {
+								for (size_t f = 0; f < model.n_f; ++f) {
+										for (size_t x = 0; x <= 2; ++x) {
+												auto v = saved.get_v(i, f, x);
+												REQUIRE(restored.get_v(i, f, x)
+														== v);
+										}
+								}
+						}
+
+						// new features grow with fresh extras
+						auto more = DataSet::dummy(20, 40, 5, 4, 2);
+						auto more_sampler = Sampler::create(more);
+						loaded->warm_start(*more_sampler, *adam);
+						auto max_id = DataSet::max_feature_id(more->entries());
+						REQUIRE(ffm.n == max_id + 1);
+						REQUIRE(ffm.w.row(ffm.n - 1).tail(2).isZero());
+						auto id = (*data)[0]->features[0].id;
+						REQUIRE(ffm.w.row(id) == model.w.row(id));
+						REQUIRE(!ffm.w.row(id).tail(2).isZero());
+
+						// extras alike of another optimizer are not kept
+						model.serialize("ffm.bin", true);
+						loaded = Model::from_file("ffm.bin");
+						AdamUnbiased unbiased(1e-2, 0, 0.9, 0.999);
+						REQUIRE(unbiased.extras() == adam->extras());
+						loaded->warm_start(*sampler, unbiased);
+						REQUIRE(loaded->optimizer() == "adam-unbias");
+						auto& fresh = dynamic_cast<FFM&>(*loaded);
+						REQUIRE(fresh.w.rightCols(2).isZero());
+
+						// plain model gets extras of another optimizer
+						model.serialize("ffm.bin");
+						loaded = Model::from_file("ffm.bin");
+						REQUIRE(loaded->extras().empty());
+						auto adagrad = std::make_shared<AdaGrad>(0.1, 0);
+						loaded->warm_start(*sampler, *adagrad);
+						REQUIRE(loaded->extras() == adagrad->extras());
+						auto& plain = dynamic_cast<FFM&>(*loaded);
+						REQUIRE(plain.w.col(0) == model.w.col(0));
+						REQUIRE(plain.w.col(1).isOnes());
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("recommender") {
+		logger::initialize();
+		try {
+				// features 0-19 are of users and 20-59 of items
+				auto users = DataSet::dummy(100, 20, 2, 3, 11);
+				auto items = DataSet::dummy(300, 40, 2, 4, 12);
+				for (auto& e : items->entries()) {
+						for (auto& f : e->features) {
+								f.id += 20;
+						}
+				}
+				FM fm(8);
+				auto sampler = Sampler::create(items);
+				fm.initialize(*sampler, {});
+				for (index_t j = 0; j < fm.w.rows(); ++j) {
+						fm.w(j, 0) = real_t(j % 5) / 5;
+				}
+				fm.b[0] = 0.5;
+
+				ThreadPool pool(3);
+				Recommender recommender(fm, items->entries());
+				size_t k = 5;
+				auto lists = recommender.recommend(users->entries(), k, pool);
+				REQUIRE(lists.size() == users->size());
+				for (size_t u = 0; u < users->size(); ++u) {
+						// scores of all items by FM on joined features
+						std::vector<real_t> scores;
+						for (auto& item : items->entries()) {
+								Entry pair = *(*users)[u];
+								auto& x = item->features;
+								pair.features.insert(pair.features.end(),
+													 x.begin(), x.end());
+								scores.push_back(fm.predict(pair));
+						}
+						auto& list = lists[u];
+						REQUIRE(list.size() == k);
+						for (size_t i = 0; i < k; ++i) {
+								REQUIRE(list[i].score
+										== Approx(scores[list[i].item]));
+								if (i == 0) continue;
+								REQUIRE(list[i].score <= list[i - 1].score);
+						}
+						std::sort(scores.rbegin(), scores.rend());
+						REQUIRE(list[k - 1].score == Approx(scores[k - 1]));
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("MIPS index") {
+		logger::initialize();
+		try {
+				auto users = DataSet::dummy(50, 20, 2, 3, 13);
+				auto items = DataSet::dummy(500, 40, 2, 4, 14);
+				for (auto& e : items->entries()) {
+						for (auto& f : e->features) {
+								f.id += 20;
+						}
+				}
+				FM fm(8);
+				auto sampler = Sampler::create(items);
+				fm.initialize(*sampler, {});
+
+				ThreadPool pool(3);
+				Recommender recommender(fm, items->entries());
+				size_t k = 5, n_lists = 16;
+				auto& bias = recommender.bias();
+				MipsIndex index(recommender.items(), bias, n_lists, pool);
+				REQUIRE(index.n_items() == items->size());
+				REQUIRE(index.n_lists() == n_lists);
+				auto exact = recommender.recommend(users->entries(), k, pool);
+				// all lists searched, it is exact
+				auto all = recommender.recommend(users->entries(), k, pool,
+												 index, n_lists);
+				// fewer lists searched, scores are still exact
+				auto some =
+					recommender.recommend(users->entries(), k, pool, index, 4);
+				for (size_t u = 0; u < users->size(); ++u) {
+						REQUIRE(all[u].size() == k);
+						REQUIRE(some[u].size() <= k);
+						for (size_t i = 0; i < k; ++i) {
+								REQUIRE(all[u][i].item == exact[u][i].item);
+								REQUIRE(all[u][i].score
+										== Approx(exact[u][i].score));
+						}
+						for (auto& s : some[u]) {
+								Entry pair = *(*users)[u];
+								auto& x = (*items)[s.item]->features;
+								pair.features.insert(pair.features.end(),
+													 x.begin(), x.end());
+								REQUIRE(s.score == Approx(fm.predict(pair)));
+						}
+				}
+
+				index.serialize("items.ivf");
+				MipsIndex loaded;
+				loaded.deserialize("items.ivf");
+				REQUIRE(loaded.fingerprint()
+						== MipsIndex::fingerprint(recommender.items(),
+												  recommender.bias()));
+				auto again = recommender.recommend(users->entries(), k, pool,
+												   loaded, 4);
+				for (size_t u = 0; u < users->size(); ++u) {
+						REQUIRE(again[u].size() == some[u].size());
+						for (size_t i = 0; i < again[u].size(); ++i) {
+								REQUIRE(again[u][i].item == some[u][i].item);
+						}
+				}
 		} catch (const std::exception& e) {
 				logger::error("{}", e.what());
 				throw;
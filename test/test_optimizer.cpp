@@ -1,6 +1,10 @@
 #include <catch2/catch.hpp>
 
 #include "base/logger.h"
+#include "base/thread_pool.h"
+#include "data/sampler.h"
+#include "model/fm.h"
+#include "model/lm.h"
 #include "optimizer/optimizer.h"
 
 using namespace NAMESPACE_NAME;
@@ -18,3 +22,55 @@ TEST_CASE("extras") {
                 throw;
         }
 }
+
+TEST_CASE("ALS") {
+		logger::initialize();
+		try {
+				ThreadPool pool(4);
+				auto fit = [&](Model& model, std::shared_ptr<DataSet> data) {
+						auto sampler = Sampler::create(data);
+						model.initialize(*sampler, {});
+						ALS als(1e-6);
+						real_t first = als.train_epoch(model, *sampler, pool);
+						real_t last = first;
+						for (int epoch = 0; epoch < 10; ++epoch) {
+								real_t loss =
+									als.train_epoch(model, *sampler, pool);
+								REQUIRE(loss <= last * (1 + 1e-4));
+								last = loss;
+						}
+						logger::info("ALS: loss {} -> {}", first, last);
+						return std::make_pair(first, last);
+				};
+				// fields of one feature per sample, whose features are solved
+				// in parallel, and of several, whose features are solved in
+				// turn
+				for (int n_fields : {5, 2}) {
+						auto data = DataSet::dummy(2000, 100, n_fields, 5, 7);
+						// labels given by another FM, so that they can be fit
+						FM teacher(3);
+						auto sampler = Sampler::create(data);
+						teacher.initialize(*sampler, {});
+						for (index_t j = 0; j < teacher.w.rows(); ++j) {
+								teacher.w(j, 0) = real_t(j % 7) / 7 - 0.5;
+						}
+						for (auto& entry : data->entries()) {
+								entry->label = teacher.predict(*entry);
+						}
+
+						LM lm;
+						auto [lm_first, lm_last] = fit(lm, data);
+						REQUIRE(lm_last < lm_first);
+						FM fm(3);
+						auto [fm_first, fm_last] = fit(fm, data);
+						REQUIRE(fm_last < lm_last / 10);
+				}
+
+				LM lm;
+				Entry entry;
+				REQUIRE_THROWS(ALS(0).optimize(lm, entry, 1));
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include "base/logger.h"
+#include "model/ffm.h"
+#include "model/param_server.h"
+#include "optimizer/optimizer.h"
+
+#include <thread>
+
+using namespace NAMESPACE_NAME;
+
+TEST_CASE("parameter exchange") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(20, 10, 3, 3, 1);
+				auto sampler = Sampler::create(data);
+				auto adagrad = std::make_shared<AdaGrad>(0.1, 0);
+				FFM master(2);
+				master.initialize(*sampler, adagrad->extras());
+				FFM worker = master;
+
+				auto listener = Socket::listen("ps.sock");
+				real_t loss = NAN;
+				std::thread server_thread([&] {
+						std::vector<Socket> workers;
+						workers.push_back(listener.accept());
+						ParameterServer server(master, std::move(workers), 0);
+						loss = server.run_epoch(1);
+						server.stop();
+				});
+
+				ParameterClient client(worker, Socket::connect("ps.sock"));
+				REQUIRE(client.wait_epoch() == 1);
+				Entries batch;
+				sampler->restart();
+				sampler->get_samples(5, batch);
+				for (auto& e : batch) {
+						adagrad->optimize(worker, *e, 0.5);
+				}
+				client.sync(batch);
+				client.end_epoch(3, 6);
+				REQUIRE(client.wait_epoch() == 0);
+				server_thread.join();
+
+				REQUIRE(loss == Approx(0.5));
+				// parameters are pushed, extras stay local
+				REQUIRE(master.b[0] == worker.b[0]);
+				REQUIRE(master.b[1] == Approx(1));
+				REQUIRE(worker.b[1] > 1);
+				for (auto& e : batch) {
+						for (auto& f : e->features) {
+								REQUIRE(master.w(f.id, 0) == worker.w(f.id, 0));
+								for (size_t field = 0; field < master.n_f;
+									 ++field) {
+										REQUIRE(master.get_v(f.id, field)
+												== worker.get_v(f.id, field));
+										REQUIRE(master.get_v(f.id, field, 1)
+													.isOnes());
+								}
+						}
+				}
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
@@ -33,3 +33,60 @@ TEST_CASE("composite sampler") {
 				throw;
 		}
 }
+
+TEST_CASE("prefetch sampler") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(100, 10, 2, 2, 1);
+				auto sampler = Sampler::prefetch(Sampler::create(data), 2);
+				for (int epoch = 0; epoch < 2; ++epoch) {
+						sampler->restart();
+						Entries all, batch;
+						while (size_t n = sampler->get_samples(30, batch)) {
+								REQUIRE(n == batch.size());
+								REQUIRE(n <= 30);
+								all.insert(all.end(), batch.begin(),
+										   batch.end());
+								batch.clear();
+						}
+						REQUIRE(all == data->entries());
+				}
+				// restarted while producer is still ahead
+				sampler->restart();
+				Entries batch;
+				REQUIRE(sampler->get_samples(30, batch) == 30);
+				sampler->restart();
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
+
+TEST_CASE("negative downsampling") {
+		logger::initialize();
+		try {
+				auto data = DataSet::dummy(10000, 10, 2, 2, 1);
+				auto sampler = Sampler::downsample(Sampler::create(data), 0.2);
+				size_t n_positives = 0, n_negatives = 0;
+				for (auto& e : data->entries()) {
+						(e->label > 0 ? n_positives : n_negatives)++;
+				}
+				Entries first, second;
+				while (sampler->get_samples(100, first)) {}
+				sampler->restart();
+				while (sampler->get_samples(-1, second)) {}
+				for (auto* all : {&first, &second}) {
+						size_t n_kept_positives = std::count_if(
+							all->begin(), all->end(),
+							[](auto& e) { return e->label > 0; });
+						REQUIRE(n_kept_positives == n_positives);
+						REQUIRE(all->size() - n_kept_positives
+								== Approx(n_negatives * 0.2).epsilon(0.1));
+				}
+				// drawn anew on every pass
+				REQUIRE(first != second);
+		} catch (const std::exception& e) {
+				logger::error("{}", e.what());
+				throw;
+		}
+}
@@ -0,0 +1,190 @@
+#include <catch2/catch.hpp>
+
+#include "base/logger.h"
+#include "base/socket.h"
+#include "data/sampler.h"
+#include "model/ffm.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace NAMESPACE_NAME;
+using namespace std::chrono_literals;
+
+namespace {
+
+const char* socket_path = "test_serve.sock";
+const char* model_path = "test_serve.bin";
+
+// zlearn serve, run as a child process.
+class ServeProcess {
+	public:
+		ServeProcess() {
+				m_pid = ::fork();
+				REQUIRE(m_pid >= 0);
+				if (m_pid == 0) {
+						::execl(ZLEARN_PATH, ZLEARN_PATH, "serve", "-m",
+								model_path, "--socket", socket_path, nullptr);
+						::_exit(127);
+				}
+		}
+		~ServeProcess() {
+				if (m_pid > 0) stop();
+		}
+
+		// connect once it listens.
+		Socket connect() {
+				for (int i = 0;; ++i) {
+						try {
+								return Socket::connect(socket_path);
+						} catch (const std::exception&) {
+								if (i == 200) throw;
+						}
+						std::this_thread::sleep_for(50ms);
+				}
+		}
+
+		// exit status
+		int stop() {
+				::kill(m_pid, SIGTERM);
+				int status;
+				::waitpid(m_pid, &status, 0);
+				m_pid = -1;
+				return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+		}
+
+	private:
+		pid_t m_pid = -1;
+};
+
+std::string to_line(const Entry& entry) {
+		std::string line = "0";
+		for (auto& f : entry.features) {
+				line += fmt::format(" {}:{}:{}", f.field_id, f.id, f.value);
+		}
+		return line + '\n';
+}
+
+// send lines all at once, then read a reply line for each; fewer are
+// returned if server closes connection. no REQUIRE(), as it runs on threads.
+std::vector<std::string> request(Socket& socket,
+								 const std::vector<std::string>& lines) {
+		std::string text;
+		for (auto& line : lines) {
+				text += line;
+		}
+		socket.send(text.data(), text.size());
+		std::vector<std::string> replies;
+		std::string buffer;
+		char chunk[4096];
+		while (replies.size() < lines.size()) {
+				size_t n = socket.recv_some(chunk, sizeof(chunk));
+				if (n == 0) break;
+				buffer.append(chunk, n);
+				size_t end;
+				while ((end = buffer.find('\n')) != std::string::npos) {
+						replies.push_back(buffer.substr(0, end));
+						buffer.erase(0, end + 1);
+				}
+		}
+		return replies;
+}
+
+// as serve scores a sample, which is normalized by default.
+real_t expected(Model& model, Entry entry) {
+		entry.sort_features();
+		entry.normalize();
+		return model.calibrated_predict(entry);
+}
+
+} // namespace
+
+TEST_CASE("serve") {
+		logger::initialize();
+		auto data = DataSet::dummy(100, 40, 4, 5, 20);
+		for (auto& e : data->entries()) {
+				for (auto& f : e->features) {
+						f.value = 0.5 + f.id % 3;
+				}
+		}
+		auto sampler = Sampler::create(data);
+		FFM ffm(4);
+		ffm.initialize(*sampler, {});
+		ffm.w.setRandom();
+		ffm.serialize(model_path);
+
+		std::vector<std::string> lines;
+		for (auto& e : data->entries()) {
+				lines.push_back(to_line(*e));
+		}
+		ServeProcess server;
+
+		SECTION("pipelined clients") {
+				// each client sends its lines before reading any reply, in
+				// turns with the other, and one of its lines is malformed
+				const size_t bad = 7;
+				std::vector<std::vector<std::string>> replies(2);
+				std::vector<Socket> clients;
+				for (size_t c = 0; c < replies.size(); ++c) {
+						clients.push_back(server.connect());
+				}
+				std::vector<std::thread> threads;
+				for (size_t c = 0; c < replies.size(); ++c) {
+						threads.emplace_back([&, c]() {
+								auto sent = lines;
+								if (c == 1) sent[bad] = "0 1:2 3:4:1\n";
+								for (int i = 0; i < 5; ++i) {
+										replies[c] = request(clients[c], sent);
+								}
+						});
+				}
+				for (auto& t : threads) {
+						t.join();
+				}
+				for (size_t c = 0; c < replies.size(); ++c) {
+						REQUIRE(replies[c].size() == lines.size());
+						for (size_t i = 0; i < lines.size(); ++i) {
+								auto& reply = replies[c][i];
+								if (c == 1 && i == bad) {
+										REQUIRE(reply.rfind("error: ", 0) == 0);
+										continue;
+								}
+								auto y = expected(ffm, *(*data)[i]);
+								REQUIRE(std::stof(reply)
+										== Approx(y).epsilon(1e-4));
+						}
+				}
+		}
+
+		SECTION("model replaced") {
+				auto client = server.connect();
+				auto& entry = *(*data)[0];
+				auto y = std::stof(request(client, {lines[0]})[0]);
+				REQUIRE(y == Approx(expected(ffm, entry)).epsilon(1e-4));
+
+				FFM replaced(4);
+				replaced.initialize(*sampler, {});
+				replaced.w.setRandom();
+				auto y_replaced = expected(replaced, entry);
+				REQUIRE(y_replaced != Approx(y).epsilon(1e-3));
+				std::string tmp = std::string(model_path) + ".tmp";
+				replaced.serialize(tmp.c_str());
+				REQUIRE(std::rename(tmp.c_str(), model_path) == 0);
+
+				// picked up within a few ticks of checking model file
+				bool reloaded = false;
+				for (int i = 0; i < 100 && !reloaded; ++i) {
+						std::this_thread::sleep_for(50ms);
+						y = std::stof(request(client, {lines[0]})[0]);
+						reloaded = y == Approx(y_replaced).epsilon(1e-4);
+				}
+				REQUIRE(reloaded);
+		}
+
+		REQUIRE(server.stop() == 0);
+		REQUIRE(::access(socket_path, F_OK) != 0);
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch.hpp>
 
+#include "base/numa.h"
 #include "base/thread_pool.h"
 using namespace NAMESPACE_NAME;
 
@@ -30,3 +31,21 @@ TEST_CASE("async sum") {
   auto sum = std::accumulate(A.begin(), A.end(), 0);
   REQUIRE(sum == A.size() * 5 * 10);
 }
+
+TEST_CASE("pinned workers") {
+  REQUIRE(numa::parse_list("0-3,8,10-11")
+          == std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+  REQUIRE(numa::parse_list("").empty());
+  REQUIRE(!numa::allowed_cpus().empty());
+
+  ThreadPool pool(3, true);
+  std::array<std::array<std::thread::id, 3>, 2> ids;
+  for (auto& round : ids) {
+    for (size_t i = 0; i < round.size(); ++i) {
+      pool.enqueue_to(i, [&round, i]() { round[i] = std::this_thread::get_id(); });
+    }
+    pool.sync(round.size());
+  }
+  // tasks for the same worker run on the same thread
+  REQUIRE((ids[0] == ids[1]));
+}